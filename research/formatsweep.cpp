@@ -0,0 +1,178 @@
+// Sweep MLAC coding constants over a grid of values and report compression and encoding cost over a corpus of audio files.
+// Each grid point is encoded and decoded in its own thread using MLACResearchFormat, using all CPU cores.
+//
+// Copyright 2020 Olli Niemitalo (o@iki.fi)
+//
+// Output is CSV with one row per grid point. Edit the value lists below to change the grid.
+//
+// For Emacs: -*- compile-command: "make -C .. formatsweep" -*-
+
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <sndfile.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "mlac-core.hpp"
+
+typedef MLACResearchFormat<MLACDefaultFormat> SweepFormat;
+
+// Grid of coding constant values
+const int residualExpGolombLikeMinParameters[] = {7, 8};
+const int coefShifts[] = {4, 5};
+const int c1Biases[] = {4};
+const int c2Biases[] = {-8};
+const int d0Biases[] = {8};
+const int c1ExpGolombLikeParameters[] = {2, 3, 4};
+const int c2ExpGolombLikeParameters[] = {2, 3, 4};
+const int d0ExpGolombLikeParameters[] = {2, 3, 4};
+const int warmupExpGolombLikeParameters[] = {13, 14};
+
+#define NUM_VALUES(values) ((int)(sizeof(values)/sizeof(values[0])))
+
+struct Input {
+  short *buf;
+  long int numSampleTuples;
+};
+
+struct Result {
+  MLACFormatParameters parameters;
+  long int numSampleTuples;
+  long int numBlocks;
+  double encodeSeconds;
+  bool lossless;
+};
+
+// Get grid point number index as mixed radix digits
+static MLACFormatParameters gridPoint(int index) {
+  MLACFormatParameters p;
+  p.residualExpGolombLikeMinParameter = residualExpGolombLikeMinParameters[index % NUM_VALUES(residualExpGolombLikeMinParameters)];
+  index /= NUM_VALUES(residualExpGolombLikeMinParameters);
+  p.coefShift = coefShifts[index % NUM_VALUES(coefShifts)];
+  index /= NUM_VALUES(coefShifts);
+  p.c1Bias = c1Biases[index % NUM_VALUES(c1Biases)];
+  index /= NUM_VALUES(c1Biases);
+  p.c2Bias = c2Biases[index % NUM_VALUES(c2Biases)];
+  index /= NUM_VALUES(c2Biases);
+  p.d0Bias = d0Biases[index % NUM_VALUES(d0Biases)];
+  index /= NUM_VALUES(d0Biases);
+  p.c1ExpGolombLikeParameter = c1ExpGolombLikeParameters[index % NUM_VALUES(c1ExpGolombLikeParameters)];
+  index /= NUM_VALUES(c1ExpGolombLikeParameters);
+  p.c2ExpGolombLikeParameter = c2ExpGolombLikeParameters[index % NUM_VALUES(c2ExpGolombLikeParameters)];
+  index /= NUM_VALUES(c2ExpGolombLikeParameters);
+  p.d0ExpGolombLikeParameter = d0ExpGolombLikeParameters[index % NUM_VALUES(d0ExpGolombLikeParameters)];
+  index /= NUM_VALUES(d0ExpGolombLikeParameters);
+  p.warmupExpGolombLikeParameter = warmupExpGolombLikeParameters[index % NUM_VALUES(warmupExpGolombLikeParameters)];
+  return p;
+}
+
+static const int numGridPoints = NUM_VALUES(residualExpGolombLikeMinParameters)*NUM_VALUES(coefShifts)*NUM_VALUES(c1Biases)*NUM_VALUES(c2Biases)*NUM_VALUES(d0Biases)*NUM_VALUES(c1ExpGolombLikeParameters)*NUM_VALUES(c2ExpGolombLikeParameters)*NUM_VALUES(d0ExpGolombLikeParameters)*NUM_VALUES(warmupExpGolombLikeParameters);
+
+static double threadSeconds() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec/1000000000.0;
+}
+
+// Encode and decode the corpus with the parameters of result, in the calling thread
+static void evaluate(const std::vector<Input> &inputs, Result &result) {
+  SweepFormat::setParameters(result.parameters);
+  MLACBasicEncoder<SweepFormat> encoder;
+  MLACBasicDecoder<SweepFormat> decoder;
+  uint8_t encodeBuf[SweepFormat::BLOCK_NUM_BYTES];
+  int16_t compareBuf[2*SweepFormat::BLOCK_MAX_NUM_SAMPLETUPLES];
+  result.numSampleTuples = 0;
+  result.numBlocks = 0;
+  result.encodeSeconds = 0;
+  result.lossless = true;
+  for (size_t k = 0; k < inputs.size(); k++) {
+    const int16_t *inBuf = (const int16_t *)inputs[k].buf;
+    for (long int i = 0; i < inputs[k].numSampleTuples - SweepFormat::BLOCK_MAX_NUM_SAMPLETUPLES;) {
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      double before = threadSeconds();
+      int bitDepth = encoder.encode(&inBuf[i*2], encodeBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      result.encodeSeconds += threadSeconds() - before;
+      uint8_t compareTimeStamp;
+      int compareNumSampleTuples;
+      decoder.decode(encodeBuf, compareBuf, compareTimeStamp, compareNumSampleTuples);
+      if (compareNumSampleTuples != numSampleTuplesWritten) {
+	result.lossless = false;
+      }
+      for (int j = 0; bitDepth == 16 && j < numSampleTuplesWritten*2; j++) {
+	if (compareBuf[j] != inBuf[i*2 + j]) {
+	  result.lossless = false;
+	}
+      }
+      i += numSampleTuplesWritten;
+      result.numSampleTuples += numSampleTuplesWritten;
+      result.numBlocks++;
+    }
+  }
+}
+
+int main (int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("Usage: %s input.wav [input2.wav ...]\n", argv[0]);
+    return 1;
+  }
+  if (SHRT_MAX != 0x7fff) {
+    printf("Error: C short must be 16-bit\n");
+    return 1;
+  }
+  std::vector<Input> inputs;
+  long int totalNumSampleTuples = 0;
+  int sampleRate = 44100;
+  for (int k = 1; k < argc; k++) {
+    SF_INFO sfInfo;
+    SNDFILE *sndFile = sf_open(argv[k], SFM_READ, &sfInfo);
+    if (!sndFile) {
+      printf("Error: could not open %s\n", argv[k]);
+      return 1;
+    }
+    if (sfInfo.channels != 2) {
+      printf("Error: input audio file %s must have %d channels", argv[k], 2);
+      return 1;
+    }
+    Input input;
+    input.numSampleTuples = sfInfo.frames;
+    input.buf = new short[sfInfo.frames*2];
+    sf_read_short(sndFile, input.buf, sfInfo.frames*2); // Not buffered
+    sf_close(sndFile);
+    inputs.push_back(input);
+    totalNumSampleTuples += sfInfo.frames;
+    sampleRate = sfInfo.samplerate;
+  }
+
+  std::vector<Result> results(numGridPoints);
+  std::atomic<int> nextGridPoint(0);
+  int numThreads = std::thread::hardware_concurrency();
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  fprintf(stderr, "%d grid points, %ld sample tuples, %d threads\n", numGridPoints, totalNumSampleTuples, numThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&]() {
+      for (int index = nextGridPoint++; index < numGridPoints; index = nextGridPoint++) {
+	results[index].parameters = gridPoint(index);
+	evaluate(inputs, results[index]);
+      }
+    }));
+  }
+  for (int t = 0; t < numThreads; t++) {
+    threads[t].join();
+  }
+
+  printf("residualMinParameter,coefShift,c1Bias,c2Bias,d0Bias,c1Parameter,c2Parameter,d0Parameter,warmupParameter,sampleTuplesPerPacket,encodeCPULoad,lossless\n");
+  for (int index = 0; index < numGridPoints; index++) {
+    const Result &r = results[index];
+    const MLACFormatParameters &p = r.parameters;
+    printf("%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%d\n", p.residualExpGolombLikeMinParameter, p.coefShift, p.c1Bias, p.c2Bias, p.d0Bias, p.c1ExpGolombLikeParameter, p.c2ExpGolombLikeParameter, p.d0ExpGolombLikeParameter, p.warmupExpGolombLikeParameter, r.numSampleTuples/(double)r.numBlocks, r.encodeSeconds/(r.numSampleTuples/(double)sampleRate), r.lossless);
+  }
+
+  for (size_t k = 0; k < inputs.size(); k++) {
+    delete[] inputs[k].buf;
+  }
+}
@@ -10,3 +10,21 @@ static MLACDecoder decoder;
 extern "C" int mlac_decode(const uint8_t *input, int16_t *output, uint8_t *timeStamp, int *numSampleTuplesRead) {
   return decoder.decode(input, output, *timeStamp, *numSampleTuplesRead);
 }
+
+extern "C" int mlac_decode_variable_length(const uint8_t *input, int16_t *output, uint8_t *timeStamp, int *numSampleTuplesRead, int *numBytesRead) {
+  return decoder.decodeVariableLength(input, output, *timeStamp, *numSampleTuplesRead, *numBytesRead);
+}
+
+extern "C" int mlac_decode_float(const uint8_t *input, float *left, float *right, int stride, uint8_t *timeStamp, int *numSampleTuplesRead) {
+  MLACOutput<float> output = {left, right, stride, 0};
+  return decoder.decode(input, output, *timeStamp, *numSampleTuplesRead);
+}
+
+extern "C" int mlac_decode_int32(const uint8_t *input, int32_t *left, int32_t *right, int stride, int shift, uint8_t *timeStamp, int *numSampleTuplesRead) {
+  MLACOutput<int32_t> output = {left, right, stride, shift};
+  return decoder.decode(input, output, *timeStamp, *numSampleTuplesRead);
+}
+
+extern "C" void mlac_decoder_restart_stream() {
+  decoder.restartStream();
+}
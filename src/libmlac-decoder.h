@@ -20,14 +20,31 @@ extern "C" {
 
   // MLAC decode
   // Arguments:
-  //   input = pointer to beginning of a block of MLAC_BLOCK_NUM_BYTES encoded audio.
+  //   input = pointer to beginning of a block of MLAC_BLOCK_NUM_BYTES encoded audio. Blocks of a stream must be decoded in order.
   //   output = pointer to beggining of interleaved stereo 16-bit audio that must have room for at least MLAC_BLOCK_MAX_NUM_SAMPLETUPLES stereo samples to be written.
   // Returns:
   //   timeStamp = time stamp read, not yet implemented. NOTE: TIME STAMPS ARE NOT YET FUNCTIONAL AND ARE INSTEAD USED FOR STORING NUMBER OF SAMPLE TUPLES
   //   numSampleTuplesRead = number of stereo samples read
-  //   Return value = Effective resolution of audio in bits, 16 for lossless compression, less for lossy compression
+  //   Return value = Effective resolution of audio in bits, 16 for lossless compression, less for lossy compression,
+  //                  0 for a block that could not be decoded after mlac_decoder_restart_stream. Its output is silence.
   extern int mlac_decode(const uint8_t *input, int16_t *output, uint8_t *timeStamp, int *numSampleTuplesRead);
 
+  // MLAC decode a variable-length packet written by mlac_encode_next_variable_length. Same as mlac_decode, but input points to the beginning
+  // of a packet of at most MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES bytes, and numBytesRead returns the number of bytes of the packet.
+  extern int mlac_decode_variable_length(const uint8_t *input, int16_t *output, uint8_t *timeStamp, int *numSampleTuplesRead, int *numBytesRead);
+
+  // MLAC decode to float audio from -1 to 1. Same as mlac_decode, but the left and right channel samples of stereo sample i are written to left[i*stride]
+  // and right[i*stride]: for interleaved stereo, right = left + 1 and stride = 2, and for planar stereo, stride = 1. The samples are converted as they
+  // are written, without a 16-bit buffer in between.
+  extern int mlac_decode_float(const uint8_t *input, float *left, float *right, int stride, uint8_t *timeStamp, int *numSampleTuplesRead);
+
+  // MLAC decode to 32-bit integer audio. Same as mlac_decode_float, but the 16-bit samples are shifted left by shift bits, for example by 8 for 24-bit
+  // samples in the low bits and by 16 for 32-bit samples.
+  extern int mlac_decode_int32(const uint8_t *input, int32_t *left, int32_t *right, int stride, int shift, uint8_t *timeStamp, int *numSampleTuplesRead);
+
+  // Forget the previous blocks. Call this after a lost block, so that blocks that continue from it are not decoded until the next independent block.
+  extern void mlac_decoder_restart_stream();
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,3 +10,50 @@ static MLACEncoder encoder;
 extern "C" int mlac_encode(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples) {
   return encoder.encode(input, output, timeStamp, *numSampleTuplesWritten, *numBitsWritten, minNumSampleTuples);
 }
+
+extern "C" int mlac_encode_next(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples) {
+  return encoder.encodeNext(input, output, timeStamp, *numSampleTuplesWritten, *numBitsWritten, minNumSampleTuples);
+}
+
+extern "C" int mlac_encode_next_variable_length(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBytesWritten, int minNumSampleTuples) {
+  return encoder.encodeNextVariableLength(input, output, timeStamp, *numSampleTuplesWritten, *numBytesWritten, minNumSampleTuples);
+}
+
+extern "C" int mlac_encode_next_float(const float *left, const float *right, int stride, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples) {
+  MLACInput<float> input = {left, right, stride, 0};
+  return encoder.encodeNext(input, output, timeStamp, *numSampleTuplesWritten, *numBitsWritten, minNumSampleTuples);
+}
+
+extern "C" int mlac_encode_next_int32(const int32_t *left, const int32_t *right, int stride, int shift, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples) {
+  MLACInput<int32_t> input = {left, right, stride, shift};
+  return encoder.encodeNext(input, output, timeStamp, *numSampleTuplesWritten, *numBitsWritten, minNumSampleTuples);
+}
+
+extern "C" int mlac_encode_anytime(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, long budgetMicroseconds, int *refinementLevel, int minNumSampleTuples) {
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budgetMicroseconds);
+  return encoder.encodeAnytime(input, output, timeStamp, *numSampleTuplesWritten, *numBitsWritten, deadline, *refinementLevel, minNumSampleTuples);
+}
+
+extern "C" void mlac_encoder_set_effort(int effort) {
+  encoder.effort = effort;
+}
+
+extern "C" void mlac_encoder_set_independent_block_interval(int independentBlockInterval) {
+  encoder.independentBlockInterval = independentBlockInterval;
+}
+
+extern "C" void mlac_encoder_set_lookahead(int lookaheadNumBlocks) {
+  encoder.lookaheadNumBlocks = lookaheadNumBlocks;
+}
+
+extern "C" void mlac_encoder_set_frame_length(int frameNumSampleTuples) {
+  encoder.frameNumSampleTuples = frameNumSampleTuples;
+}
+
+extern "C" void mlac_encoder_set_dither(int dither) {
+  encoder.dither = dither != 0;
+}
+
+extern "C" void mlac_encoder_set_max_length(int maxNumSampleTuples) {
+  encoder.blockMaxNumSampleTuples = maxNumSampleTuples;
+}
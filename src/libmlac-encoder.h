@@ -26,9 +26,79 @@ extern "C" {
   //   numSampleTuplesWritten = number of stereo sample pairs encoded
   //   numBitsWritten = number of bits written (if less than MLAC_BLOCK_NUM_BYTES*8, then there is room for auxiliary data after encoded audio)
   //   minNumSampleTuples = minimum number of stero samples that must fit to packet, range: MLAC_BLOCK_MIN_NUM_SAMPLETUPLES inclusive to BLOCK_MAX_NUM_SAMPLETUPLES inclusive.
-  //                        this setting can force lossy compression.
+  //                        this setting can force lossy compression: near-lossless linear prediction at the highest true bit depth that fits,
+  //                        or if that is not better, the most significant bits as PCM. Lossy compression does not go below 8 bits, so a packet may have fewer
+  //                        stereo samples than asked if MLAC_BLOCK_MAX_NUM_SAMPLETUPLES is more than fit in a packet at 8 bits.
   //   Return value = Effective resolution of audio in bits, 16 for lossless compression, less for lossy compression
   extern int mlac_encode(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples);
+
+  // MLAC encode the next block of a continuous stream. Same as mlac_encode, but input must continue numSampleTuplesWritten stereo samples after the input of
+  // the previous call to mlac_encode_next, unless mlac_encode was called in between. This is faster than mlac_encode and gives the same output,
+  // unless stream mode is enabled by mlac_encoder_set_independent_block_interval.
+  extern int mlac_encode_next(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples);
+
+  // MLAC encode the next block of a continuous stream as a variable-length packet for file storage, without padding. Same as mlac_encode_next,
+  // but output must have room for MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES bytes, and numBytesWritten returns the number of bytes of the packet.
+  // Decode the packets with mlac_decode_variable_length.
+  extern int mlac_encode_next_variable_length(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBytesWritten, int minNumSampleTuples);
+
+  // MLAC encode the next block of a continuous stream from float audio, nominally from -1 to 1. Same as mlac_encode_next, but the left and right
+  // channel samples of stereo sample i are left[i*stride] and right[i*stride]: for interleaved stereo, right = left + 1 and stride = 2, and for
+  // planar stereo, stride = 1. The samples are converted to 16 bits, dithered if set by mlac_encoder_set_dither, in the same pass that the encoder
+  // reads them. Lookahead mode is not used.
+  extern int mlac_encode_next_float(const float *left, const float *right, int stride, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples);
+
+  // MLAC encode the next block of a continuous stream from 32-bit integer audio. Same as mlac_encode_next_float, but the samples are shifted right
+  // by shift bits, for example by 8 for 24-bit samples in the low bits and by 16 for 32-bit samples, and clipped to 16 bits.
+  extern int mlac_encode_next_int32(const int32_t *left, const int32_t *right, int stride, int shift, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, int minNumSampleTuples);
+
+  // MLAC encode within a time budget (anytime encoding). Same as mlac_encode, but returns within about budgetMicroseconds microseconds.
+  // A packet of the most significant bits as PCM is made first, and then refined by linear prediction at efforts MLAC_EFFORT_FASTEST
+  // up to the effort set by mlac_encoder_set_effort, as long as each is expected to finish in time. The encoder learns the time of each
+  // refinement from earlier calls, so the first calls may run late.
+  // Returns also:
+  //   refinementLevel = highest refinement level reached, MLAC_REFINEMENT_MSB or MLAC_REFINEMENT_LPC + effort
+  extern int mlac_encode_anytime(const int16_t *input, uint8_t *output, uint8_t timeStamp, int *numSampleTuplesWritten, int *numBitsWritten, long budgetMicroseconds, int *refinementLevel, int minNumSampleTuples);
+
+  // Set MLAC encoder effort level
+  // Arguments:
+  //   effort = MLAC_EFFORT_FASTEST (default) to MLAC_EFFORT_MAX. Higher effort uses more CPU time to fit more stereo samples to each packet.
+  extern void mlac_encoder_set_effort(int effort);
+
+  // Set MLAC encoder stream mode
+  // Arguments:
+  //   independentBlockInterval = number of blocks from one independent block to the next in mlac_encode_next, 1 (default) for all blocks independent.
+  //                              The blocks in between continue from the previous block and fit more stereo samples, but cannot be decoded if
+  //                              the blocks before them were lost.
+  extern void mlac_encoder_set_independent_block_interval(int independentBlockInterval);
+
+  // Set MLAC encoder lookahead mode
+  // Arguments:
+  //   lookaheadNumBlocks = number of packets over which mlac_encode_next and mlac_encode_next_variable_length place the end of the current packet,
+  //                        1 (default) for packets as long as fit. Above 1, the input must contain at least
+  //                        lookaheadNumBlocks*MLAC_BLOCK_MAX_NUM_SAMPLETUPLES stereo samples. Saves a few tenths of a percent of variable-length
+  //                        packet bytes on transient-rich material, at many times the encoding time.
+  extern void mlac_encoder_set_lookahead(int lookaheadNumBlocks);
+
+  // Set MLAC encoder fixed-frame mode for isochronous transports
+  // Arguments:
+  //   frameNumSampleTuples = number of stereo samples of every packet, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES exclusive to MLAC_BLOCK_MAX_NUM_SAMPLETUPLES inclusive,
+  //                          or 0 (default) for off. Each packet is lossless if the frame fits, otherwise lossy at the highest true bit depth that fits,
+  //                          which can then go below 8 bits. minNumSampleTuples and lookahead mode are ignored. The bits after numBitsWritten
+  //                          are free for auxiliary data.
+  extern void mlac_encoder_set_frame_length(int frameNumSampleTuples);
+
+  // Set MLAC encoder dither of float input
+  // Arguments:
+  //   dither = 1 to add triangular dither of 2 LSB peak to peak to the input of mlac_encode_next_float before rounding to 16 bits, 0 (default) for none.
+  extern void mlac_encoder_set_dither(int dither);
+
+  // Set MLAC encoder maximum packet length, for a shorter input lookahead
+  // Arguments:
+  //   maxNumSampleTuples = maximum number of stereo samples of a packet, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES exclusive to MLAC_BLOCK_MAX_NUM_SAMPLETUPLES
+  //                        inclusive (default). The input of the encode functions must then contain at least maxNumSampleTuples stereo samples
+  //                        instead of MLAC_BLOCK_MAX_NUM_SAMPLETUPLES. The packets are decoded as usual.
+  extern void mlac_encoder_set_max_length(int maxNumSampleTuples);
   
 #ifdef __cplusplus
 }
@@ -4,6 +4,36 @@
 
 #pragma once
 
+// Packet size and block length limits of the default format. The encoder needs MLAC_BLOCK_MAX_NUM_SAMPLETUPLES stereo samples of
+// input lookahead, and the decoder needs room for as many in its output. For a shorter lookahead, set a lower maximum in the encoder
+// at run time (mlac_encoder_set_max_length). Quiet material can fill packets of up to 255 stereo samples if both the encoder and the
+// decoder are compiled with a higher MLAC_BLOCK_MAX_NUM_SAMPLETUPLES. That changes the format: a decoder compiled with a lower value
+// than the encoder outputs silence for the longer packets.
+#ifndef MLAC_BLOCK_NUM_BYTES
 #define MLAC_BLOCK_NUM_BYTES 244
+#endif
+#ifndef MLAC_BLOCK_MAX_NUM_SAMPLETUPLES
 #define MLAC_BLOCK_MAX_NUM_SAMPLETUPLES 121
+#endif
+#ifndef MLAC_BLOCK_MIN_NUM_SAMPLETUPLES
 #define MLAC_BLOCK_MIN_NUM_SAMPLETUPLES 60
+#endif
+
+// The decoder keeps only the stream state of a few dozen bytes between blocks. It decodes a block through a buffer of delta values on the
+// stack, big enough for the whole block by default. For microcontrollers, compile with -DMLAC_LOW_RAM to decode 16 sample tuples at a time
+// through a buffer of up to 24 delta values per channel instead, at some cost in speed. The output is the same. MLAC_LOW_RAM does not change
+// the encoders; MLACCompactEncoder is the encoder that keeps no buffers.
+
+// Maximum number of bytes of a variable-length packet for file storage: a block and its length prefix
+#define MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES (MLAC_BLOCK_NUM_BYTES + ((MLAC_BLOCK_NUM_BYTES <= 0x100) ? 1 : 2))
+
+// Encoder effort levels
+#define MLAC_EFFORT_FASTEST 0
+#define MLAC_EFFORT_RESELECT_PARAMETERS 1
+#define MLAC_EFFORT_REFIT 2
+#define MLAC_EFFORT_MAX 3
+
+// Refinement levels of anytime encoding: a block of the most significant bits as PCM, then linear prediction at effort
+// MLAC_EFFORT_FASTEST and up, level MLAC_REFINEMENT_LPC + effort
+#define MLAC_REFINEMENT_MSB 0
+#define MLAC_REFINEMENT_LPC 1
@@ -11,16 +11,14 @@
 
 #include <limits.h>
 #include <cstdint>
+#include <chrono>
 #include <math.h>
 #include "mlac-constants.h"
 
 // Constants that are used in both the encoder and the decoder. Changing these will redefine the compression format. Some come from mlac-constants.h.
-const int BLOCK_NUM_BYTES = MLAC_BLOCK_NUM_BYTES; // Number of bytes per block of compressed data
-const int BLOCK_MAX_NUM_SAMPLETUPLES = MLAC_BLOCK_MAX_NUM_SAMPLETUPLES; // Maximum number of sample tuples
-const int BLOCK_MIN_NUM_SAMPLETUPLES = MLAC_BLOCK_MIN_NUM_SAMPLETUPLES; // Minimum number of sample tuples
+// The coding constants below are the defaults of MLACFormat. The block constants further below are those of the default format.
 const int NUM_LP_COEFS = 2; // 
 const int RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER = 7;
-const int NUM_ITERATIONS = 1;
 const int COEF_DIVISOR = 16;
 const int COEF_SHIFT = 4;
 const int C1_BIAS = 4;
@@ -29,6 +27,26 @@ const int D0_BIAS = 8;
 const int C1_EXPGOLOMBLIKE_PARAMETER = 3;
 const int C2_EXPGOLOMBLIKE_PARAMETER = 3;
 const int D0_EXPGOLOMBLIKE_PARAMETER = 3;
+const int WARMUP_EXPGOLOMBLIKE_PARAMETER = 14;
+const int COEF_DELTA_EXPGOLOMBLIKE_PARAMETER = 2;
+const int MAX_LP_ORDER = 8; // Largest maximum linear prediction order of a format. Blocks of order NUM_LP_COEFS have their own coefficient coding.
+const int LP_ORDER_NUM_BITS = 3; // Number of bits for orders above NUM_LP_COEFS
+const int HIGH_ORDER_COEF_SHIFT = 8; // Coefficient fractional bits for orders above NUM_LP_COEFS
+const int HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER = 6;
+const int ADAPTIVE_RESIDUAL_SHIFT = 3; // The adaptive residual exp-Golomb-like parameter follows about the last 2^ADAPTIVE_RESIDUAL_SHIFT residuals
+const int LOW_RAM_CHUNK_NUM_SAMPLETUPLES = 16; // Number of sample tuples that the decoder decodes at a time if compiled with MLAC_LOW_RAM
+const int ADAPTIVE_RESIDUAL_BIAS = -1; // Adaptive exp-Golomb-like parameter minus bit depth of the mean residual magnitude
+const int RANS_PROB_BITS = 12; // Symbol frequencies of a rANS table sum to 2^RANS_PROB_BITS. The coder state is kept at 2^RANS_PROB_BITS .. 2^(RANS_PROB_BITS+1)-1
+const int RANS_SYMBOL_BITS = 5; // rANS symbols are residual >> raw number of bits, from -2^(RANS_SYMBOL_BITS-1) to 2^(RANS_SYMBOL_BITS-1)-1, or escape
+const int RANS_ESCAPE = 1 << RANS_SYMBOL_BITS; // Escape symbol, followed by the residual as an exp-Golomb-like code
+const int RANS_NUM_SYMBOLS = RANS_ESCAPE + 1;
+const int RANS_TABLE_NUM_BITS = 2;
+const int RANS_NUM_TABLES = 1 << RANS_TABLE_NUM_BITS;
+const int RANS_RAW_NUM_BITS_NUM_BITS = 4;
+const int RANS_MAX_RAW_NUM_BITS = 16 - RANS_SYMBOL_BITS; // No residual needs escape with this many raw bits
+const int RANS_ESCAPE_MIN_EXPGOLOMBLIKE_PARAMETER = 7; // Keeps escape codes short enough for BitStreamReader::readExpGolombLike
+const int RANS_COST_SHIFT = 8; // Fractional bits of rANS symbol costs in the encoder
+const int LOW_NUM_BITS_NUM_BITS = 4; // Number of bits of the shift and of the number of low bits coded in a linear prediction block of MLAC24BitFormat
 // *** Exp-Golomb-like code parameter value 3 enables integer coefficient values in range -4096..4095 with the current implementation of reader and writer.
 const int C1_MIN = -4096;
 const int C1_MAX = 4095;
@@ -36,20 +54,226 @@ const int C2_MIN = -4096;
 const int C2_MAX = 4095;
 const int D0_MIN = -4096;
 const int D0_MAX = 4095;
+// *** Exp-Golomb-like code parameter value 2 enables coefficient delta values in range -4096..4095.
+const int COEF_DELTA_MIN = -4096;
+const int COEF_DELTA_MAX = 4095;
+// Coefficient range for orders above NUM_LP_COEFS. Keeps the MAX_LP_ORDER + 1 products of prediction within int32.
+const int HIGH_ORDER_COEF_MIN = -4096;
+const int HIGH_ORDER_COEF_MAX = 4095;
+static_assert(MAX_LP_ORDER - NUM_LP_COEFS <= (1 << LP_ORDER_NUM_BITS), "Orders must fit in LP_ORDER_NUM_BITS");
+
+// Compression format descriptor. The packet size and block length limits are compile-time constants of the format, so that
+// encoders and decoders of several formats can be instantiated side by side, for example for different transports.
+// A format with maxLPOrder above NUM_LP_COEFS codes the prediction order of each block and can use orders up to maxLPOrder.
+// That costs a bit per block, which higher orders seldom pay back in short blocks, so the default format has only order NUM_LP_COEFS.
+// A format with adaptiveResiduals can code the residuals of a block with exp-Golomb-like parameters that adapt from residual to
+// residual, at the cost of a bit per block.
+// A format with ransResiduals can code the residuals of a block with a static-table rANS coder, also at the cost of a bit per block.
+template <int blockNumBytes, int blockMaxNumSampleTuples, int blockMinNumSampleTuples, int maxLPOrder = NUM_LP_COEFS, bool adaptiveResiduals = false, bool ransResiduals = false>
+struct MLACFormat {
+  static const int BLOCK_NUM_BYTES = blockNumBytes; // Number of bytes per block of compressed data
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = blockMaxNumSampleTuples; // Maximum number of sample tuples
+  static const int BLOCK_MIN_NUM_SAMPLETUPLES = blockMinNumSampleTuples; // Minimum number of sample tuples
+  static const int MAX_LP_ORDER = maxLPOrder; // Maximum linear prediction order
+  static const bool ADAPTIVE_RESIDUALS = adaptiveResiduals; // Can blocks code residuals with adaptive exp-Golomb-like parameters
+  static const bool RANS_RESIDUALS = ransResiduals; // Can blocks code residuals with rANS
+  static const int NUM_CHANNELS = 2; // Number of channels, 1 in MLACMonoFormat
+  static const int CHMODE_NUM_BITS = 2; // Number of bits of the channel mode field
+  static const int LOW_NUM_BITS = 0; // Number of bits of a sample below its 16 predicted bits, 8 in MLAC24BitFormat
+  static_assert(MAX_LP_ORDER >= NUM_LP_COEFS && MAX_LP_ORDER <= ::MAX_LP_ORDER, "Invalid maximum linear prediction order");
+  static_assert(BLOCK_MAX_NUM_SAMPLETUPLES <= 255, "Number of sample tuples must fit in 8 bits");
+  static_assert(BLOCK_MIN_NUM_SAMPLETUPLES >= 4 && BLOCK_MIN_NUM_SAMPLETUPLES < BLOCK_MAX_NUM_SAMPLETUPLES, "Invalid minimum number of sample tuples");
+  static_assert(BLOCK_NUM_BYTES*8 >= 8 + 2 + 4 + 2*8*BLOCK_MIN_NUM_SAMPLETUPLES, "Minimum number of sample tuples must fit in CHMODE_MSB");
+  static_assert(BLOCK_NUM_BYTES <= 0x10000, "Block length must fit in the length prefix of a variable-length packet");
+
+  // Variable-length packets for file storage have the block cut to whole bytes, preceded by the number of bytes of the block minus 1
+  static const int PACKET_LENGTH_NUM_BYTES = (BLOCK_NUM_BYTES <= 0x100) ? 1 : 2; // Number of bytes of the length prefix, MSB first
+  static const int VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES = PACKET_LENGTH_NUM_BYTES + BLOCK_NUM_BYTES;
+
+  // Coding constants
+  static const int RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER = ::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+  static const int COEF_SHIFT = ::COEF_SHIFT;
+  static const int C1_BIAS = ::C1_BIAS;
+  static const int C2_BIAS = ::C2_BIAS;
+  static const int D0_BIAS = ::D0_BIAS;
+  static const int C1_EXPGOLOMBLIKE_PARAMETER = ::C1_EXPGOLOMBLIKE_PARAMETER;
+  static const int C2_EXPGOLOMBLIKE_PARAMETER = ::C2_EXPGOLOMBLIKE_PARAMETER;
+  static const int D0_EXPGOLOMBLIKE_PARAMETER = ::D0_EXPGOLOMBLIKE_PARAMETER;
+  static const int WARMUP_EXPGOLOMBLIKE_PARAMETER = ::WARMUP_EXPGOLOMBLIKE_PARAMETER;
+  static const int COEF_DELTA_EXPGOLOMBLIKE_PARAMETER = ::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER;
+  static const int HIGH_ORDER_COEF_SHIFT = ::HIGH_ORDER_COEF_SHIFT;
+  static const int HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER = ::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER;
+
+  // Number of sample tuples in a CHMODE_MSB block of the given true bit depth
+  static constexpr int chModeMSBNumSampleTuples(int trueBitDepth) {
+    return (trueBitDepth < 8) ? 0 : ((BLOCK_NUM_BYTES*8-8-2-4)/(2*trueBitDepth) < BLOCK_MAX_NUM_SAMPLETUPLES) ? (BLOCK_NUM_BYTES*8-8-2-4)/(2*trueBitDepth) : BLOCK_MAX_NUM_SAMPLETUPLES;
+  }
+};
+
+// Mono format with the packet size, block length limits and residual codings of BaseFormat. A sample tuple is a single sample. Blocks
+// are coded like those of BaseFormat with only the independent channel of CHMODE_INDEPENDENT_AND_DEPENDENT, which is the left channel of
+// MLACInput and MLACOutput: the channel mode field has one bit, for CHMODE_INDEPENDENT_AND_DEPENDENT or CHMODE_MSB, and the warmup,
+// exp-Golomb-like parameter or rANS table and state, coefficients and residuals of the dependent channel are left out, and so is the
+// right channel of CHMODE_MSB blocks. Mono audio thus costs about half of the same audio in both channels of BaseFormat.
+template <class BaseFormat>
+struct MLACMonoFormat: BaseFormat {
+  static const int NUM_CHANNELS = 1;
+  static const int CHMODE_NUM_BITS = 1;
+  static const int BLOCK_NUM_BYTES = BaseFormat::BLOCK_NUM_BYTES;
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = BaseFormat::BLOCK_MAX_NUM_SAMPLETUPLES;
+  static constexpr int chModeMSBNumSampleTuples(int trueBitDepth) {
+    return (trueBitDepth < 8) ? 0 : ((BLOCK_NUM_BYTES*8-8-1-4)/trueBitDepth < BLOCK_MAX_NUM_SAMPLETUPLES) ? (BLOCK_NUM_BYTES*8-8-1-4)/trueBitDepth : BLOCK_MAX_NUM_SAMPLETUPLES;
+  }
+};
+
+// 24-bit format with the packet size, block length limits, channels and residual codings of BaseFormat. Samples have LOW_NUM_BITS
+// more bits below the 16 bits of BaseFormat. A linear prediction block codes the samples shifted right by 0 to LOW_NUM_BITS bits, the
+// fewest that bring all of them to 16 bits, as BaseFormat does, so that quiet audio is predicted at its full resolution. The residuals
+// are followed by the shift and the number of low bits coded (LOW_NUM_BITS_NUM_BITS bits each), and the bits below the shift of the
+// sample tuples in order as they are, with any of them that are zero in all of the sample tuples left out. A continuation block has
+// the shift of the block before it, which is LOW_NUM_BITS after blocks of other kinds. Loud blocks cost up to NUM_CHANNELS*LOW_NUM_BITS
+// bits per sample tuple more than in BaseFormat, so BaseFormat should have larger packets than the default format to fit its longer
+// blocks. Constant runs must have low bits of zero. CHMODE_MSB and near-lossless blocks code only the 16 most significant bits and are
+// lossy.
+template <class BaseFormat>
+struct MLAC24BitFormat: BaseFormat {
+  static const int LOW_NUM_BITS = 8;
+};
+
+// The default format, from mlac-constants.h. This is the format of MLACEncoder, MLACDecoder and the C wrappers.
+typedef MLACFormat<MLAC_BLOCK_NUM_BYTES, MLAC_BLOCK_MAX_NUM_SAMPLETUPLES, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES> MLACDefaultFormat;
+static_assert(MLACDefaultFormat::VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES == MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES, "Update MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES");
+
+const int BLOCK_NUM_BYTES = MLACDefaultFormat::BLOCK_NUM_BYTES; // Number of bytes per block of compressed data in the default format
+const int BLOCK_MAX_NUM_SAMPLETUPLES = MLACDefaultFormat::BLOCK_MAX_NUM_SAMPLETUPLES; // Maximum number of sample tuples in the default format
+const int BLOCK_MIN_NUM_SAMPLETUPLES = MLACDefaultFormat::BLOCK_MIN_NUM_SAMPLETUPLES; // Minimum number of sample tuples in the default format
+
+// Run-time values of the coding constants of MLACFormat, for research on the compression format
+struct MLACFormatParameters {
+  int residualExpGolombLikeMinParameter; // Must be at least RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER
+  int coefShift; // 1 to 12
+  int c1Bias;
+  int c2Bias;
+  int d0Bias;
+  int c1ExpGolombLikeParameter; // Coefficient parameters must be at least 1
+  int c2ExpGolombLikeParameter;
+  int d0ExpGolombLikeParameter;
+  int warmupExpGolombLikeParameter; // Must be at least 6
+  MLACFormatParameters(): residualExpGolombLikeMinParameter(RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER), coefShift(COEF_SHIFT), c1Bias(C1_BIAS), c2Bias(C2_BIAS), d0Bias(D0_BIAS), c1ExpGolombLikeParameter(C1_EXPGOLOMBLIKE_PARAMETER), c2ExpGolombLikeParameter(C2_EXPGOLOMBLIKE_PARAMETER), d0ExpGolombLikeParameter(D0_EXPGOLOMBLIKE_PARAMETER), warmupExpGolombLikeParameter(WARMUP_EXPGOLOMBLIKE_PARAMETER) {
+  }
+};
+
+// Research format in which the coding constants of BaseFormat are variables that can be set at run time using setParameters,
+// to tune them without recompiling. Each thread has its own values. Only for research: a decoder must use the same values as the encoder,
+// and encoding and decoding are slower than with constants.
+template <class BaseFormat>
+struct MLACResearchFormat: BaseFormat {
+  static thread_local int RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+  static thread_local int COEF_SHIFT;
+  static thread_local int C1_BIAS;
+  static thread_local int C2_BIAS;
+  static thread_local int D0_BIAS;
+  static thread_local int C1_EXPGOLOMBLIKE_PARAMETER;
+  static thread_local int C2_EXPGOLOMBLIKE_PARAMETER;
+  static thread_local int D0_EXPGOLOMBLIKE_PARAMETER;
+  static thread_local int WARMUP_EXPGOLOMBLIKE_PARAMETER;
+
+  // Set the coding constants of the calling thread
+  static void setParameters(const MLACFormatParameters &parameters) {
+    RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER = parameters.residualExpGolombLikeMinParameter;
+    COEF_SHIFT = parameters.coefShift;
+    C1_BIAS = parameters.c1Bias;
+    C2_BIAS = parameters.c2Bias;
+    D0_BIAS = parameters.d0Bias;
+    C1_EXPGOLOMBLIKE_PARAMETER = parameters.c1ExpGolombLikeParameter;
+    C2_EXPGOLOMBLIKE_PARAMETER = parameters.c2ExpGolombLikeParameter;
+    D0_EXPGOLOMBLIKE_PARAMETER = parameters.d0ExpGolombLikeParameter;
+    WARMUP_EXPGOLOMBLIKE_PARAMETER = parameters.warmupExpGolombLikeParameter;
+  }
+};
+
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER = BaseFormat::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::COEF_SHIFT = BaseFormat::COEF_SHIFT;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::C1_BIAS = BaseFormat::C1_BIAS;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::C2_BIAS = BaseFormat::C2_BIAS;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::D0_BIAS = BaseFormat::D0_BIAS;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::C1_EXPGOLOMBLIKE_PARAMETER = BaseFormat::C1_EXPGOLOMBLIKE_PARAMETER;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::C2_EXPGOLOMBLIKE_PARAMETER = BaseFormat::C2_EXPGOLOMBLIKE_PARAMETER;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::D0_EXPGOLOMBLIKE_PARAMETER = BaseFormat::D0_EXPGOLOMBLIKE_PARAMETER;
+template <class BaseFormat> thread_local int MLACResearchFormat<BaseFormat>::WARMUP_EXPGOLOMBLIKE_PARAMETER = BaseFormat::WARMUP_EXPGOLOMBLIKE_PARAMETER;
+
+// Encoder effort levels. These trade encoder CPU time for compression and do not change the compression format. Some come from mlac-constants.h.
+// Fastest: One linear prediction fit and fixed exp-Golomb-like parameters during tail extension
+const int EFFORT_FASTEST = MLAC_EFFORT_FASTEST;
+// Also re-select the exp-Golomb-like parameters when tail extension runs out of bits
+const int EFFORT_RESELECT_PARAMETERS = MLAC_EFFORT_RESELECT_PARAMETERS;
+// Also re-fit the linear prediction coefficients to the extended block, and try higher prediction orders if the format has them
+const int EFFORT_REFIT = MLAC_EFFORT_REFIT;
+// Also search neighbouring quantized coefficient values
+const int EFFORT_MAX = MLAC_EFFORT_MAX;
+const int EFFORT_DEFAULT = EFFORT_FASTEST;
+const int REFIT_NUM_ITERATIONS = 3; // Number of linear prediction fits at effort EFFORT_REFIT and above
+const int NEIGHBOUR_SEARCH_MAX_NUM_PASSES = 4;
+
+// Refinement levels of anytime encoding, see MLACBasicEncoder::encodeAnytime. Some come from mlac-constants.h.
+// A CHMODE_MSB block, which needs no analysis
+const int REFINEMENT_MSB = MLAC_REFINEMENT_MSB;
+// The block of encode at effort EFFORT_FASTEST. Level REFINEMENT_LPC + effort is that at a higher effort.
+const int REFINEMENT_LPC = MLAC_REFINEMENT_LPC;
+const int NUM_REFINEMENT_LEVELS = REFINEMENT_LPC + EFFORT_MAX + 1;
+const int REFINEMENT_DURATION_DECAY = 64; // Number of blocks over which a duration estimate of a refinement level decays by a factor of e
+const int LOOKAHEAD_NUM_CANDIDATES = 7; // Number of block lengths shorter than the greedy one that lookahead mode tries
 
 // Channel modes
 // Left channel is independently coded. Right channel is coded as dependent on the left channel
 const int CHMODE_INDEPENDENT_AND_DEPENDENT = 0;
 // The left and right channel are coded independently. Lossy coding of the MSBs only or PCM coding if all bits are included,
+// or a constant run or near-lossless block, see CONSTANT_RUN_CODE and NEAR_LOSSLESS_CODE
 const int CHMODE_MSB = 1;
+// Right channel is independently coded. Left channel is coded as dependent on the right channel
+const int CHMODE_DEPENDENT_AND_INDEPENDENT = 2;
+// Mid channel is independently coded. Side channel is coded as dependent on the mid channel. See midSide.
+const int CHMODE_MID_AND_SIDE = 3;
+
+// Coefficient codings of linear prediction blocks. A continuation block has no warmup and continues from the decoded samples of the previous block.
+// Independent block, coefficients are coded as such
+const int COEF_CODING_INDEPENDENT = 0;
+// Continuation block, coefficients are coded as deltas from those of the previous linear prediction block
+const int COEF_CODING_DELTA = 1;
+// Continuation block, the coefficients of the previous linear prediction block are reused
+const int COEF_CODING_REUSE = 2;
 
 // Base bit depths: Exp-Golomb-like code in reverse order:
 //const int bitDepths = {15, 14, 13, 12, 11, 10, 9, 8, 7}
 const int residualExpGolombLikeParameterEncodingNumBits[9] = {8, 8, 7, 6, 5, 4, 3, 2, 1};
 const int residualExpGolombLikeParameterEncodings[9] = {0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01}; // 00000000, 00000001, 0000001, 000001, 00001, 0001, 001, 01, 1
 
-const int chModeMSBNumSampleTuples[17] = {0, 0, 0, 0, 0, 0, 0, 0, (BLOCK_NUM_BYTES*8-8-2-4)/(2*8), (BLOCK_NUM_BYTES*8-8-2-4)/(2*9), (BLOCK_NUM_BYTES*8-8-2-4)/(2*10), (BLOCK_NUM_BYTES*8-8-2-4)/(2*11), (BLOCK_NUM_BYTES*8-8-2-4)/(2*12), (BLOCK_NUM_BYTES*8-8-2-4)/(2*13), (BLOCK_NUM_BYTES*8-8-2-4)/(2*14), (BLOCK_NUM_BYTES*8-8-2-4)/(2*15),(BLOCK_NUM_BYTES*8-8-2-4)/(2*16)};
+// Static rANS tables of a Laplacian distribution of residual >> raw number of bits, with the given scale. The last symbol is escape.
+const uint16_t ransCumFreqs[RANS_NUM_TABLES][RANS_NUM_SYMBOLS + 1] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 21, 45, 109, 284, 756, 2047, 3338, 3811, 3986, 4050, 4074, 4083, 4086, 4087, 4088, 4089, 4090, 4091, 4092, 4093, 4094, 4095, 4096}, // Scale 1
+  {0, 1, 2, 3, 4, 5, 6, 8, 12, 19, 34, 64, 125, 249, 501, 1010, 2047, 3084, 3594, 3846, 3970, 4031, 4061, 4076, 4083, 4087, 4089, 4090, 4091, 4092, 4093, 4094, 4095, 4096}, // Scale 1.41
+  {0, 1, 2, 3, 5, 8, 13, 22, 37, 61, 101, 167, 276, 456, 752, 1241, 2048, 2854, 3343, 3639, 3819, 3928, 3994, 4034, 4058, 4073, 4082, 4087, 4090, 4092, 4093, 4094, 4095, 4096}, // Scale 2
+  {0, 3, 7, 13, 22, 35, 53, 78, 114, 165, 238, 342, 490, 701, 1002, 1430, 2041, 2652, 3080, 3381, 3592, 3740, 3844, 3917, 3968, 4004, 4029, 4047, 4060, 4069, 4075, 4079, 4082, 4096}, // Scale 2.83
+};
+// Number of bits of each symbol, -log2(frequency/2^RANS_PROB_BITS), in units of 2^-RANS_COST_SHIFT bits
+const uint16_t ransSymbolCosts[RANS_NUM_TABLES][RANS_NUM_SYMBOLS] = {
+  {3072, 3072, 3072, 3072, 3072, 3072, 3072, 3072, 3072, 2666, 2260, 1898, 1536, 1164, 798, 426, 426, 797, 1164, 1536, 1898, 2260, 2666, 3072, 3072, 3072, 3072, 3072, 3072, 3072, 3072, 3072, 3072},
+  {3072, 3072, 3072, 3072, 3072, 3072, 2816, 2560, 2353, 2072, 1816, 1554, 1292, 1030, 770, 507, 507, 769, 1030, 1292, 1554, 1816, 2072, 2353, 2560, 2816, 3072, 3072, 3072, 3072, 3072, 3072, 3072},
+  {3072, 3072, 3072, 2816, 2666, 2478, 2260, 2072, 1898, 1710, 1525, 1339, 1154, 970, 785, 600, 600, 785, 970, 1154, 1339, 1525, 1710, 1898, 2072, 2260, 2478, 2666, 2816, 3072, 3072, 3072, 3072},
+  {2666, 2560, 2410, 2260, 2125, 2004, 1883, 1748, 1620, 1487, 1357, 1226, 1095, 964, 834, 703, 703, 834, 964, 1095, 1226, 1357, 1487, 1620, 1748, 1883, 2004, 2125, 2260, 2410, 2560, 2666, 2097},
+};
+
 const int TRUE_BITDEPTH_BIAS = 1;
+// Code of a constant run block in the true bit depth field of CHMODE_MSB, which has no true bit depths below 8. The block repeats
+// one sample tuple, coded as 16 bits per channel, for the number of sample tuples of the block.
+const int CONSTANT_RUN_CODE = 0;
+// Code of a near-lossless block in the true bit depth field of CHMODE_MSB. The block is coded like an independent block of
+// CHMODE_INDEPENDENT_AND_DEPENDENT and order NUM_LP_COEFS, except that the residuals are multiples of 2^shift, coded divided by 2^shift
+// with exp-Golomb-like parameters that can go below RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER. The true bit depth of the block is 16 - shift.
+const int NEAR_LOSSLESS_CODE = 1;
+const int NEAR_LOSSLESS_SHIFT_NUM_BITS = 4;
+const int NEAR_LOSSLESS_PARAMETER_NUM_BITS = 4; // Exp-Golomb-like parameters 1 to 16 of the quantized residuals
+const int EXPGOLOMBLIKE_MAX_NUM_BITS = 25; // Longest exp-Golomb-like code that BitStreamReader::readExpGolombLike can read
 
 const uint32_t bitMasks[17] = {0x00, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff, 0x1fff, 0x3fff, 0x7fff, 0xffff};
 
@@ -103,10 +327,10 @@ inline int bitDepth16 (int16_t value16, int minBitDepth) {
 }
 
 // It is OK if bitDepth is less than expGolombLikeParameter
-inline int bitDepthToExpGolombLikeNumBits16(int16_t bitDepth, int expGolombLikeParameter) {
+inline int bitDepthToExpGolombLikeNumBits16(int16_t bitDepth, int expGolombLikeParameter, int maxBitDepth = 16) {
   if (bitDepth <= expGolombLikeParameter) {
     return 1 + expGolombLikeParameter;
-  } else if (bitDepth == 16) {
+  } else if (bitDepth >= maxBitDepth) {
     return 2*bitDepth - expGolombLikeParameter - 1;
   } else {
     return 2*bitDepth - expGolombLikeParameter;
@@ -201,8 +425,8 @@ public:
     write(expGolombLike, numBits);
   }
 
-  void writeResidualExpGolombLikeParameter(int expGolombLikeParameter) {
-    write(residualExpGolombLikeParameterEncodings[expGolombLikeParameter - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER], residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]);    
+  void writeResidualExpGolombLikeParameter(int expGolombLikeParameter, int minExpGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) {
+    write(residualExpGolombLikeParameterEncodings[expGolombLikeParameter - minExpGolombLikeParameter], residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - minExpGolombLikeParameter]);    
   }
 
   BitStreamWriter(uint8_t *output): output(output), numBitsWritten(0) {
@@ -287,7 +511,7 @@ public:
       // TODO EVERYTHING ***
       }*/
   
-  void readResidualExpGolombLikeParameter(int &expGolombLikeParameter) {
+  void readResidualExpGolombLikeParameter(int &expGolombLikeParameter, int minExpGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) {
     uint32_t bitBuf = input[numBitsRead >> 3];
     for (int i = (numBitsRead >> 3) + 1; i < (numBitsRead >> 3) + 2; i++) {
       bitBuf <<= 8;
@@ -299,16 +523,16 @@ public:
 #ifdef __ARM_FEATURE_CLZ
     expGolombLikeParameter = __builtin_clz((uint32_t)bitBuf); // Count leading zeros
     if (expGolombLikeParameter >= 8) {
-      expGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+      expGolombLikeParameter = minExpGolombLikeParameter;
       numBitsRead += residualExpGolombLikeParameterEncodingNumBits[0];
     } else {
       numBitsRead += residualExpGolombLikeParameterEncodingNumBits[8 - expGolombLikeParameter];
-      expGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + (8 - expGolombLikeParameter);
+      expGolombLikeParameter = minExpGolombLikeParameter + (8 - expGolombLikeParameter);
     }
 #else // __ARM_FEATURE_CLZ
-    for (expGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 8; expGolombLikeParameter > RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; expGolombLikeParameter--) {
+    for (expGolombLikeParameter = minExpGolombLikeParameter + 8; expGolombLikeParameter > minExpGolombLikeParameter; expGolombLikeParameter--) {
       if ((bitBuf & 0x80000000)) {
-        numBitsRead += residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter-RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
+        numBitsRead += residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter-minExpGolombLikeParameter];
         return;
       }
       bitBuf <<= 1;
@@ -331,41 +555,207 @@ inline int32_t saturate(int32_t value, int32_t minimum, int32_t maximum) {
   return value;
 }
 
-inline int bestExpGolombLikeParameter16(int *bitDepthCounts, int &bestNumBits, int totalCount) {
+// Return the number of bits to right shift values, whose absolute values bitwise or'ed together give absBits, to make them smaller than 2^numBits
+inline int normalizationShift(uint64_t absBits, int numBits) {
+  int shift = 0;
+  while ((absBits >> shift) >> numBits) {
+    shift++;
+  }
+  return shift;
+}
+
+inline uint64_t absBits64(int64_t value) {
+  return (value < 0) ? -(uint64_t)value : value;
+}
+
+// Return numerator/denominator*2^shift rounded to nearest, halfway cases away from zero, and saturated to minimum..maximum.
+// Exact for all values of the arguments, except that denominator must not be 0, so the result is the same on every platform.
+inline int32_t fixedPointQuotient(int64_t numerator, int64_t denominator, int shift, int32_t minimum, int32_t maximum) {
+  bool negative = (numerator < 0) != (denominator < 0);
+  uint64_t n = absBits64(numerator);
+  uint64_t d = absBits64(denominator);
+  uint64_t q = n/d;
+  uint64_t r = n%d;
+  if (q >> 24) {
+    return negative ? minimum : maximum;
+  }
+  // Long division for shift fractional bits and a rounding bit
+  for (int i = 0; i <= shift; i++) {
+    q <<= 1;
+    if (r >= d - r) {
+      q |= 1;
+      r -= d - r;
+    } else {
+      r <<= 1;
+    }
+  }
+  // Up to 2^(24 + shift), beyond int32 for large shifts
+  int64_t value = (q + 1) >> 1;
+  if (negative) {
+    value = -value;
+  }
+  return (value > maximum) ? maximum : (value < minimum) ? minimum : (int32_t)value;
+}
+
+inline int bestExpGolombLikeParameter16(int *bitDepthCounts, int &bestNumBits, int totalCount, int minExpGolombLikeParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) {
   int numAboveBase = 0;
   bestNumBits = INT_MAX;
-  int numBits = 16*totalCount - bitDepthCounts[16-RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
-  for (int i = 16-RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; i >= 0; i--) {
+  int numBits = 16*totalCount - bitDepthCounts[16-minExpGolombLikeParameter];
+  for (int i = 16-minExpGolombLikeParameter; i >= 0; i--) {
     numBits += numAboveBase;
     numAboveBase += bitDepthCounts[i];
     numBits += numAboveBase;
     if (numBits > bestNumBits) {
-      return RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + i;      
+      return minExpGolombLikeParameter + i;      
     }
     bestNumBits = numBits;
     numBits -= totalCount;
   }
-  return RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+  return minExpGolombLikeParameter;
+}
+
+// Residual coding of a channel in a block with a fixed exp-Golomb-like parameter
+struct FixedExpGolombLikeParameter {
+  static const int MAX_NUM_BITS = 2*16 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; // Longest code of a residual
+  int parameter;
+  void read(BitStreamReader &reader, int16_t &residual) {
+    reader.readExpGolombLike(residual, parameter);
+  }
+  void write(BitStreamWriter &writer, int16_t residual) {
+    writer.writeExpGolombLike(residual, parameter);
+  }
+  FixedExpGolombLikeParameter(int initialParameter): parameter(initialParameter) {
+  }
+  FixedExpGolombLikeParameter() {
+  }
+};
+
+// Exp-Golomb-like code of the residuals of a near-lossless block, which are multiples of 2^shift. Only the residual divided by 2^shift,
+// modulo 2^(16 - shift), is coded, because the prediction wraps around modulo 2^16.
+struct QuantizedExpGolombLikeParameter {
+  static const int MAX_NUM_BITS = 2*16; // Longest code of a residual, with a parameter of at least 1
+  int parameter;
+  int shift;
+  void read(BitStreamReader &reader, int16_t &residual) {
+    reader.readExpGolombLike(residual, parameter, 16 - shift);
+    residual = (uint16_t)residual << shift;
+  }
+  QuantizedExpGolombLikeParameter(int parameter, int shift): parameter(parameter), shift(shift) {
+  }
+  QuantizedExpGolombLikeParameter() {
+  }
+};
+
+// Backward-adaptive exp-Golomb-like parameter in the style of LOCO-I. The parameter follows a running mean of the magnitudes of
+// the residuals already coded, so the decoder tracks it with no side info other than the initial parameter. The parameter is
+// the bit depth of the mean by bitDepth16, which is a count leading zeros where available, so decoding stays as fast as with fixed parameters.
+template <class Format>
+struct AdaptiveExpGolombLikeParameter {
+  static const int MAX_NUM_BITS = 2*16 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; // Longest code of a residual
+  int parameter;
+  int32_t magnitudeSum; // About 2^ADAPTIVE_RESIDUAL_SHIFT times the mean magnitude of recent residuals
+  void update(int16_t residual) {
+    magnitudeSum += ((residual < 0) ? -(int32_t)residual : residual) - (magnitudeSum >> ADAPTIVE_RESIDUAL_SHIFT);
+    int32_t mean = magnitudeSum >> ADAPTIVE_RESIDUAL_SHIFT;
+    parameter = bitDepth16((mean > 0x7fff) ? 0x7fff : mean, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER - ADAPTIVE_RESIDUAL_BIAS) + ADAPTIVE_RESIDUAL_BIAS;
+    if (parameter > Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 8) {
+      parameter = Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 8;
+    }
+  }
+  void read(BitStreamReader &reader, int16_t &residual) {
+    reader.readExpGolombLike(residual, parameter);
+    update(residual);
+  }
+  void write(BitStreamWriter &writer, int16_t residual) {
+    writer.writeExpGolombLike(residual, parameter);
+    update(residual);
+  }
+  // Start from a mean magnitude that gives initialParameter
+  AdaptiveExpGolombLikeParameter(int initialParameter): parameter(initialParameter), magnitudeSum((3 << (initialParameter - ADAPTIVE_RESIDUAL_BIAS - 3)) << ADAPTIVE_RESIDUAL_SHIFT) {
+  }
+  AdaptiveExpGolombLikeParameter() {
+  }
+};
+
+inline int ransEscapeExpGolombLikeParameter(int rawNumBits) {
+  return (rawNumBits + RANS_SYMBOL_BITS < RANS_ESCAPE_MIN_EXPGOLOMBLIKE_PARAMETER) ? RANS_ESCAPE_MIN_EXPGOLOMBLIKE_PARAMETER : rawNumBits + RANS_SYMBOL_BITS;
+}
+
+// rANS symbol of a residual
+inline int ransSymbol(int16_t residual, int rawNumBits) {
+  int value = residual >> rawNumBits;
+  if (value < -(1 << (RANS_SYMBOL_BITS - 1)) || value >= (1 << (RANS_SYMBOL_BITS - 1))) {
+    return RANS_ESCAPE;
+  }
+  return value + (1 << (RANS_SYMBOL_BITS - 1));
 }
 
+// Residual decoding of a channel in a block coded with rANS (range variant of asymmetric numeral systems) using a static table.
+// Each channel has its own coder state, so the two channels interleave two rANS streams in the same bit stream.
+// The state is renormalized a variable number of bits at a time, so a coder state costs only RANS_PROB_BITS bits to transmit.
+// The rawNumBits LSBs of each residual follow its renormalization bits uncoded.
+struct RANSResidualDecoder {
+  // Longest code of a residual: renormalization bits and an escaped residual
+  static const int MAX_NUM_BITS = RANS_PROB_BITS + 2*16 - RANS_ESCAPE_MIN_EXPGOLOMBLIKE_PARAMETER;
+  const uint16_t *cumFreqs;
+  int rawNumBits;
+  uint32_t state;
+  void read(BitStreamReader &reader, int16_t &residual) {
+    uint32_t slot = state & bitMasks[RANS_PROB_BITS];
+    // Binary search for the symbol of slot
+    int symbol = 0;
+    for (int step = 1 << RANS_SYMBOL_BITS; step; step >>= 1) {
+      if (symbol + step < RANS_NUM_SYMBOLS && cumFreqs[symbol + step] <= slot) {
+        symbol += step;
+      }
+    }
+    state = (cumFreqs[symbol + 1] - cumFreqs[symbol])*(state >> RANS_PROB_BITS) + slot - cumFreqs[symbol];
+    // Renormalize. The state is below 2^(RANS_PROB_BITS+1) so its bit depth as int16_t is its bit length plus 1.
+    int numBits = RANS_PROB_BITS + 2 - bitDepth16(state, 2);
+    if (numBits > 0) {
+      uint32_t bits;
+      reader.read(bits, numBits);
+      state = (state << numBits) | bits;
+    }
+    if (symbol == RANS_ESCAPE) {
+      reader.readExpGolombLike(residual, ransEscapeExpGolombLikeParameter(rawNumBits));
+    } else {
+      uint32_t bits = 0;
+      if (rawNumBits) {
+        reader.read(bits, rawNumBits);
+      }
+      residual = (symbol - (1 << (RANS_SYMBOL_BITS - 1)))*(1 << rawNumBits) | bits;
+    }
+  }
+  // Read the initial coder state
+  RANSResidualDecoder(BitStreamReader &reader, int table, int rawNumBits): cumFreqs(ransCumFreqs[table]), rawNumBits(rawNumBits) {
+    reader.read(state, RANS_PROB_BITS);
+    state |= 1 << RANS_PROB_BITS;
+  }
+  RANSResidualDecoder() {
+  }
+};
+
+template <class Format>
 struct Channel {
-  int16_t s[BLOCK_MAX_NUM_SAMPLETUPLES]; // Samples
-  int bitDepthCounts[17 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]; // byte would be enough
+  int16_t s[NUM_LP_COEFS + Format::BLOCK_MAX_NUM_SAMPLETUPLES]; // Samples
+  int bitDepthCounts[17 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]; // byte would be enough. Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER is never smaller than RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER
   int expGolombLikeParameter;
   int numBits;
   void addToBitDepthCounts(int16_t value) {
-    int bitDepth = bitDepth16(value, RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
-    bitDepthCounts[bitDepth - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]++;
+    int bitDepth = bitDepth16(value, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    bitDepthCounts[bitDepth - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]++;
   }
   void resetExpGolombLikeStats() {
-    for (int i = 0; i <= 16 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; i++) {
+    for (int i = 0; i <= 16 - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER; i++) {
       bitDepthCounts[i] = 0;
     }
   }
 };
 
+template <class Format = MLACDefaultFormat>
 inline int16_t predict(int16_t xm2, int16_t xc2, int16_t xm1, int16_t xc1) {
-  int32_t result = ((int32_t)xm2*(int32_t)xc2 + (int32_t)xm1*(int32_t)xc1 + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT; // Rounding gives marginal compression ratio improvement
+  int32_t result = ((int32_t)xm2*(int32_t)xc2 + (int32_t)xm1*(int32_t)xc1 + (1 << (Format::COEF_SHIFT - 1))) >> Format::COEF_SHIFT; // Rounding gives marginal compression ratio improvement
   //#ifdef __ARM_FEATURE_SAT
   //  return (int16_t) __ssat32(result, 16);
   //#else  // __ARM_FEATURE_SAT
@@ -374,8 +764,9 @@ inline int16_t predict(int16_t xm2, int16_t xc2, int16_t xm1, int16_t xc1) {
   //return saturate(round(xm2*(float)xc2*(1.0f/COEF_DIVISOR) + xm1*(float)xc1*(1.0f/COEF_DIVISOR)), -32768.0f, 32767.0f); // Equivalent floating point calculation
 }
 
+template <class Format = MLACDefaultFormat>
 inline int16_t predict(int16_t ym2, int16_t yc2, int16_t ym1, int16_t yc1, int16_t x0, int16_t yd0) {
-  int32_t result = ((int32_t)ym2*(int32_t)yc2 + (int32_t)ym1*(int32_t)yc1 + (int32_t)x0*(int32_t)yd0 + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT; // Rounding gives marginal compression ratio improvement
+  int32_t result = ((int32_t)ym2*(int32_t)yc2 + (int32_t)ym1*(int32_t)yc1 + (int32_t)x0*(int32_t)yd0 + (1 << (Format::COEF_SHIFT - 1))) >> Format::COEF_SHIFT; // Rounding gives marginal compression ratio improvement
   //  int32_t result = (int32_t)ym2*(int32_t)yc2 + (int32_t)ym1*(int32_t)yc1 + (int32_t)x0*(int32_t)yd0;
   //#ifdef __ARM_FEATURE_SAT
   //return (int16_t) __ssat32(result, 16);
@@ -389,7 +780,41 @@ inline int16_t predict(int16_t ym2, int16_t yc2, int16_t ym1, int16_t yc1, int16
   //  return saturate(round(ym2*(float)yc2*(1.0f/COEF_DIVISOR) + ym1*(float)yc1*(1.0f/COEF_DIVISOR) + x0*(float)yd0*(1.0f/COEF_DIVISOR)), -32768.0f, 32767.0f); // Equivalent floating point calculation
 }
 
+// Linear prediction of the sample pointed to by x from the numTaps previous samples, with coefs[1] .. coefs[numTaps] for samples x[-1] .. x[-numTaps].
+// crossTerm is added to the prediction before the shift. Used for orders above NUM_LP_COEFS, and for the first samples of a block with fewer taps.
+template <class Format = MLACDefaultFormat>
+inline int16_t predictHighOrder(const int16_t *x, const int16_t *coefs, int numTaps, int32_t crossTerm = 0) {
+  int32_t result = crossTerm + (1 << (Format::HIGH_ORDER_COEF_SHIFT - 1));
+  for (int k = 1; k <= numTaps; k++) {
+    result += (int32_t)x[-k]*(int32_t)coefs[k];
+  }
+  return (int16_t)saturate(result >> Format::HIGH_ORDER_COEF_SHIFT, -0x8000, 0x7fff);
+}
+
+// Same as above with the number of taps known at compile time, so that the loop is unrolled
+template <class Format, int order>
+inline int16_t predictHighOrder(const int16_t *x, const int16_t *coefs, int32_t crossTerm = 0) {
+  return predictHighOrder<Format>(x, coefs, order, crossTerm);
+}
+
+// Lifting form of the mid/side transform of a left and right channel value pair to mid and side, in place.
+// Exactly invertible by inverseMidSide in 16-bit wrap-around arithmetic, so it can be applied to delta values and warmup samples alike.
+inline void midSide(int16_t &left, int16_t &right) {
+  int16_t side = left - right;
+  left = right + (side >> 1);
+  right = side;
+}
+
+// Inverse of midSide, from mid and side to left and right, in place
+inline void inverseMidSide(int16_t &mid, int16_t &side) {
+  int16_t right = mid - (side >> 1);
+  mid = side + right;
+  side = right;
+}
+
 struct LPCoefs {
+  int order; // Prediction order, NUM_LP_COEFS to MAX_LP_ORDER
+  // Coefficients of order NUM_LP_COEFS, with COEF_SHIFT
   // Coefficients to calculate independent left channel sample i
   int16_t xc2; // Coef for left channel sample i-2
   int16_t xc1; // Coef for left channel sample i-1
@@ -397,387 +822,3194 @@ struct LPCoefs {
   int16_t yc2; // Coef for right channel sample i-2
   int16_t yc1; // Coef for right channel sample i-1
   int16_t yd0; // Coef for left channel sample i
+  // Coefficients of orders above NUM_LP_COEFS, with HIGH_ORDER_COEF_SHIFT
+  int16_t xcn[MAX_LP_ORDER + 1]; // xcn[k] = Coef for left channel sample i-k, xcn[0] is not used
+  int16_t ycn[MAX_LP_ORDER + 1]; // ycn[k] = Coef for right channel sample i-k, ycn[0] = Coef for left channel sample i
+
+  // Set order NUM_LP_COEFS and the coefficients to their biases, for a block that has no coefficients
+  template <class Format>
+  void reset() {
+    order = NUM_LP_COEFS;
+    xc1 = Format::C1_BIAS;
+    xc2 = Format::C2_BIAS;
+    yc1 = Format::C1_BIAS;
+    yc2 = Format::C2_BIAS;
+    yd0 = Format::D0_BIAS;
+  }
 };
 
-class MLACDecoder {
-  int16_t x[BLOCK_MAX_NUM_SAMPLETUPLES];
-  int16_t y[BLOCK_MAX_NUM_SAMPLETUPLES];
+// Number of bits needed for the prediction order field. Formats that have only order NUM_LP_COEFS have no such field.
+template <class Format>
+inline int lpOrderNumBits(int order) {
+  return (Format::MAX_LP_ORDER == NUM_LP_COEFS) ? 0 : (order == NUM_LP_COEFS) ? 1 : 1 + LP_ORDER_NUM_BITS;
+}
 
-public:
-  // MLAC decode
-  // Arguments:
-  //   input = pointer to beginning of a block of BLOCK_NUM_BYTES encoded audio.
-  //   output = pointer to beggining of interleaved stereo 16-bit audio that must have room for at least BLOCK_MAX_NUM_SAMPLETUPLES stereo samples to be written.
-  // Returns:
-  //   timeStamp = time stamp read, not yet implemented. NOTE: TIME STAMPS ARE NOT YET FUNCTIONAL AND ARE INSTEAD USED FOR STORING NUMBER OF SAMPLE TUPLES
-  //   numSampleTuplesRead = number of stereo samples read
-  //   Return value = Effective resolution of audio in bits, 16 for lossless compression, less for lossy compression
-  int decode(const uint8_t *input, int16_t *output, uint8_t &timeStamp, int &numSampleTuplesRead) {
-    BitStreamReader reader(input, BLOCK_NUM_BYTES);
+// Levinson-Durbin recursion for linear prediction coefficients of orders 1 to maxOrder from autocorrelations r[0] .. r[maxOrder]
+// that must be smaller than 2^24 in absolute value. coefs[m][k] will be the coefficient for sample i-k of the predictor of order m,
+// with LEVINSON_DURBIN_SHIFT fractional bits. Returns the highest order solved. Exact integer arithmetic, the same on every platform.
+const int LEVINSON_DURBIN_SHIFT = 20;
+inline int levinsonDurbin(const int32_t *r, int maxOrder, int32_t coefs[][MAX_LP_ORDER + 1]) {
+  int64_t error = r[0];
+  for (int m = 1; m <= maxOrder; m++) {
+    if (error <= 0) {
+      return m - 1;
+    }
+    int64_t numerator = (int64_t)r[m]*(1 << LEVINSON_DURBIN_SHIFT);
+    for (int k = 1; k < m; k++) {
+      numerator -= (int64_t)coefs[m - 1][k]*r[m - k];
+    }
+    int32_t reflection = fixedPointQuotient(numerator, error, 0, -(1 << LEVINSON_DURBIN_SHIFT), 1 << LEVINSON_DURBIN_SHIFT);
+    for (int k = 1; k < m; k++) {
+      coefs[m][k] = coefs[m - 1][k] - (int32_t)(((int64_t)reflection*coefs[m - 1][m - k] + (1 << (LEVINSON_DURBIN_SHIFT - 1))) >> LEVINSON_DURBIN_SHIFT);
+    }
+    coefs[m][m] = reflection;
+    error -= (error*(((int64_t)reflection*reflection) >> LEVINSON_DURBIN_SHIFT)) >> LEVINSON_DURBIN_SHIFT;
+  }
+  return maxOrder;
+}
 
-    // Read time stamp
-    uint32_t temp;
-    reader.read(temp, 8); 
-    timeStamp = temp;
-    numSampleTuplesRead = temp; // Fake it! ***    
-    // Read channel mode
-    uint32_t chMode;
-    reader.read(chMode, 2);
-    if (chMode != CHMODE_MSB) {
-      // Read left channel warmup
-      reader.readExpGolombLike(x[0], 14);
-      reader.readExpGolombLike(x[1], 14);
-      // Read right channel warmup
-      reader.readExpGolombLike(y[0], 14);
-      reader.readExpGolombLike(y[1], 14);
-    }
-    if (chMode == CHMODE_INDEPENDENT_AND_DEPENDENT) {
-      int xrExpGolombLikeParameter, ydrExpGolombLikeParameter;
-      int16_t xc1, xc2, yc1, yc2, yd0;
-      // Read independent left channel exp-Golomb-like parameter and coefficients
-      reader.readResidualExpGolombLikeParameter(xrExpGolombLikeParameter);
-      reader.readExpGolombLike(xc1, C1_EXPGOLOMBLIKE_PARAMETER);
-      xc1 += C1_BIAS;
-      reader.readExpGolombLike(xc2, C2_EXPGOLOMBLIKE_PARAMETER);
-      xc2 += C2_BIAS;
-      // Read independent right channel exp-Golomb-like parameter and coefficients
-      reader.readResidualExpGolombLikeParameter(ydrExpGolombLikeParameter);
-      reader.readExpGolombLike(yc1, C1_EXPGOLOMBLIKE_PARAMETER);
-      yc1 += C1_BIAS;
-      reader.readExpGolombLike(yc2, C2_EXPGOLOMBLIKE_PARAMETER);
-      yc2 += C2_BIAS;
-      reader.readExpGolombLike(yd0, D0_EXPGOLOMBLIKE_PARAMETER);
-      yd0 += D0_BIAS;
-      // Read audio data residues
-      for (int i = NUM_LP_COEFS; i < numSampleTuplesRead; i++) {
-	int16_t xr, ydr;
-	reader.readExpGolombLike(xr, xrExpGolombLikeParameter);
-	reader.readExpGolombLike(ydr, ydrExpGolombLikeParameter);
-	x[i] = predict(x[i - 2], xc2, x[i - 1], xc1) + xr;
-	y[i] = predict(y[i - 2], yc2, y[i - 1], yc1, x[i], yd0) + ydr;
-      }
-    } else { // chMode == CHMODE_MSB
-      // Read true bit depth
-      uint32_t trueBitDepth;
-      reader.read(trueBitDepth, 4);
-      trueBitDepth += TRUE_BITDEPTH_BIAS;
-      // Read raw PCM audio
-      if (trueBitDepth == 16) {
-        for (int i = 0; i < chModeMSBNumSampleTuples[trueBitDepth]; i++) {
-          uint32_t val;
-          reader.read(val, trueBitDepth);
-          output[i*2 + 0] = val;
-          reader.read(val, trueBitDepth); 
-          output[i*2 + 1] = val;
-        }
-      } else {
-        for (int i = 0; i < chModeMSBNumSampleTuples[trueBitDepth]; i++) {
-          uint32_t val;
-          reader.read(val, trueBitDepth);
-          output[i*2 + 0] = (val << (16 - trueBitDepth)) | (0x8000 >> trueBitDepth);
-          reader.read(val, trueBitDepth); 
-          output[i*2 + 1] = (val << (16 - trueBitDepth)) | (0x8000 >> trueBitDepth);
-        }
-      }
-      return trueBitDepth;
+// Number of bits needed for the residual exp-Golomb-like parameter and the coefficients of the independent left channel
+template <class Format>
+inline int independentSideInfoNumBits(const LPCoefs &c, int expGolombLikeParameter) {
+  return residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.xc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.xc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+}
+
+// Number of bits needed for the residual exp-Golomb-like parameter and the coefficients of the dependent right channel
+template <class Format>
+inline int dependentSideInfoNumBits(const LPCoefs &c, int expGolombLikeParameter) {
+  return residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.yc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yd0-Format::D0_BIAS, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+}
+
+// Same as independentSideInfoNumBits but for any order and with the given coefficient coding. Also counts the prediction order field.
+// previous = coefficients of the previous linear prediction block. Orders above NUM_LP_COEFS are coded as such unless reused.
+template <class Format>
+inline int independentSideInfoNumBits(const LPCoefs &c, int expGolombLikeParameter, int coefCoding, const LPCoefs &previous) {
+  if (coefCoding != COEF_CODING_REUSE && c.order != NUM_LP_COEFS) {
+    int numBits = lpOrderNumBits<Format>(c.order) + residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
+    for (int k = 1; k <= c.order; k++) {
+      numBits += valueToExpGolombLikeNumBits16(c.xcn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
     }
-    // chMode != CHMODE MSB
-    output[0] = x[0];
-    output[1] = y[0];
-    for (int i = 1; i < numSampleTuplesRead; i++) {
-      output[2*i + 0] = output[2*(i - 1) + 0] + x[i];
-      output[2*i + 1] = output[2*(i - 1) + 1] + y[i];
+    return numBits;
+  } else if (coefCoding == COEF_CODING_DELTA) {
+    return lpOrderNumBits<Format>(c.order) + residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.xc1-previous.xc1, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.xc2-previous.xc2, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+  } else if (coefCoding == COEF_CODING_REUSE) {
+    return residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
+  }
+  return lpOrderNumBits<Format>(c.order) + independentSideInfoNumBits<Format>(c, expGolombLikeParameter);
+}
+
+// Same as dependentSideInfoNumBits but for any order and with the given coefficient coding. 0 in a mono format, which has no dependent channel.
+template <class Format>
+inline int dependentSideInfoNumBits(const LPCoefs &c, int expGolombLikeParameter, int coefCoding, const LPCoefs &previous) {
+  if (Format::NUM_CHANNELS == 1) {
+    return 0;
+  }
+  if (coefCoding != COEF_CODING_REUSE && c.order != NUM_LP_COEFS) {
+    int numBits = residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
+    for (int k = 0; k <= c.order; k++) {
+      numBits += valueToExpGolombLikeNumBits16(c.ycn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
     }
-    return 16;
+    return numBits;
+  } else if (coefCoding == COEF_CODING_DELTA) {
+    return residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.yc1-previous.yc1, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yc2-previous.yc2, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yd0-previous.yd0, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+  } else if (coefCoding == COEF_CODING_REUSE) {
+    return residualExpGolombLikeParameterEncodingNumBits[expGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
   }
-};
+  return dependentSideInfoNumBits<Format>(c, expGolombLikeParameter);
+}
 
-class MLACEncoder {
-  Channel xr;
-  Channel ydr;
-  int16_t x[BLOCK_MAX_NUM_SAMPLETUPLES];
-  int16_t y[BLOCK_MAX_NUM_SAMPLETUPLES];
+// Decoded state of a stream that a continuation block continues from. The encoder keeps the same state as the decoder.
+struct MLACStreamState {
+  int16_t xDeltas[NUM_LP_COEFS]; // Delta values of the last decoded left channel samples, oldest first
+  int16_t yDeltas[NUM_LP_COEFS]; // Same for the right channel
+  int16_t xLast; // Last decoded left channel sample
+  int16_t yLast; // Last decoded right channel sample
+  LPCoefs c; // Coefficients of the last linear prediction block
+  bool valid; // Is there an independent block to continue from?
+  int lowShift; // Shift of the samples of the last block of MLAC24BitFormat, LOW_NUM_BITS unless it was a linear prediction block
 
-public:
-  // MLAC encode
-  // Arguments:
-  //   input = pointer to begining of interleaved stereo 16-bit audio that must contain at least BLOCK_MAX_NUM_SAMPLETUPLES stereo samples.
-  //   output = pointer to beginning of a block of encoded audio to be written. Will write BLOCK_NUM_BYTES bytes.
-  //   timeStamp = time stamp to be written, not yet implemented. NOTE: TIME STAMPS ARE NOT YET FUNCTIONAL AND ARE INSTEAD USED FOR STORING NUMBER OF SAMPLE TUPLES
-  // Returns:
-  //   numSampleTuplesWritten = number of stereo sample pairs encoded
-  //   numBitsWritten = number of bits written (if less than BLOCK_NUM_BYTES*8, then there is room for auxiliary data after encoded audio)
-  //   minNumSampleTuples = minimum number of stero samples that must fit to packet, range: BLOCK_MIN_NUM_SAMPLETUPLES inclusive to BLOCK_MAX_NUM_SAMPLETUPLES inclusive.
-  //                        this setting can force lossy compression.
-  //   Return value = Effective resolution of audio in bits, 16 for lossless compression, less for lossy compression
-  int encode(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
-    
-    int trueBitDepth = 16;
-    BitStreamWriter writer(output);
-    
-    // Delta values
-    
-    x[0] = input[0];
-    y[0] = input[1];
-    for (int i = 1; i < BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
-      x[i] = input[i*2] - input[(i - 1)*2];
-      y[i] = input[i*2 + 1] - input[(i - 1)*2 + 1];
+  // Update the samples from the last NUM_LP_COEFS + 1 decoded interleaved sample tuples of a block, of numChannels channels.
+  // A mono stream has a silent right channel.
+  void update(const int16_t *lastSampleTuples, int numChannels = 2) {
+    for (int k = 0; k < NUM_LP_COEFS; k++) {
+      xDeltas[k] = lastSampleTuples[(k + 1)*numChannels] - lastSampleTuples[k*numChannels];
+      yDeltas[k] = (numChannels == 2) ? lastSampleTuples[(k + 1)*2 + 1] - lastSampleTuples[k*2 + 1] : 0;
     }
+    xLast = lastSampleTuples[NUM_LP_COEFS*numChannels];
+    yLast = (numChannels == 2) ? lastSampleTuples[NUM_LP_COEFS*2 + 1] : 0;
+  }
 
-    int j = 2;
+  MLACStreamState(): valid(false), lowShift(0) {
+  }
+};
 
-    int64_t x1x1Pre = x[1]*(int32_t)x[1];
-    int64_t x0x0Pre = x[0]*(int32_t)x[0] + x1x1Pre;
-    int64_t x1x2Pre = x[1]*(int32_t)x[2];
-    int64_t x0x1Pre = x[0]*(int32_t)x[1] + x1x2Pre;
-    int64_t x0x2 = x[0]*(int32_t)x[2] + x[1]*(int32_t)x[3];
-
-    int64_t y1y1Pre = y[1]*(int32_t)y[1];
-    int64_t y0y0Pre = y[0]*(int32_t)y[0] + y1y1Pre;
-    int64_t y1y2Pre = y[1]*(int32_t)y[2];
-    int64_t y0y1Pre = y[0]*(int32_t)y[1] + y1y2Pre;
-    int64_t y0y2 = y[0]*(int32_t)y[2] + y[1]*(int32_t)y[3];
-    
-    int64_t x2y2 = x[0 + 2]*(int32_t)y[0 + 2] + x[1 + 2]*(int32_t)y[1 + 2];
-    int64_t y1x2 = y[0 + 1]*(int32_t)x[0 + 2] + y[1 + 1]*(int32_t)x[1 + 2];
-    int64_t y0x2 = y[0]*(int32_t)x[0 + 2] + y[1]*(int32_t)x[1 + 2];
-    
-    int64_t xx0 = 0;
-    int64_t xx1 = 0;
-    
-    int64_t yy0 = 0;
-    int64_t yy1 = 0;
-        
-    int bestChMode = CHMODE_MSB;
-    LPCoefs c;
-    LPCoefs bestc;
-    int bestNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES;
-    int bestNumBits = 8 + 2 + 1 + bestNumSampleTuples*2*16;
+// Input of the converting entry points of MLACBasicEncoder, for audio that is not interleaved int16_t. The left and right channel
+// samples of sample tuple i are left[i*stride] and right[i*stride]. For interleaved stereo, right = left + 1 and stride = 2, and for
+// planar stereo, stride = 1. Mono formats read only left. Sample is int16_t, int32_t or float. int32_t samples are shifted right by shift bits, for example by 8 for
+// 24-bit samples in the low bits and by 16 for 32-bit samples, and clipped to 16 bits. float samples, nominally from -1 to 1, are
+// scaled by 32768, dithered if MLACBasicEncoder::dither is set, rounded and clipped to 16 bits. Of MLAC24BitFormat, the samples are
+// converted to 16 + LOW_NUM_BITS bits instead: int32_t samples are shifted right by shift - LOW_NUM_BITS bits, float samples are scaled
+// by 32768*2^LOW_NUM_BITS, and int16_t samples have low bits of zero.
+template <class Sample>
+struct MLACInput {
+  const Sample *left;
+  const Sample *right;
+  int stride;
+  int shift;
+};
 
-    int commonNumBits =
-      ( 8
-        // time stamp      
-        + 2 // chmode
-        + valueToExpGolombLikeNumBits16(x[0], 14) + valueToExpGolombLikeNumBits16(y[0], 14) + valueToExpGolombLikeNumBits16(x[1], 14) + valueToExpGolombLikeNumBits16(y[1], 14) // warmup
-        );
-    int numAvailableBits = BLOCK_NUM_BYTES*8 - commonNumBits;
-    int targetNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES + 1;
-    int chMode;
-    int numBits;
-    int bestxrExpGolombLikeParameter;
-    int bestydrExpGolombLikeParameter;
+// Output of the converting entry points of MLACBasicDecoder, for audio that is not interleaved int16_t. The left and right channel
+// samples of sample tuple i are written to left[i*stride] and right[i*stride]. For interleaved stereo, right = left + 1 and stride = 2,
+// and for planar stereo, stride = 1. Mono formats write only left. Sample is int16_t, int32_t or float. int32_t samples are the 16-bit samples shifted left by shift
+// bits, for example by 8 for 24-bit samples in the low bits and by 16 for 32-bit samples. float samples are the 16-bit samples divided
+// by 32768. Of MLAC24BitFormat, the low bits of linear prediction blocks are added below the 16 bits: shifted left by
+// shift - LOW_NUM_BITS bits to int32_t samples and divided by 32768*2^LOW_NUM_BITS to float samples, and left out of int16_t samples.
+template <class Sample>
+struct MLACOutput {
+  Sample *left;
+  Sample *right;
+  int stride;
+  int shift;
+};
 
-    for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+template <class Format> class MLACBasicIncrementalDecoder;
 
-      // Calculate linear prediction coefficients. Aim a bit higher with numSampleTuples than we are sure we can go.
-      
-      for (; j < targetNumSampleTuples - NUM_LP_COEFS - 1; j += 2) { // This unrolled loop gives 3 % speedup on BeagleBone Black. This loop be removed without further modifications.
-        xx0 -= (int32_t) - (x[j]*(int32_t)x[j]) - x[j + 1]*(int32_t)x[j + 1]; // Dual 16x16 multiply and 32-bit subtractive accumulate (- 0x40000000 - 0x40000000 is valid).
-        xx1 -= (int32_t) - (x[j]*(int32_t)x[j + 1]) - x[j + 1]*(int32_t)x[j + 2];
-        x0x2 -= (int32_t) - (x[j]*(int32_t)x[j + 2]) - x[j + 1]*(int32_t)x[j + 3];
+template <class Format>
+class MLACBasicDecoder {
+  static const int BLOCK_NUM_BYTES = Format::BLOCK_NUM_BYTES;
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+#ifdef MLAC_LOW_RAM
+  // Number of delta values per channel in the window that a linear prediction block is decoded through: the history needed for
+  // prediction and a chunk of LOW_RAM_CHUNK_NUM_SAMPLETUPLES sample tuples
+  static const int DELTA_WINDOW_LENGTH = Format::MAX_LP_ORDER + LOW_RAM_CHUNK_NUM_SAMPLETUPLES;
+#else
+  // Number of delta values per channel in the window that a linear prediction block is decoded through: the whole block
+  static const int DELTA_WINDOW_LENGTH = NUM_LP_COEFS + BLOCK_MAX_NUM_SAMPLETUPLES;
+#endif
+  static const bool STEREO = Format::NUM_CHANNELS == 2; // Are there dependent channel fields, or only the independent channel of mono?
+  static_assert(Format::NUM_CHANNELS == 1 || Format::NUM_CHANNELS == 2, "Blocks have one or two channels");
+  MLACStreamState stream;
+  static_assert(MAX_LP_ORDER == 8, "Update the prediction order cases");
 
-        yy0 -= (int32_t) - (y[j]*(int32_t)y[j]) - y[j + 1]*(int32_t)y[j + 1];
-        yy1 -= (int32_t) - (y[j]*(int32_t)y[j + 1]) - y[j + 1]*(int32_t)y[j + 2];
-        y0y2 -= (int32_t) - (y[j]*(int32_t)y[j + 2]) - y[j + 1]*(int32_t)y[j + 3];
+  // Read residues and calculate delta values x[begin] .. x[end-1] and y[begin] .. y[end-1] with coefficients of order above NUM_LP_COEFS.
+  // The first sample tuples of the block are predicted from as many previous delta values as there are from historyStart on.
+  template <int order, class ResidualCoding>
+  static void decodeHighOrder(BitStreamReader &reader, const LPCoefs &c, int16_t *x, int16_t *y, int historyStart, int begin, int end, ResidualCoding &xrCoding, ResidualCoding &ydrCoding) {
+    int i = begin;
+    for (; i < end && i < historyStart + order; i++) {
+      int16_t xr, ydr;
+      xrCoding.read(reader, xr);
+      x[i] = predictHighOrder<Format>(&x[i], c.xcn, i - historyStart) + xr;
+      if (STEREO) {
+        ydrCoding.read(reader, ydr);
+        y[i] = predictHighOrder<Format>(&y[i], c.ycn, i - historyStart, (int32_t)x[i]*c.ycn[0]) + ydr;
+      }
+    }
+    for (; i < end; i++) {
+      int16_t xr, ydr;
+      xrCoding.read(reader, xr);
+      x[i] = predictHighOrder<Format, order>(&x[i], c.xcn) + xr;
+      if (STEREO) {
+        ydrCoding.read(reader, ydr);
+        y[i] = predictHighOrder<Format, order>(&y[i], c.ycn, (int32_t)x[i]*c.ycn[0]) + ydr;
+      }
+    }
+  }
 
-	x2y2 -= (int32_t) - (x[j + 2]*(int32_t)y[j + 2]) - x[j + 3]*(int32_t)y[j + 3];
-	y1x2 -= (int32_t) - (y[j + 1]*(int32_t)x[j + 2]) - y[j + 2]*(int32_t)x[j + 3];
-	y0x2 -= (int32_t) - (y[j]*(int32_t)x[j + 2]) - y[j + 1]*(int32_t)x[j + 3];
+  // Read residues and calculate delta values x[begin] .. x[end-1] and y[begin] .. y[end-1], with FixedExpGolombLikeParameter,
+  // AdaptiveExpGolombLikeParameter, QuantizedExpGolombLikeParameter or RANSResidualDecoder as ResidualCoding
+  template <class ResidualCoding>
+  static void decodeResiduals(BitStreamReader &reader, const LPCoefs &c, int16_t *x, int16_t *y, int historyStart, int begin, int end, ResidualCoding &xrCodingState, ResidualCoding &ydrCodingState) {
+    // Work on copies that can be kept in registers
+    ResidualCoding xrCoding = xrCodingState;
+    ResidualCoding ydrCoding = ydrCodingState;
+    switch (c.order) {
+    case 3: decodeHighOrder<3>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    case 4: decodeHighOrder<4>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    case 5: decodeHighOrder<5>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    case 6: decodeHighOrder<6>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    case 7: decodeHighOrder<7>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    case 8: decodeHighOrder<8>(reader, c, x, y, historyStart, begin, end, xrCoding, ydrCoding); break;
+    default:
+      for (int i = begin; i < end; i++) {
+        int16_t xr, ydr;
+        xrCoding.read(reader, xr);
+        x[i] = predict<Format>(x[i - 2], c.xc2, x[i - 1], c.xc1) + xr;
+        if (STEREO) {
+          ydrCoding.read(reader, ydr);
+          y[i] = predict<Format>(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0) + ydr;
+        }
       }
-      for (; j < targetNumSampleTuples - NUM_LP_COEFS; j++) {
-        xx0 += x[j]*(int32_t)x[j];
-        xx1 += x[j]*(int32_t)x[j + 1];
-        x0x2 += x[j]*(int32_t)x[j + 2];
+    }
+    xrCodingState = xrCoding;
+    ydrCodingState = ydrCoding;
+  }
 
-        yy0 += y[j]*(int32_t)y[j];
-        yy1 += y[j]*(int32_t)y[j + 1];
-        y0y2 += y[j]*(int32_t)y[j + 2];
+  // Write a decoded 16-bit sample converted to the output sample type
+  static void writeSample(int16_t *destination, int16_t sample, int shift) {
+    *destination = sample;
+  }
 
-	x2y2 += x[j + 2]*(int32_t)y[j + 2];
-	y1x2 += y[j + 1]*(int32_t)x[j + 2];
-	y0x2 += y[j]*(int32_t)x[j + 2];        
-      }
+  static void writeSample(int32_t *destination, int16_t sample, int shift) {
+    *destination = sample*(1 << shift);
+  }
 
-      // 01234.............j 
-      // PP++++++++++++++++   x0x0
-      //  P++++++++++++++++P  x1x1
-      //   ++++++++++++++++PP x2x2
-      // 012345............j
-      // PP++++++++++++++++   x0x1
-      //  P++++++++++++++++P  x1x2
-      // 012345............j
-      // PP++++++++++++++++   x0x2
+  static void writeSample(float *destination, int16_t sample, int shift) {
+    *destination = sample*(1.0f/32768.0f);
+  }
 
-      int64_t x0x0 = x0x0Pre + xx0;
-      int64_t x1x1 = x1x1Pre + xx0 + x[j]*(int32_t)x[j];
-      int64_t x2x2 = xx0 + (x[j]*(int32_t)x[j] + x[j + 1]*(int32_t)x[j + 1]);
-      int64_t x0x1 = x0x1Pre + xx1;
-      int64_t x1x2 = x1x2Pre + xx1 + x[j]*(int32_t)x[j + 1];
+  // Shift a written sample of a linear prediction block of MLAC24BitFormat left by lowShift bits and add its low bits below it, the
+  // lowShift bits of low
+  static void addLowBits(int16_t *destination, int lowShift, uint32_t low, int shift) {
+    *destination >>= Format::LOW_NUM_BITS - lowShift;
+  }
 
-      int64_t y0y0 = y0y0Pre + yy0;
-      int64_t y1y1 = y1y1Pre + yy0 + y[j]*(int32_t)y[j];
-      int64_t y0y1 = y0y1Pre + yy1;
-      int64_t y1y2 = y1y2Pre + yy1 + y[j]*(int32_t)y[j + 1];
+  static void addLowBits(int32_t *destination, int lowShift, uint32_t low, int shift) {
+    int32_t value = (*destination >> shift)*(1 << lowShift) + (int32_t)low;
+    *destination = (shift >= Format::LOW_NUM_BITS) ? value*(1 << (shift - Format::LOW_NUM_BITS)) : value >> (Format::LOW_NUM_BITS - shift);
+  }
 
-      // The above is an optimization of:
-      /*
-      for (; j < targetNumSampleTuples - NUM_LP_COEFS; j++) {
-        x0x0 += x[j]*(int32_t)x[j];
-	x0x1 += x[j]*(int32_t)x[j + 1];
-	x0x2 += x[j]*(int32_t)x[j + 2];
-	x1x1 += x[j + 1]*(int32_t)x[j + 1];
-	x1x2 += x[j + 1]*(int32_t)x[j + 2];
-	x2x2 += x[j + 2]*(int32_t)x[j + 2];
-	y0y0 += y[j]*(int32_t)y[j];
-	y0y1 += y[j]*(int32_t)y[j + 1];
-	y0y2 += y[j]*(int32_t)y[j + 2];
-	y1x2 += y[j + 1]*(int32_t)x[j + 2];
-	y1y1 += y[j + 1]*(int32_t)y[j + 1];
-	y1y2 += y[j + 1]*(int32_t)y[j + 2];
-	y0x2 += y[j]*(int32_t)x[j + 2];
+  static void addLowBits(float *destination, int lowShift, uint32_t low, int shift) {
+    *destination = *destination*((1 << lowShift)*(1.0f/(1 << Format::LOW_NUM_BITS))) + low*(1.0f/(32768.0f*(1 << Format::LOW_NUM_BITS)));
+  }
+
+  // Read the shift and the low bits of the sample tuples of a linear prediction block of MLAC24BitFormat, and apply them to the written
+  // output
+  template <class Sample>
+  static void readLowBits(BitStreamReader &reader, const MLACOutput<Sample> &output, int numSampleTuples) {
+    uint32_t lowShift;
+    uint32_t lowNumBits;
+    reader.read(lowShift, LOW_NUM_BITS_NUM_BITS);
+    reader.read(lowNumBits, LOW_NUM_BITS_NUM_BITS);
+    if (lowShift > Format::LOW_NUM_BITS || lowNumBits > lowShift || (lowShift == Format::LOW_NUM_BITS && lowNumBits == 0)) {
+      return;
+    }
+    for (int i = 0; i < numSampleTuples; i++) {
+      uint32_t low = 0;
+      if (lowNumBits) {
+        reader.read(low, lowNumBits);
       }
-      */
-      
-      float xDivisor = (float)x0x0*x1x1 - (float)x0x1*x0x1;
-      float xc1f, xc2f;
-      if (xDivisor == 0) {
-	xc1f = 0;
-	xc2f = 0;
-      } else {
-	float xInvDivisor = 1.0f/xDivisor;
-	xc1f = ((float)x0x0*x1x2 - (float)x0x1*x0x2)*xInvDivisor;
-	xc2f = ((float)x0x2*x1x1 - (float)x0x1*x1x2)*xInvDivisor;
-      }
-      //      float dev_xc1f = x0x1/(float)x0x0;
-      //      printf("%f,%f,%f,", xc1f, xc2f, dev_xc1f);
-      c.xc1 = saturate((int)round(xc1f*COEF_DIVISOR), C1_MIN + C1_BIAS, C1_MAX + C1_BIAS);
-      c.xc2 = saturate((int)round(xc2f*COEF_DIVISOR), C2_MIN + C2_BIAS, C2_MAX + C2_BIAS);
-      float ydivisor = 2.0f*y0y1*y0x2*y1x2 - (float)y0y1*y0y1*x2x2 + (float)y0y0*y1y1*x2x2 - (float)y0y0*y1x2*y1x2 - (float)y0x2*y0x2*y1y1;
-      float yc1f, yc2f, yd0f;
-      if (ydivisor == 0) {
-	yc1f = 0;
-	yc2f = 0;
-	yd0f = 0;
-      } else {
-	float ydInvDivisor = 1.0f/ydivisor;
-	yc1f = ((float)y0y0*y1y2*x2x2 - (float)y0y0*y1x2*x2y2 - (float)y0y1*y0y2*x2x2 + (float)y0y1*y0x2*x2y2 + (float)y0y2*y0x2*y1x2 - (float)y0x2*y0x2*y1y2)*ydInvDivisor;
-	yc2f = ((float)y0y2*y1y1*x2x2 - (float)y0y2*y1x2*y1x2 - (float)y0y1*y1y2*x2x2 + (float)y0y1*y1x2*x2y2 - (float)y0x2*y1y1*x2y2 + (float)y0x2*y1y2*y1x2)*ydInvDivisor;
-	yd0f = ((float)y0y0*y1y1*x2y2 - (float)y0y0*y1y2*y1x2 - (float)y0y1*y0y1*x2y2 + (float)y0y1*y0y2*y1x2 + (float)y0y1*y0x2*y1y2 - (float)y0y2*y0x2*y1y1)*ydInvDivisor;
-      }
-      c.yc1 = saturate((int)round(yc1f*COEF_DIVISOR), C1_MIN + C1_BIAS, C1_MAX + C1_BIAS);
-      c.yc2 = saturate((int)round(yc2f*COEF_DIVISOR), C2_MIN + C2_BIAS, C2_MAX + C2_BIAS);
-      c.yd0 = saturate((int)round(yd0f*COEF_DIVISOR), D0_MIN + D0_BIAS, D0_MAX + D0_BIAS);
- 
-      // Do linear prediction with the new coefficients
-     
-      xr.resetExpGolombLikeStats();
-      ydr.resetExpGolombLikeStats();
-      for (int i = NUM_LP_COEFS; i < targetNumSampleTuples; i++) {
-	xr.s[i] = x[i] - predict(x[i - 2], c.xc2, x[i - 1], c.xc1);
-	ydr.s[i] = y[i] - predict(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0);
-	xr.addToBitDepthCounts(xr.s[i]);
-	ydr.addToBitDepthCounts(ydr.s[i]);
-      }
-      xr.expGolombLikeParameter = bestExpGolombLikeParameter16(xr.bitDepthCounts, xr.numBits, targetNumSampleTuples - NUM_LP_COEFS);
-      ydr.expGolombLikeParameter = bestExpGolombLikeParameter16(ydr.bitDepthCounts, ydr.numBits, targetNumSampleTuples - NUM_LP_COEFS);
-      xr.numBits += residualExpGolombLikeParameterEncodingNumBits[xr.expGolombLikeParameter - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.xc1-C1_BIAS, C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.xc2-C2_BIAS, C2_EXPGOLOMBLIKE_PARAMETER);
-      ydr.numBits += residualExpGolombLikeParameterEncodingNumBits[ydr.expGolombLikeParameter - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] + valueToExpGolombLikeNumBits16(c.yc1-C1_BIAS, C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yc2-C2_BIAS, C2_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yd0-D0_BIAS, D0_EXPGOLOMBLIKE_PARAMETER);
-      int xrydrNumBits = xr.numBits + ydr.numBits;
-      chMode = CHMODE_INDEPENDENT_AND_DEPENDENT;
-      numBits = xrydrNumBits;
-      if (numBits > numAvailableBits) {
-	//	printf("Early out\n");
-        break;
-      } 
-      bestChMode = chMode;
-      bestc = c;
-      bestNumSampleTuples = targetNumSampleTuples;
-      bestNumBits = numBits;
-      bestxrExpGolombLikeParameter = xr.expGolombLikeParameter;
-      bestydrExpGolombLikeParameter = ydr.expGolombLikeParameter;
-      if (numBits +  2*(1 + RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) <= numAvailableBits) {
-        for (int i = targetNumSampleTuples; i < BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
-          xr.s[i] = x[i] - predict(x[i - 2], c.xc2, x[i - 1], c.xc1);
-          ydr.s[i] = y[i] - predict(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0);
-          // Could maybe (or not) do these more efficiently via totalExpGolombLikeNumBits16
-          xrydrNumBits += valueToExpGolombLikeNumBits16(xr.s[i], xr.expGolombLikeParameter) + valueToExpGolombLikeNumBits16(ydr.s[i], ydr.expGolombLikeParameter);
-          int candidateChMode = CHMODE_INDEPENDENT_AND_DEPENDENT;
-          int candidateNumBits = xrydrNumBits;
-          if (candidateNumBits <= numAvailableBits) {
-            bestChMode = candidateChMode;
-            bestNumSampleTuples = i + 1;
-            bestNumBits = candidateNumBits;
-          } else {
-            // Possible todo: Could use new exp-Golomb-like parameterization here
-            break;
-          }
+      addLowBits(&output.left[i*output.stride], lowShift, low << (lowShift - lowNumBits), output.shift);
+      if (STEREO) {
+        if (lowNumBits) {
+          reader.read(low, lowNumBits);
         }
+        addLowBits(&output.right[i*output.stride], lowShift, low << (lowShift - lowNumBits), output.shift);
       }
-      targetNumSampleTuples = bestNumSampleTuples + 1;
     }
+  }
 
-    // *** This could be done more smartly
-    for (int i = NUM_LP_COEFS; i < bestNumSampleTuples; i++) {
-      xr.s[i] = x[i] - predict(x[i - 2], bestc.xc2, x[i - 1], bestc.xc1);
-      ydr.s[i] = y[i] - predict(y[i - 2], bestc.yc2, y[i - 1], bestc.yc1, x[i], bestc.yd0);
+  // Convert delta values of the independent and dependent channel of chMode to delta values of the left and right channel, in place
+  static void toLeftAndRight(int chMode, int16_t &x, int16_t &y) {
+    if (chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+      int16_t temp = x;
+      x = y;
+      y = temp;
+    } else if (chMode == CHMODE_MID_AND_SIDE) {
+      inverseMidSide(x, y);
     }
+  }
 
-    if (bestNumSampleTuples < minNumSampleTuples) {// *** Move this up for efficiency
-      //      bestChMode = CHMODE_MSB;
-    }
-      
-    
-    // Write time stamp
-    if (bestChMode == CHMODE_MSB) {
-      for (; trueBitDepth >= 8; trueBitDepth--) {
-	if (chModeMSBNumSampleTuples[trueBitDepth] >= minNumSampleTuples) break; 
+  // Sum numSampleTuples delta values of the channels of chMode, from x and y, to leftSample and rightSample, and write the sums to the
+  // output from sample tuple outputIndex on
+  template <int chMode, class Sample>
+  static void writeDeltas(const int16_t *x, const int16_t *y, int numSampleTuples, int16_t &leftSample, int16_t &rightSample, const MLACOutput<Sample> &output, int outputIndex) {
+    int16_t left = leftSample;
+    int16_t right = rightSample;
+    for (int i = 0; i < numSampleTuples; i++) {
+      int16_t leftDelta = x[i];
+      int16_t rightDelta = y[i];
+      toLeftAndRight(chMode, leftDelta, rightDelta);
+      left += leftDelta;
+      writeSample(&output.left[(outputIndex + i)*output.stride], left, output.shift);
+      if (STEREO) {
+        right += rightDelta;
+        writeSample(&output.right[(outputIndex + i)*output.stride], right, output.shift);
       }
-      bestNumSampleTuples = chModeMSBNumSampleTuples[trueBitDepth];
-      // *** numBitsWritten is vague
     }
-    timeStamp = bestNumSampleTuples; // Fake it! ***    
-    writer.write(timeStamp, 8);
-    // Write channel mode
-    writer.write(bestChMode, 2);
-    if (bestChMode == CHMODE_INDEPENDENT_AND_DEPENDENT) {
-      // Write left channel warmup
-      writer.writeExpGolombLike(x[0], 14);
-      writer.writeExpGolombLike(x[1], 14);
-      // Write right channel warmup
-      writer.writeExpGolombLike(y[0], 14);
-      writer.writeExpGolombLike(y[1], 14);
-      // Write independent left channel exp-Golomb-like parameter and coefficients
-      writer.writeResidualExpGolombLikeParameter(bestxrExpGolombLikeParameter);
-      writer.writeExpGolombLike(bestc.xc1-C1_BIAS, C1_EXPGOLOMBLIKE_PARAMETER);
-      writer.writeExpGolombLike(bestc.xc2-C2_BIAS, C2_EXPGOLOMBLIKE_PARAMETER);
-      // Write dependent right channel exp-Golomb-like parameter and coefficients
-      writer.writeResidualExpGolombLikeParameter(bestydrExpGolombLikeParameter);
-      writer.writeExpGolombLike(bestc.yc1-C1_BIAS, C1_EXPGOLOMBLIKE_PARAMETER);
-      writer.writeExpGolombLike(bestc.yc2-C2_BIAS, C2_EXPGOLOMBLIKE_PARAMETER);      
-      writer.writeExpGolombLike(bestc.yd0-D0_BIAS, D0_EXPGOLOMBLIKE_PARAMETER);      
-      // Write audio data residues
-      for (int i = NUM_LP_COEFS; i < bestNumSampleTuples; i++) {
-	writer.writeExpGolombLike(xr.s[i], bestxrExpGolombLikeParameter);
-	writer.writeExpGolombLike(ydr.s[i], bestydrExpGolombLikeParameter);
-      }
-    } else { // bestChMode == CHMODE_MSB
-      // Write true bit depth
-      writer.write(trueBitDepth - TRUE_BITDEPTH_BIAS, 4);
-      // Write raw PCM audio
-      if (trueBitDepth == 16) {
-        for (int i = 0; i < bestNumSampleTuples; i++) {
-          writer.write(input[i*2 + 0], trueBitDepth);
-          writer.write(input[i*2 + 1], trueBitDepth);
+    leftSample = left;
+    rightSample = right;
+  }
+
+  // Kinds of blocks, by how their sample tuples are decoded after the header
+  static const int BLOCK_FIXED = 0; // Linear prediction with fixed exp-Golomb-like parameters
+  static const int BLOCK_ADAPTIVE = 1; // Linear prediction with adaptive exp-Golomb-like parameters
+  static const int BLOCK_RANS = 2; // Linear prediction with rANS coded residuals
+  static const int BLOCK_NEAR_LOSSLESS = 3;
+  static const int BLOCK_PCM = 4;
+  static const int BLOCK_CONSTANT_RUN = 5;
+  static const int BLOCK_UNDECODABLE = 6; // Continuation block after restartStream, or block longer than BLOCK_MAX_NUM_SAMPLETUPLES
+
+  // Longest number of bits that a block header can take, of fields and exp-Golomb-like codes of at most 32 bits, also when it is read
+  // from a block that has only partly arrived
+  static const int MAX_HEADER_NUM_BITS = 8 + 16 + Format::NUM_CHANNELS*(32*(2 + 1 + 1 + Format::MAX_LP_ORDER) + RANS_PROB_BITS);
+
+  // What a block codes before the residuals of its linear prediction or its PCM audio, and the state of its residual coding
+  struct BlockHeader {
+    int numSampleTuples;
+    int kind;
+    int bitDepth; // Effective resolution of the audio of the block, the return value of decode
+    bool independent; // Does the block start a stream that continuation blocks can continue?
+    int chMode; // Channel mode of the delta values of a linear prediction or near-lossless block
+    LPCoefs c;
+    int blockStart; // Index of the first sample tuple of the block in the window of delta values
+    int historyStart; // Index of the first delta value in the window that prediction may use
+    int trueBitDepth; // Of a PCM block
+    int16_t constant[2]; // Sample tuple of a constant run
+    FixedExpGolombLikeParameter xrFixed, ydrFixed;
+    AdaptiveExpGolombLikeParameter<Format> xrAdaptive, ydrAdaptive;
+    RANSResidualDecoder xrRANS, ydrRANS;
+    QuantizedExpGolombLikeParameter xrQuantized, ydrQuantized;
+  };
+
+  // How far the sample tuples of a block have been decoded and written to the output
+  struct BlockProgress {
+    int numSampleTuplesDecoded;
+    int16_t leftSample; // Last left channel sample written
+    int16_t rightSample; // Last right channel sample written
+    int windowStart; // Index of x[0] and y[0] as if the window held all of the block
+    int next; // Index in the window of the next delta value to decode
+    int unwritten; // Index in the window of the first delta value not written to the output
+    int16_t lastSampleTuples[(NUM_LP_COEFS + 1)*2]; // What the stream continues from, of a PCM block
+  };
+
+  // Read the header of a block. The warmup, or the delta values of the previous block that a continuation block continues from, go to
+  // x and y. Nothing else changes, so the header of a block that has only partly arrived can be read again once more of it has.
+  void readHeader(BitStreamReader &reader, BlockHeader &h, int16_t *x, int16_t *y) const {
+    // Read time stamp
+    uint32_t temp;
+    reader.read(temp, 8); 
+    h.numSampleTuples = temp; // Fake it! ***    
+    // Read channel mode
+    uint32_t chMode;
+    reader.read(chMode, Format::CHMODE_NUM_BITS);
+    h.chMode = chMode;
+    h.blockStart = 0;
+    h.independent = true;
+    if (h.numSampleTuples > Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+      // A block of a format with longer blocks would overrun the window of delta values and the output
+      h.numSampleTuples = Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+      h.kind = BLOCK_UNDECODABLE;
+      h.bitDepth = 0;
+      h.independent = false;
+      return;
+    }
+    if (chMode != CHMODE_MSB) {
+      // x and y are the independent and dependent channel of chMode until the end of linear prediction
+      // Read continuation flag
+      uint32_t continuation;
+      reader.read(continuation, 1);
+      int coefCoding = COEF_CODING_INDEPENDENT;
+      if (continuation) {
+        h.independent = false;
+        if (!stream.valid) {
+          h.kind = BLOCK_UNDECODABLE;
+          h.bitDepth = 0;
+          return;
+        }
+        // Read coefficient reuse flag
+        uint32_t reuse;
+        reader.read(reuse, 1);
+        coefCoding = reuse ? COEF_CODING_REUSE : COEF_CODING_DELTA;
+        // Continue from the delta values of the previous block
+        h.blockStart = NUM_LP_COEFS;
+        for (int k = 0; k < NUM_LP_COEFS; k++) {
+          x[k] = stream.xDeltas[k];
+          y[k] = stream.yDeltas[k];
+          if (chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+            int16_t temp = x[k];
+            x[k] = y[k];
+            y[k] = temp;
+          } else if (chMode == CHMODE_MID_AND_SIDE) {
+            midSide(x[k], y[k]);
+          }
         }
       } else {
-        for (int i = 0; i < bestNumSampleTuples; i++) {
-          writer.write(input[i*2 + 0] >> (16 - trueBitDepth), trueBitDepth);
-          writer.write(input[i*2 + 1] >> (16 - trueBitDepth), trueBitDepth);
+        // Read independent channel warmup
+        reader.readExpGolombLike(x[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        reader.readExpGolombLike(x[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        // Read dependent channel warmup
+        if (STEREO) {
+          reader.readExpGolombLike(y[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+          reader.readExpGolombLike(y[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
         }
       }
-    }
-    numSampleTuplesWritten = bestNumSampleTuples;
-    numBitsWritten = bestNumBits;
-    return trueBitDepth;
-  }
-};
+      int xrExpGolombLikeParameter, ydrExpGolombLikeParameter = 0;
+      LPCoefs &c = h.c;
+      c = stream.c;
+      if (!continuation) {
+        c.reset<Format>();
+      }
+      if (coefCoding != COEF_CODING_REUSE && Format::MAX_LP_ORDER > NUM_LP_COEFS) {
+        // Read prediction order
+        uint32_t highOrder;
+        reader.read(highOrder, 1);
+        c.order = NUM_LP_COEFS;
+        if (highOrder) {
+          reader.read(temp, LP_ORDER_NUM_BITS);
+          c.order = NUM_LP_COEFS + 1 + temp;
+          if (c.order > Format::MAX_LP_ORDER) {
+            c.order = Format::MAX_LP_ORDER; // Only read from bits that have not arrived yet
+          }
+        }
+      }
+      bool highOrderCoefs = coefCoding != COEF_CODING_REUSE && c.order != NUM_LP_COEFS;
+      uint32_t rans = 0;
+      uint32_t adaptive = 0;
+      if (Format::RANS_RESIDUALS) {
+        // Read rANS residual coding flag
+        reader.read(rans, 1);
+      }
+      if (Format::ADAPTIVE_RESIDUALS && !rans) {
+        // Read adaptive residual coding flag
+        reader.read(adaptive, 1);
+      }
+      uint32_t xrRANSRawNumBits, xrRANSTable, ydrRANSRawNumBits = 0, ydrRANSTable = 0;
+      // Read independent channel exp-Golomb-like parameter or rANS raw number of bits and table, and coefficients
+      if (rans) {
+        reader.read(xrRANSRawNumBits, RANS_RAW_NUM_BITS_NUM_BITS);
+        reader.read(xrRANSTable, RANS_TABLE_NUM_BITS);
+      } else {
+        reader.readResidualExpGolombLikeParameter(xrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+      }
+      if (highOrderCoefs) {
+        for (int k = 1; k <= c.order; k++) {
+          reader.readExpGolombLike(c.xcn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
+        }
+      } else if (coefCoding == COEF_CODING_INDEPENDENT) {
+        reader.readExpGolombLike(c.xc1, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+        c.xc1 += Format::C1_BIAS;
+        reader.readExpGolombLike(c.xc2, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+        c.xc2 += Format::C2_BIAS;
+      } else if (coefCoding == COEF_CODING_DELTA) {
+        int16_t delta;
+        reader.readExpGolombLike(delta, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+        c.xc1 += delta;
+        reader.readExpGolombLike(delta, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+        c.xc2 += delta;
+      }
+      // Read dependent channel exp-Golomb-like parameter or rANS raw number of bits and table, and coefficients
+      if (STEREO) {
+        if (rans) {
+          reader.read(ydrRANSRawNumBits, RANS_RAW_NUM_BITS_NUM_BITS);
+          reader.read(ydrRANSTable, RANS_TABLE_NUM_BITS);
+        } else {
+          reader.readResidualExpGolombLikeParameter(ydrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+        }
+        if (highOrderCoefs) {
+          for (int k = 0; k <= c.order; k++) {
+            reader.readExpGolombLike(c.ycn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
+          }
+        } else if (coefCoding == COEF_CODING_INDEPENDENT) {
+          reader.readExpGolombLike(c.yc1, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+          c.yc1 += Format::C1_BIAS;
+          reader.readExpGolombLike(c.yc2, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+          c.yc2 += Format::C2_BIAS;
+          reader.readExpGolombLike(c.yd0, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+          c.yd0 += Format::D0_BIAS;
+        } else if (coefCoding == COEF_CODING_DELTA) {
+          int16_t delta;
+          reader.readExpGolombLike(delta, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+          c.yc1 += delta;
+          reader.readExpGolombLike(delta, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+          c.yc2 += delta;
+          reader.readExpGolombLike(delta, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+          c.yd0 += delta;
+        }
+      }
+      // The warmup of an independent block is not a delta value and is not used by orders above NUM_LP_COEFS
+      h.historyStart = continuation ? 0 : 1;
+      if (rans) {
+        // The coder states come first, in the order of the channels
+        h.kind = BLOCK_RANS;
+        h.xrRANS = RANSResidualDecoder(reader, xrRANSTable, xrRANSRawNumBits);
+        h.ydrRANS = STEREO ? RANSResidualDecoder(reader, ydrRANSTable, ydrRANSRawNumBits) : h.xrRANS; // Unused in mono
+      } else if (adaptive) {
+        h.kind = BLOCK_ADAPTIVE;
+        h.xrAdaptive = AdaptiveExpGolombLikeParameter<Format>(xrExpGolombLikeParameter);
+        h.ydrAdaptive = AdaptiveExpGolombLikeParameter<Format>(STEREO ? ydrExpGolombLikeParameter : xrExpGolombLikeParameter); // Unused in mono
+      } else {
+        h.kind = BLOCK_FIXED;
+        h.xrFixed = FixedExpGolombLikeParameter(xrExpGolombLikeParameter);
+        h.ydrFixed = FixedExpGolombLikeParameter(ydrExpGolombLikeParameter);
+      }
+      h.bitDepth = 16 + Format::LOW_NUM_BITS;
+    } else { // chMode == CHMODE_MSB
+      // Read true bit depth
+      uint32_t trueBitDepth;
+      reader.read(trueBitDepth, 4);
+      if (trueBitDepth == CONSTANT_RUN_CODE) {
+        // Read the sample tuple of the constant run
+        uint32_t left, right = 0;
+        reader.read(left, 16);
+        if (STEREO) {
+          reader.read(right, 16);
+        }
+        h.kind = BLOCK_CONSTANT_RUN;
+        h.constant[0] = left;
+        h.constant[1] = right;
+        h.bitDepth = 16 + Format::LOW_NUM_BITS;
+      } else if (trueBitDepth == NEAR_LOSSLESS_CODE) {
+        // Read shift
+        uint32_t shift;
+        reader.read(shift, NEAR_LOSSLESS_SHIFT_NUM_BITS);
+        // Read warmup of the left (independent) and right (dependent) channel
+        reader.readExpGolombLike(x[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        reader.readExpGolombLike(x[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        if (STEREO) {
+          reader.readExpGolombLike(y[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+          reader.readExpGolombLike(y[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        }
+        // Read exp-Golomb-like parameters and coefficients
+        LPCoefs &c = h.c;
+        c.reset<Format>();
+        uint32_t xrExpGolombLikeParameter, ydrExpGolombLikeParameter = 0;
+        reader.read(xrExpGolombLikeParameter, NEAR_LOSSLESS_PARAMETER_NUM_BITS);
+        reader.readExpGolombLike(c.xc1, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+        c.xc1 += Format::C1_BIAS;
+        reader.readExpGolombLike(c.xc2, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+        c.xc2 += Format::C2_BIAS;
+        if (STEREO) {
+          reader.read(ydrExpGolombLikeParameter, NEAR_LOSSLESS_PARAMETER_NUM_BITS);
+          reader.readExpGolombLike(c.yc1, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+          c.yc1 += Format::C1_BIAS;
+          reader.readExpGolombLike(c.yc2, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+          c.yc2 += Format::C2_BIAS;
+          reader.readExpGolombLike(c.yd0, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+          c.yd0 += Format::D0_BIAS;
+        }
+        h.kind = BLOCK_NEAR_LOSSLESS;
+        h.chMode = CHMODE_INDEPENDENT_AND_DEPENDENT;
+        h.historyStart = 1;
+        h.xrQuantized = QuantizedExpGolombLikeParameter(xrExpGolombLikeParameter + 1, shift);
+        h.ydrQuantized = QuantizedExpGolombLikeParameter(ydrExpGolombLikeParameter + 1, shift);
+        h.bitDepth = 16 - shift;
+      } else {
+        h.kind = BLOCK_PCM;
+        h.trueBitDepth = trueBitDepth + TRUE_BITDEPTH_BIAS;
+        h.bitDepth = h.trueBitDepth;
+      }
+    }
+  }
+
+  // Start decoding the sample tuples of a block whose header has been read
+  void startBlock(const BlockHeader &h, BlockProgress &p) const {
+    p.numSampleTuplesDecoded = 0;
+    p.leftSample = h.blockStart ? stream.xLast : 0;
+    p.rightSample = h.blockStart ? stream.yLast : 0;
+    p.windowStart = 0;
+    p.next = NUM_LP_COEFS;
+    p.unwritten = h.blockStart;
+  }
+
+  // Decode the residues of a linear prediction or near-lossless block up to sample tuple numSampleTuples of the block, continuing from
+  // p, and write the sample tuples to the output. x and y are a window of DELTA_WINDOW_LENGTH delta values that holds the first NUM_LP_COEFS
+  // delta values: warmup, or delta values of the previous block at blockStart = NUM_LP_COEFS. Once the window is full, its sample tuples
+  // are written and the last MAX_LP_ORDER delta values are moved to its beginning as history for the next ones. Delta values stay in the
+  // channels of chMode, and once the block is done, the stream continues from its end. Returns whether the block is done.
+  template <class ResidualCoding, class Sample>
+  bool decodeBlock(BitStreamReader &reader, const BlockHeader &h, int16_t *x, int16_t *y, BlockProgress &p, int numSampleTuples, ResidualCoding &xrCoding, ResidualCoding &ydrCoding, const MLACOutput<Sample> &output) {
+    int end = h.blockStart + h.numSampleTuples; // Index after the block as if the window held all of it
+    int stop = h.blockStart + numSampleTuples; // Index after the sample tuples to decode now, as if the window held all of the block
+    for (;;) {
+      int windowEnd = end - p.windowStart;
+      if (windowEnd > DELTA_WINDOW_LENGTH) {
+        windowEnd = DELTA_WINDOW_LENGTH;
+      }
+      int windowStop = (stop - p.windowStart < windowEnd) ? stop - p.windowStart : windowEnd;
+      if (windowStop < p.next) {
+        windowStop = p.next; // The warmup is already known
+      }
+      decodeResiduals(reader, h.c, x, y, h.historyStart - p.windowStart, p.next, windowStop, xrCoding, ydrCoding);
+      int outputIndex = p.windowStart + p.unwritten - h.blockStart;
+      if (h.chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+        writeDeltas<CHMODE_DEPENDENT_AND_INDEPENDENT>(&x[p.unwritten], &y[p.unwritten], windowStop - p.unwritten, p.leftSample, p.rightSample, output, outputIndex);
+      } else if (h.chMode == CHMODE_MID_AND_SIDE) {
+        writeDeltas<CHMODE_MID_AND_SIDE>(&x[p.unwritten], &y[p.unwritten], windowStop - p.unwritten, p.leftSample, p.rightSample, output, outputIndex);
+      } else {
+        writeDeltas<CHMODE_INDEPENDENT_AND_DEPENDENT>(&x[p.unwritten], &y[p.unwritten], windowStop - p.unwritten, p.leftSample, p.rightSample, output, outputIndex);
+      }
+      p.next = p.unwritten = windowStop;
+      if (windowStop < windowEnd) {
+        p.numSampleTuplesDecoded = p.windowStart + windowStop - h.blockStart;
+        return false;
+      }
+      if (p.windowStart + windowEnd == end) {
+        break;
+      }
+      for (int k = 0; k < Format::MAX_LP_ORDER; k++) {
+        x[k] = x[windowEnd - Format::MAX_LP_ORDER + k];
+        if (STEREO) {
+          y[k] = y[windowEnd - Format::MAX_LP_ORDER + k];
+        }
+      }
+      p.windowStart += windowEnd - Format::MAX_LP_ORDER;
+      p.next = p.unwritten = Format::MAX_LP_ORDER;
+    }
+    p.numSampleTuplesDecoded = h.numSampleTuples;
+    // Recover the last sample tuples backwards from the last delta values. The right channel of mono stays silent.
+    int16_t lastSampleTuples[(NUM_LP_COEFS + 1)*2]; // What the stream continues from
+    lastSampleTuples[NUM_LP_COEFS*2 + 0] = p.leftSample;
+    lastSampleTuples[NUM_LP_COEFS*2 + 1] = p.rightSample;
+    for (int k = NUM_LP_COEFS; k > 0; k--) {
+      int16_t leftDelta = x[end - p.windowStart - 1 - NUM_LP_COEFS + k];
+      int16_t rightDelta = STEREO ? y[end - p.windowStart - 1 - NUM_LP_COEFS + k] : 0;
+      toLeftAndRight(h.chMode, leftDelta, rightDelta);
+      lastSampleTuples[(k - 1)*2 + 0] = lastSampleTuples[k*2 + 0] - leftDelta;
+      lastSampleTuples[(k - 1)*2 + 1] = lastSampleTuples[k*2 + 1] - rightDelta;
+    }
+    stream.update(lastSampleTuples);
+    return true;
+  }
+
+  // Read raw PCM audio of a PCM block up to sample tuple numSampleTuples, continuing from p, reconstructed in the middle of the
+  // quantization step. Returns whether the block is done.
+  template <class Sample>
+  bool decodePCM(BitStreamReader &reader, const BlockHeader &h, BlockProgress &p, int numSampleTuples, const MLACOutput<Sample> &output) {
+    int shift = 16 - h.trueBitDepth;
+    int16_t halfStep = (h.trueBitDepth == 16) ? 0 : 0x8000 >> h.trueBitDepth;
+    for (int i = p.numSampleTuplesDecoded; i < numSampleTuples; i++) {
+      uint32_t val;
+      reader.read(val, h.trueBitDepth);
+      int16_t left = (val << shift) | halfStep;
+      int16_t right = 0;
+      writeSample(&output.left[i*output.stride], left, output.shift);
+      if (STEREO) {
+        reader.read(val, h.trueBitDepth);
+        right = (val << shift) | halfStep;
+        writeSample(&output.right[i*output.stride], right, output.shift);
+      }
+      int k = i - (h.numSampleTuples - NUM_LP_COEFS - 1);
+      if (k >= 0) {
+        p.lastSampleTuples[k*2 + 0] = left;
+        p.lastSampleTuples[k*2 + 1] = right;
+      }
+    }
+    p.numSampleTuplesDecoded = numSampleTuples;
+    if (numSampleTuples < h.numSampleTuples) {
+      return false;
+    }
+    stream.update(p.lastSampleTuples);
+    stream.c.reset<Format>();
+    stream.valid = true;
+    return true;
+  }
+
+  // Decode the sample tuples of a block whose header has been read, up to sample tuple numSampleTuples of the block, continuing from p,
+  // and write them to the output. Once the block is done, the stream continues from it. Returns whether the block is done.
+  template <class Sample>
+  bool continueBlock(BitStreamReader &reader, BlockHeader &h, int16_t *x, int16_t *y, BlockProgress &p, int numSampleTuples, const MLACOutput<Sample> &output) {
+    switch (h.kind) {
+    case BLOCK_FIXED:
+      if (!decodeBlock(reader, h, x, y, p, numSampleTuples, h.xrFixed, h.ydrFixed, output)) {
+        return false;
+      }
+      break;
+    case BLOCK_ADAPTIVE:
+      if (!decodeBlock(reader, h, x, y, p, numSampleTuples, h.xrAdaptive, h.ydrAdaptive, output)) {
+        return false;
+      }
+      break;
+    case BLOCK_RANS:
+      if (!decodeBlock(reader, h, x, y, p, numSampleTuples, h.xrRANS, h.ydrRANS, output)) {
+        return false;
+      }
+      break;
+    case BLOCK_NEAR_LOSSLESS:
+      if (!decodeBlock(reader, h, x, y, p, numSampleTuples, h.xrQuantized, h.ydrQuantized, output)) {
+        return false;
+      }
+      stream.c = h.c;
+      stream.valid = true;
+      return true;
+    case BLOCK_PCM:
+      return decodePCM(reader, h, p, numSampleTuples, output);
+    case BLOCK_CONSTANT_RUN:
+      for (int i = 0; i < h.numSampleTuples; i++) {
+        writeSample(&output.left[i*output.stride], h.constant[0], output.shift);
+        if (STEREO) {
+          writeSample(&output.right[i*output.stride], h.constant[1], output.shift);
+        }
+      }
+      for (int k = 0; k <= NUM_LP_COEFS; k++) {
+        p.lastSampleTuples[k*2 + 0] = h.constant[0];
+        p.lastSampleTuples[k*2 + 1] = h.constant[1];
+      }
+      p.numSampleTuplesDecoded = h.numSampleTuples;
+      stream.update(p.lastSampleTuples);
+      stream.c.reset<Format>();
+      stream.valid = true;
+      return true;
+    default: // BLOCK_UNDECODABLE, output silence. Continuation blocks after it cannot be decoded either.
+      for (int i = 0; i < h.numSampleTuples; i++) {
+        writeSample(&output.left[i*output.stride], 0, 0);
+        if (STEREO) {
+          writeSample(&output.right[i*output.stride], 0, 0);
+        }
+      }
+      p.numSampleTuplesDecoded = h.numSampleTuples;
+      stream.valid = false;
+      return true;
+    }
+    // A linear prediction block is done
+    if (Format::LOW_NUM_BITS) {
+      readLowBits(reader, output, h.numSampleTuples);
+    }
+    stream.c = h.c;
+    if (h.independent) {
+      stream.valid = true;
+    }
+    return true;
+  }
+
+  // Number of sample tuples of a block that can be decoded, continuing from p, from numAvailableBits bits of it. Residuals are counted
+  // at the longest length of their code, so a sample tuple is decoded at most one such sample tuple after its bits have arrived. The low
+  // bits of MLAC24BitFormat come after all the residuals, so its linear prediction blocks are decoded only once all of the bits have arrived.
+  int numDecodableSampleTuples(const BitStreamReader &reader, const BlockHeader &h, const BlockProgress &p, int numAvailableBits) const {
+    int maxSampleTupleNumBits;
+    switch (h.kind) {
+    case BLOCK_FIXED:
+    case BLOCK_ADAPTIVE:
+    case BLOCK_RANS:
+      if (Format::LOW_NUM_BITS) {
+        return p.numSampleTuplesDecoded;
+      }
+      maxSampleTupleNumBits = Format::NUM_CHANNELS*((h.kind == BLOCK_RANS) ? RANSResidualDecoder::MAX_NUM_BITS : (h.kind == BLOCK_ADAPTIVE) ? AdaptiveExpGolombLikeParameter<Format>::MAX_NUM_BITS : FixedExpGolombLikeParameter::MAX_NUM_BITS);
+      break;
+    case BLOCK_NEAR_LOSSLESS:
+      maxSampleTupleNumBits = Format::NUM_CHANNELS*QuantizedExpGolombLikeParameter::MAX_NUM_BITS;
+      break;
+    case BLOCK_PCM:
+      maxSampleTupleNumBits = Format::NUM_CHANNELS*h.trueBitDepth;
+      break;
+    default:
+      return h.numSampleTuples;
+    }
+    int numSampleTuples = p.numSampleTuplesDecoded + (numAvailableBits - reader.numBitsRead)/maxSampleTupleNumBits;
+    return (numSampleTuples < h.numSampleTuples) ? numSampleTuples : h.numSampleTuples;
+  }
+
+  template <class> friend class MLACBasicIncrementalDecoder;
+
+public:
+  // Forget the previous blocks. Call this after a lost block, so that continuation blocks are not decoded until the next independent block.
+  // CHMODE_MSB blocks are independent.
+  void restartStream() {
+    stream.valid = false;
+  }
+
+  // MLAC decode
+  // Arguments:
+  //   input = pointer to beginning of a block of BLOCK_NUM_BYTES encoded audio. Blocks of a stream must be decoded in order.
+  //   output = pointer to beggining of interleaved stereo 16-bit audio that must have room for at least BLOCK_MAX_NUM_SAMPLETUPLES stereo samples to be written.
+  //            Of MLACMonoFormat, the audio is mono.
+  //   numBytes = number of bytes of the block, if cut to less than BLOCK_NUM_BYTES. Bytes after it are not accessed.
+  // Returns:
+  //   timeStamp = time stamp read, not yet implemented. NOTE: TIME STAMPS ARE NOT YET FUNCTIONAL AND ARE INSTEAD USED FOR STORING NUMBER OF SAMPLE TUPLES
+  //   numSampleTuplesRead = number of stereo samples read
+  //   Return value = Effective resolution of audio in bits, 16 (24 of MLAC24BitFormat) for lossless compression, less for lossy
+  //                  compression, 0 for a continuation block that could not be decoded after restartStream. Its output is silence.
+  //                  Also 0 for a block of more than BLOCK_MAX_NUM_SAMPLETUPLES sample tuples, for example of an encoder compiled with a
+  //                  larger MLAC_BLOCK_MAX_NUM_SAMPLETUPLES. BLOCK_MAX_NUM_SAMPLETUPLES sample tuples of silence are output instead.
+  int decode(const uint8_t *input, int16_t *output, uint8_t &timeStamp, int &numSampleTuplesRead, int numBytes = BLOCK_NUM_BYTES) {
+    MLACOutput<int16_t> interleaved = {output, output + Format::NUM_CHANNELS - 1, Format::NUM_CHANNELS, 0};
+    return decode(input, interleaved, timeStamp, numSampleTuplesRead, numBytes);
+  }
+
+  // MLAC decode, converting the output from 16 bits as it is written. Arguments and return values are the same as of decode.
+  template <class Sample>
+  int decode(const uint8_t *input, const MLACOutput<Sample> &output, uint8_t &timeStamp, int &numSampleTuplesRead, int numBytes = BLOCK_NUM_BYTES) {
+    BitStreamReader reader(input, numBytes);
+    int16_t x[DELTA_WINDOW_LENGTH]; // Delta values of the independent or left channel
+    int16_t y[DELTA_WINDOW_LENGTH]; // Delta values of the dependent or right channel
+    BlockHeader h;
+    BlockProgress p;
+    readHeader(reader, h, x, y);
+    timeStamp = numSampleTuplesRead = h.numSampleTuples;
+    startBlock(h, p);
+    continueBlock(reader, h, x, y, p, h.numSampleTuples, output);
+    return h.bitDepth;
+  }
+
+  // MLAC decode a variable-length packet written by MLACBasicEncoder::encodeNextVariableLength. Arguments and return values are the same
+  // as of decode, and numBytesRead returns the number of bytes of the packet, so that the next packet starts at input + numBytesRead.
+  template <class Output>
+  int decodeVariableLength(const uint8_t *input, Output output, uint8_t &timeStamp, int &numSampleTuplesRead, int &numBytesRead) {
+    int numBytes = 0;
+    for (int i = 0; i < Format::PACKET_LENGTH_NUM_BYTES; i++) {
+      numBytes = (numBytes << 8) | input[i];
+    }
+    numBytes++;
+    numBytesRead = Format::PACKET_LENGTH_NUM_BYTES + numBytes;
+    return decode(&input[Format::PACKET_LENGTH_NUM_BYTES], output, timeStamp, numSampleTuplesRead, numBytes);
+  }
+};
+
+// Decoder of blocks that arrive a fragment at a time, for example a packet of a radio link that is received in pieces. The sample tuples
+// of a block are written to the output as soon as their bits have arrived, so that playback can start before the whole block has. The
+// output is the same as of MLACBasicDecoder. Residuals are counted at the longest length of their code, so a sample tuple of a linear
+// prediction or near-lossless block is written at most one such sample tuple of bits late. Linear prediction blocks of MLAC24BitFormat
+// are written only once the whole block has arrived, because their low bits come last.
+template <class Format>
+class MLACBasicIncrementalDecoder {
+  typedef MLACBasicDecoder<Format> Decoder;
+  static const int BLOCK_NUM_BYTES = Format::BLOCK_NUM_BYTES;
+  // Room for a block, and for reading a header from the first bytes of a block that has only partly arrived
+  static const int BUFFER_NUM_BYTES = (BLOCK_NUM_BYTES > Decoder::MAX_HEADER_NUM_BITS/8 + 4) ? BLOCK_NUM_BYTES : Decoder::MAX_HEADER_NUM_BITS/8 + 4;
+  Decoder decoder;
+  uint8_t block[BUFFER_NUM_BYTES]; // The bytes of the block that have arrived
+  int numBytesReceived;
+  bool headerRead; // Has the header of the block been read?
+  BitStreamReader reader; // Reads the block, from after the bits decoded so far
+  typename Decoder::BlockHeader header;
+  typename Decoder::BlockProgress progress;
+  int16_t x[Decoder::DELTA_WINDOW_LENGTH]; // Delta values of the independent or left channel
+  int16_t y[Decoder::DELTA_WINDOW_LENGTH]; // Delta values of the dependent or right channel
+
+public:
+  // Forget the previous blocks and the part of the current block that has arrived. Call this after a lost block or fragment.
+  void restartStream() {
+    decoder.restartStream();
+    numBytesReceived = 0;
+    headerRead = false;
+  }
+
+  // MLAC decode the next fragment of a block
+  // Arguments:
+  //   fragment = pointer to the next numFragmentBytes bytes of the block. A fragment must not extend past the end of the block, and the
+  //              fragment after the last one of a block starts the next block.
+  //   output = as of MLACBasicDecoder::decode, for the whole block. It must be the same for every fragment of a block.
+  //   numBytes = as of MLACBasicDecoder::decode
+  // Returns:
+  //   timeStamp, numSampleTuplesRead = as of MLACBasicDecoder::decode, once the first byte of the block has arrived
+  //   numSampleTuplesDecoded = number of sample tuples of the block written to the output so far. All numSampleTuplesRead of them are,
+  //                            at the latest once the last fragment of the block has arrived.
+  //   Return value = as of MLACBasicDecoder::decode, once the header of the block has arrived, and -1 before it
+  template <class Sample>
+  int decodeFragment(const uint8_t *fragment, int numFragmentBytes, const MLACOutput<Sample> &output, uint8_t &timeStamp, int &numSampleTuplesRead, int &numSampleTuplesDecoded, int numBytes = BLOCK_NUM_BYTES) {
+    for (int i = 0; i < numFragmentBytes; i++) {
+      block[numBytesReceived + i] = fragment[i];
+    }
+    numBytesReceived += numFragmentBytes;
+    bool complete = numBytesReceived >= numBytes;
+    timeStamp = numSampleTuplesRead = numBytesReceived ? block[0] : 0;
+    numSampleTuplesDecoded = 0;
+    if (!headerRead) {
+      if (!numBytesReceived) {
+        return -1;
+      }
+      reader = BitStreamReader(block, numBytes);
+      decoder.readHeader(reader, header, x, y);
+      // A header that was read past the bits that have arrived may have been read wrong. Read it again once more of the block is here.
+      if (!complete && reader.numBitsRead > numBytesReceived*8) {
+        return -1;
+      }
+      headerRead = true;
+      decoder.startBlock(header, progress);
+    }
+    timeStamp = numSampleTuplesRead = header.numSampleTuples;
+    int numSampleTuples = complete ? header.numSampleTuples : decoder.numDecodableSampleTuples(reader, header, progress, numBytesReceived*8);
+    if (numSampleTuples > progress.numSampleTuplesDecoded) {
+      decoder.continueBlock(reader, header, x, y, progress, numSampleTuples, output);
+    }
+    numSampleTuplesDecoded = progress.numSampleTuplesDecoded;
+    if (complete) {
+      numBytesReceived = 0;
+      headerRead = false;
+    }
+    return header.bitDepth;
+  }
+
+  // Same as decodeFragment, to interleaved 16-bit audio as of MLACBasicDecoder::decode
+  int decodeFragment(const uint8_t *fragment, int numFragmentBytes, int16_t *output, uint8_t &timeStamp, int &numSampleTuplesRead, int &numSampleTuplesDecoded, int numBytes = BLOCK_NUM_BYTES) {
+    MLACOutput<int16_t> interleaved = {output, output + Format::NUM_CHANNELS - 1, Format::NUM_CHANNELS, 0};
+    return decodeFragment(fragment, numFragmentBytes, interleaved, timeStamp, numSampleTuplesRead, numSampleTuplesDecoded, numBytes);
+  }
+
+  MLACBasicIncrementalDecoder(): numBytesReceived(0), headerRead(false), reader(block, BLOCK_NUM_BYTES) {
+    for (int i = 0; i < BUFFER_NUM_BYTES; i++) {
+      block[i] = 0;
+    }
+  }
+};
+
+template <class Format, int numRungs> class MLACBasicLadderEncoder;
+template <class Format> class MLACBasicCompactEncoder;
+
+template <class Format>
+class MLACBasicEncoder {
+  static const int BLOCK_NUM_BYTES = Format::BLOCK_NUM_BYTES;
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  static const int BLOCK_MIN_NUM_SAMPLETUPLES = Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+  static const int NUM_CHANNELS = Format::NUM_CHANNELS; // Number of interleaved channels of the input
+  static const bool STEREO = NUM_CHANNELS == 2; // Is there a dependent channel, or only the independent channel of mono?
+  Channel<Format> xr;
+  Channel<Format> ydr;
+  // Delta values of the current block start at x and y. In a continuous stream, the block slides forward in xBuf and yBuf so that
+  // the delta values of sample tuples not yet encoded can be reused by the next block. A continuation block starts at x[blockStart]
+  // and is preceded by delta values of the previous block, as decoded.
+  int16_t xBuf[NUM_LP_COEFS + 2*BLOCK_MAX_NUM_SAMPLETUPLES];
+  int16_t yBuf[NUM_LP_COEFS + 2*BLOCK_MAX_NUM_SAMPLETUPLES];
+  int16_t *x; // Independent channel of the channel mode being coded
+  int16_t *y; // Dependent channel of the channel mode being coded
+  // Mid and side channel of CHMODE_MID_AND_SIDE
+  int16_t midBuf[NUM_LP_COEFS + BLOCK_MAX_NUM_SAMPLETUPLES];
+  int16_t sideBuf[NUM_LP_COEFS + BLOCK_MAX_NUM_SAMPLETUPLES];
+  int deltaOffset; // Offset of the current block in xBuf and yBuf, after the first NUM_LP_COEFS delta values
+  int numKeptDeltas; // Delta values of sample tuples 1 .. numKeptDeltas - 1 of the block are already known
+  int deltaLowShift; // Shift of the samples that the kept delta values are of, of MLAC24BitFormat
+  int blockStart; // Index of the first sample tuple of the current block in x and y: NUM_LP_COEFS in a continuation block, otherwise 0
+  int blockEnd; // Index after the last sample tuple available to the current block in x and y
+  int coefCoding; // Coefficient coding that side info bits are counted for
+  int lowTupleNumBits; // Number of low bits per sample tuple that bits are counted for, of MLAC24BitFormat
+  MLACStreamState stream; // What the decoder knows after the previous block
+  int numBlocksSinceIndependent; // Number of blocks since the last independent block
+  template <class, int> friend class MLACBasicLadderEncoder;
+  template <class> friend class MLACBasicCompactEncoder;
+  // rANS coding of the residuals of a channel
+  struct RANSChannel {
+    int table;
+    int rawNumBits;
+    uint32_t state;
+  };
+  // Input converted by the converting entry points, at the same offset as the delta values in xBuf and yBuf. numKeptInputSampleTuples
+  // sample tuples of it from the previous call to encodeNext are kept, 0 if the previous input was not converted.
+  int16_t inputBuf[NUM_CHANNELS*2*BLOCK_MAX_NUM_SAMPLETUPLES];
+  // Low bits of the converted input of MLAC24BitFormat, below the 16 bits in inputBuf. Other formats need no room for them.
+  uint8_t lowBuf[Format::LOW_NUM_BITS ? NUM_CHANNELS*2*BLOCK_MAX_NUM_SAMPLETUPLES : 1];
+  static_assert(Format::LOW_NUM_BITS <= 8 && Format::LOW_NUM_BITS < (1 << LOW_NUM_BITS_NUM_BITS), "Low bits must fit in lowBuf");
+  // Converted input of MLAC24BitFormat shifted right by fewer than LOW_NUM_BITS bits, for linear prediction of quiet blocks
+  int16_t shiftedBuf[Format::LOW_NUM_BITS ? NUM_CHANNELS*BLOCK_MAX_NUM_SAMPLETUPLES : 1];
+  int numKeptInputSampleTuples;
+  uint32_t ditherState;
+  // Bits of a block coded with rANS, in reverse order of writing. Formats without rANS residuals need no room for them.
+  static const int RANS_MAX_NUM_CHUNKS = Format::RANS_RESIDUALS ? 4*(NUM_LP_COEFS + BLOCK_MAX_NUM_SAMPLETUPLES) : 1;
+  uint32_t ransBits[RANS_MAX_NUM_CHUNKS];
+  uint8_t ransChunkNumBits[RANS_MAX_NUM_CHUNKS];
+  int numRANSChunks;
+
+  // Calculate residuals of sample tuples begin..end-1 of the left (independent) and/or right (dependent) channel with coefficients
+  // of the given order above NUM_LP_COEFS. The first sample tuples of the block are predicted from as many previous delta values as there are,
+  // the same way as in the decoder.
+  template <int order>
+  void highOrderResiduals(const LPCoefs &c, int begin, int end, bool independent, bool dependent) {
+    dependent = dependent && STEREO;
+    int historyStart = blockStart ? 0 : 1;
+    int head = (end < historyStart + order) ? end : historyStart + order;
+    for (int i = begin; i < head; i++) {
+      if (independent) {
+        xr.s[i] = x[i] - predictHighOrder<Format>(&x[i], c.xcn, i - historyStart);
+      }
+      if (dependent) {
+        ydr.s[i] = y[i] - predictHighOrder<Format>(&y[i], c.ycn, i - historyStart, (int32_t)x[i]*c.ycn[0]);
+      }
+    }
+    if (begin < head) {
+      begin = head;
+    }
+    if (independent) {
+      for (int i = begin; i < end; i++) {
+        xr.s[i] = x[i] - predictHighOrder<Format, order>(&x[i], c.xcn);
+      }
+    }
+    if (dependent) {
+      for (int i = begin; i < end; i++) {
+        ydr.s[i] = y[i] - predictHighOrder<Format, order>(&y[i], c.ycn, (int32_t)x[i]*c.ycn[0]);
+      }
+    }
+  }
+
+  // Same as above for the order of the coefficients
+  void highOrderResiduals(const LPCoefs &c, int begin, int end, bool independent, bool dependent) {
+    static_assert(MAX_LP_ORDER == 8, "Update the prediction order cases");
+    switch (c.order) {
+    case 3: highOrderResiduals<3>(c, begin, end, independent, dependent); break;
+    case 4: highOrderResiduals<4>(c, begin, end, independent, dependent); break;
+    case 5: highOrderResiduals<5>(c, begin, end, independent, dependent); break;
+    case 6: highOrderResiduals<6>(c, begin, end, independent, dependent); break;
+    case 7: highOrderResiduals<7>(c, begin, end, independent, dependent); break;
+    case 8: highOrderResiduals<8>(c, begin, end, independent, dependent); break;
+    }
+  }
+
+  // Calculate residuals of sample tuples begin..end-1 of both channels
+  void residuals(const LPCoefs &c, int begin, int end) {
+    if (c.order == NUM_LP_COEFS) {
+      for (int i = begin; i < end; i++) {
+        xr.s[i] = x[i] - predict<Format>(x[i - 2], c.xc2, x[i - 1], c.xc1);
+        if (STEREO) {
+          ydr.s[i] = y[i] - predict<Format>(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0);
+        }
+      }
+    } else {
+      highOrderResiduals(c, begin, end, true, true);
+    }
+  }
+
+  // Count the bits of the residuals in xr and ydr coded with adaptive exp-Golomb-like parameters that start from
+  // xrExpGolombLikeParameter and ydrExpGolombLikeParameter, and the low bits. numBits starts from the side info bits. Updates numSampleTuples
+  // and numBits to describe the longest block up to end that fits in numAvailableBits.
+  void extendAdaptive(int xrExpGolombLikeParameter, int ydrExpGolombLikeParameter, int end, int &numSampleTuples, int &numBits, int numAvailableBits) {
+    AdaptiveExpGolombLikeParameter<Format> xrParameter(xrExpGolombLikeParameter);
+    AdaptiveExpGolombLikeParameter<Format> ydrParameter(STEREO ? ydrExpGolombLikeParameter : xrExpGolombLikeParameter); // Unused in mono
+    numSampleTuples = NUM_LP_COEFS;
+    for (int i = NUM_LP_COEFS; i < end; i++) {
+      int candidateNumBits = numBits + valueToExpGolombLikeNumBits16(xr.s[i], xrParameter.parameter) + (STEREO ? valueToExpGolombLikeNumBits16(ydr.s[i], ydrParameter.parameter) : 0) + lowTupleNumBits;
+      if (candidateNumBits > numAvailableBits) {
+        break;
+      }
+      xrParameter.update(xr.s[i]);
+      if (STEREO) {
+        ydrParameter.update(ydr.s[i]);
+      }
+      numSampleTuples = i + 1;
+      numBits = candidateNumBits;
+    }
+  }
+
+  // Return the initial adaptive exp-Golomb-like parameter, near the fixed parameter, that needs the fewest bits
+  // for the residuals of sample tuples NUM_LP_COEFS..end-1 of a channel
+  static int adaptiveInitialParameter(const int16_t *s, int end, int fixedParameter) {
+    int bestParameter = fixedParameter;
+    int bestNumBits = INT_MAX;
+    for (int initialParameter = fixedParameter - 1; initialParameter <= fixedParameter + 2; initialParameter++) {
+      if (initialParameter < Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER || initialParameter > Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 8) {
+        continue;
+      }
+      AdaptiveExpGolombLikeParameter<Format> parameter(initialParameter);
+      int numBits = residualExpGolombLikeParameterEncodingNumBits[initialParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER];
+      for (int i = NUM_LP_COEFS; i < end; i++) {
+        numBits += valueToExpGolombLikeNumBits16(s[i], parameter.parameter);
+        parameter.update(s[i]);
+      }
+      if (numBits < bestNumBits) {
+        bestParameter = initialParameter;
+        bestNumBits = numBits;
+      }
+    }
+    return bestParameter;
+  }
+
+  // Write the residues of sample tuples NUM_LP_COEFS..end-1, with FixedExpGolombLikeParameter or AdaptiveExpGolombLikeParameter as ResidualCoding
+  template <class ResidualCoding>
+  void writeResiduals(BitStreamWriter &writer, int end, ResidualCoding xrCoding, ResidualCoding ydrCoding) {
+    for (int i = NUM_LP_COEFS; i < end; i++) {
+      xrCoding.write(writer, xr.s[i]);
+      if (STEREO) {
+        ydrCoding.write(writer, ydr.s[i]);
+      }
+    }
+  }
+
+  // Estimated number of bits of a residual coded with rANS, in units of 2^-RANS_COST_SHIFT bits
+  static int ransNumBits(int16_t residual, const RANSChannel &channel) {
+    int symbol = ransSymbol(residual, channel.rawNumBits);
+    if (symbol == RANS_ESCAPE) {
+      return ransSymbolCosts[channel.table][RANS_ESCAPE] + (valueToExpGolombLikeNumBits16(residual, ransEscapeExpGolombLikeParameter(channel.rawNumBits)) << RANS_COST_SHIFT);
+    }
+    return ransSymbolCosts[channel.table][symbol] + (channel.rawNumBits << RANS_COST_SHIFT);
+  }
+
+  // Choose the rANS table and raw number of bits for the residuals of sample tuples NUM_LP_COEFS..end-1 of a channel.
+  // Returns the estimated number of bits of the residuals in units of 2^-RANS_COST_SHIFT bits.
+  static int chooseRANSTable(const int16_t *s, int end, RANSChannel &channel) {
+    uint32_t magnitudeSum = 0;
+    for (int i = NUM_LP_COEFS; i < end; i++) {
+      magnitudeSum += (s[i] < 0) ? -(int32_t)s[i] : s[i];
+    }
+    uint32_t mean = magnitudeSum/(end - NUM_LP_COEFS);
+    // The table scales are 1 to 2.83, so start from the raw number of bits that scales the mean magnitude to 2 .. 3.99
+    int centerRawNumBits = bitDepth16((mean > 0x7fff) ? 0x7fff : mean, 3) - 3;
+    if (centerRawNumBits > RANS_MAX_RAW_NUM_BITS) {
+      centerRawNumBits = RANS_MAX_RAW_NUM_BITS;
+    }
+    int bestNumBits = INT_MAX;
+    for (int rawNumBits = centerRawNumBits; rawNumBits <= centerRawNumBits + 2 && rawNumBits <= RANS_MAX_RAW_NUM_BITS; rawNumBits++) {
+      int symbolCounts[RANS_NUM_SYMBOLS] = {0};
+      int numBits = 0;
+      for (int i = NUM_LP_COEFS; i < end; i++) {
+        int symbol = ransSymbol(s[i], rawNumBits);
+        symbolCounts[symbol]++;
+        numBits += (symbol == RANS_ESCAPE) ? valueToExpGolombLikeNumBits16(s[i], ransEscapeExpGolombLikeParameter(rawNumBits)) : rawNumBits;
+      }
+      for (int table = 0; table < RANS_NUM_TABLES; table++) {
+        int tableNumBits = numBits << RANS_COST_SHIFT;
+        for (int symbol = 0; symbol < RANS_NUM_SYMBOLS; symbol++) {
+          tableNumBits += symbolCounts[symbol]*ransSymbolCosts[table][symbol];
+        }
+        if (tableNumBits < bestNumBits) {
+          bestNumBits = tableNumBits;
+          channel.table = table;
+          channel.rawNumBits = rawNumBits;
+        }
+      }
+    }
+    return bestNumBits;
+  }
+
+  void pushRANSBits(uint32_t bits, int numBits) {
+    if (numBits) {
+      ransBits[numRANSChunks] = bits;
+      ransChunkNumBits[numRANSChunks] = numBits;
+      numRANSChunks++;
+    }
+  }
+
+  // Encode a residual with rANS. Residuals are encoded in reverse order, and the bits are written in reverse order of pushing them.
+  void encodeRANS(RANSChannel &channel, int16_t residual) {
+    int symbol = ransSymbol(residual, channel.rawNumBits);
+    if (symbol == RANS_ESCAPE) {
+      int numBits;
+      uint32_t bits = expGolombLikeEncode16(residual, ransEscapeExpGolombLikeParameter(channel.rawNumBits), 16, numBits);
+      pushRANSBits(bits, numBits);
+    } else {
+      pushRANSBits(residual & bitMasks[channel.rawNumBits], channel.rawNumBits);
+    }
+    const uint16_t *cumFreqs = ransCumFreqs[channel.table];
+    uint32_t freq = cumFreqs[symbol + 1] - cumFreqs[symbol];
+    // Renormalize the state to freq .. 2*freq-1. freq is below 2^RANS_PROB_BITS so its bit depth as int16_t is its bit length plus 1.
+    int numBits = RANS_PROB_BITS + 2 - bitDepth16(freq, 2);
+    if ((channel.state >> numBits) < freq) {
+      numBits--;
+    }
+    pushRANSBits(channel.state & bitMasks[numBits], numBits);
+    channel.state >>= numBits;
+    channel.state = ((channel.state/freq) << RANS_PROB_BITS) + channel.state%freq + cumFreqs[symbol];
+  }
+
+  // Encode the residuals of sample tuples NUM_LP_COEFS..end-1 with rANS. Returns the number of bits including the coder states.
+  int encodeRANS(RANSChannel &xrChannel, RANSChannel &ydrChannel, int end) {
+    numRANSChunks = 0;
+    xrChannel.state = 1 << RANS_PROB_BITS;
+    ydrChannel.state = 1 << RANS_PROB_BITS;
+    for (int i = end - 1; i >= NUM_LP_COEFS; i--) {
+      if (STEREO) {
+        encodeRANS(ydrChannel, ydr.s[i]);
+      }
+      encodeRANS(xrChannel, xr.s[i]);
+    }
+    int numBits = NUM_CHANNELS*RANS_PROB_BITS;
+    for (int k = 0; k < numRANSChunks; k++) {
+      numBits += ransChunkNumBits[k];
+    }
+    return numBits;
+  }
+
+  // Calculate independent left channel residuals and exp-Golomb-like statistics for sample tuples NUM_LP_COEFS..numSampleTuples-1.
+  // Returns the number of bits needed for the residuals and side info of the channel, and the low bits of the sample tuples.
+  int predictIndependent(const LPCoefs &c, int numSampleTuples) {
+    xr.resetExpGolombLikeStats();
+    if (c.order == NUM_LP_COEFS) {
+      for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+        xr.s[i] = x[i] - predict<Format>(x[i - 2], c.xc2, x[i - 1], c.xc1);
+        xr.addToBitDepthCounts(xr.s[i]);
+      }
+    } else {
+      highOrderResiduals(c, NUM_LP_COEFS, numSampleTuples, true, false);
+      for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+        xr.addToBitDepthCounts(xr.s[i]);
+      }
+    }
+    xr.expGolombLikeParameter = bestExpGolombLikeParameter16(xr.bitDepthCounts, xr.numBits, numSampleTuples - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    xr.numBits += independentSideInfoNumBits<Format>(c, xr.expGolombLikeParameter, coefCoding, stream.c) + (numSampleTuples - NUM_LP_COEFS)*lowTupleNumBits;
+    return xr.numBits;
+  }
+
+  // Same as predictIndependent but for the dependent right channel. Mono has none and needs no bits for it.
+  int predictDependent(const LPCoefs &c, int numSampleTuples) {
+    if (!STEREO) {
+      ydr.expGolombLikeParameter = Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+      ydr.numBits = 0;
+      return 0;
+    }
+    ydr.resetExpGolombLikeStats();
+    if (c.order == NUM_LP_COEFS) {
+      for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+        ydr.s[i] = y[i] - predict<Format>(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0);
+        ydr.addToBitDepthCounts(ydr.s[i]);
+      }
+    } else {
+      highOrderResiduals(c, NUM_LP_COEFS, numSampleTuples, false, true);
+      for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+        ydr.addToBitDepthCounts(ydr.s[i]);
+      }
+    }
+    ydr.expGolombLikeParameter = bestExpGolombLikeParameter16(ydr.bitDepthCounts, ydr.numBits, numSampleTuples - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    ydr.numBits += dependentSideInfoNumBits<Format>(c, ydr.expGolombLikeParameter, coefCoding, stream.c);
+    return ydr.numBits;
+  }
+
+  // Try to fit more sample tuples to the block, continuing from numSampleTuples using the residuals and statistics in xr and ydr.
+  // Updates numSampleTuples, numBits and the exp-Golomb-like parameters to describe the longest block that fits in numAvailableBits.
+  void extend(const LPCoefs &c, int &numSampleTuples, int &numBits, int &xrExpGolombLikeParameter, int &ydrExpGolombLikeParameter, int numAvailableBits, bool reselectParameters) {
+    if (numBits + NUM_CHANNELS*(1 + Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) > numAvailableBits) {
+      return;
+    }
+    int candidateNumBits = numBits;
+    if (c.order != NUM_LP_COEFS) {
+      highOrderResiduals(c, numSampleTuples, blockEnd, true, true);
+    }
+    for (int i = numSampleTuples; i < blockEnd; i++) {
+      if (c.order == NUM_LP_COEFS) {
+        xr.s[i] = x[i] - predict<Format>(x[i - 2], c.xc2, x[i - 1], c.xc1);
+        if (STEREO) {
+          ydr.s[i] = y[i] - predict<Format>(y[i - 2], c.yc2, y[i - 1], c.yc1, x[i], c.yd0);
+        }
+      }
+      // Could maybe (or not) do these more efficiently via totalExpGolombLikeNumBits16
+      candidateNumBits += valueToExpGolombLikeNumBits16(xr.s[i], xrExpGolombLikeParameter) + (STEREO ? valueToExpGolombLikeNumBits16(ydr.s[i], ydrExpGolombLikeParameter) : 0) + lowTupleNumBits;
+      if (reselectParameters) {
+        xr.addToBitDepthCounts(xr.s[i]);
+        if (STEREO) {
+          ydr.addToBitDepthCounts(ydr.s[i]);
+        }
+      }
+      if (candidateNumBits > numAvailableBits) {
+        if (!reselectParameters) {
+          break;
+        }
+        // See if new exp-Golomb-like parameters let the block continue
+        int xrNumBits, ydrNumBits = 0;
+        int xrCandidateParameter = bestExpGolombLikeParameter16(xr.bitDepthCounts, xrNumBits, i + 1 - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+        int ydrCandidateParameter = STEREO ? bestExpGolombLikeParameter16(ydr.bitDepthCounts, ydrNumBits, i + 1 - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) : ydrExpGolombLikeParameter;
+        candidateNumBits = xrNumBits + independentSideInfoNumBits<Format>(c, xrCandidateParameter, coefCoding, stream.c) + ydrNumBits + dependentSideInfoNumBits<Format>(c, ydrCandidateParameter, coefCoding, stream.c) + (i + 1 - NUM_LP_COEFS)*lowTupleNumBits;
+        if (candidateNumBits > numAvailableBits) {
+          break;
+        }
+        xrExpGolombLikeParameter = xrCandidateParameter;
+        ydrExpGolombLikeParameter = ydrCandidateParameter;
+      }
+      numSampleTuples = i + 1;
+      numBits = candidateNumBits;
+    }
+  }
+
+  // Search neighbouring quantized values of the coefficients pointed to by coefs for fewer bits over numSampleTuples sample tuples.
+  // predictChannel is predictIndependent or predictDependent. On return, the channel holds the residuals of the chosen coefficients.
+  // Returns the number of bits needed for the channel.
+  int searchNeighbourCoefs(LPCoefs &c, int16_t *const *coefs, const int *coefMins, const int *coefMaxs, int numCoefs, int (MLACBasicEncoder::*predictChannel)(const LPCoefs &, int), int numSampleTuples) {
+    int bestNumBits = (this->*predictChannel)(c, numSampleTuples);
+    bool lastIsBest = true;
+    for (int pass = 0; pass < NEIGHBOUR_SEARCH_MAX_NUM_PASSES; pass++) {
+      bool improved = false;
+      for (int k = 0; k < numCoefs; k++) {
+        for (int step = -1; step <= 1; step += 2) {
+          int16_t original = *coefs[k];
+          if (original + step < coefMins[k] || original + step > coefMaxs[k]) {
+            continue;
+          }
+          *coefs[k] = original + step;
+          int numBits = (this->*predictChannel)(c, numSampleTuples);
+          if (numBits < bestNumBits) {
+            bestNumBits = numBits;
+            lastIsBest = true;
+            improved = true;
+            break;
+          }
+          *coefs[k] = original;
+          lastIsBest = false;
+        }
+      }
+      if (!improved) {
+        break;
+      }
+    }
+    if (!lastIsBest) {
+      (this->*predictChannel)(c, numSampleTuples);
+    }
+    return bestNumBits;
+  }
+
+  // Fit linear predictors of orders 1 to Format::MAX_LP_ORDER to the delta values s[begin] .. s[end-1] by the autocorrelation method.
+  // coefs are as from levinsonDurbin. Returns the highest order solved.
+  static int fitHighOrder(const int16_t *s, int begin, int end, int32_t coefs[][MAX_LP_ORDER + 1]) {
+    int64_t sums[MAX_LP_ORDER + 1];
+    uint64_t absBits = 0;
+    for (int k = 0; k <= Format::MAX_LP_ORDER; k++) {
+      sums[k] = 0;
+      for (int i = begin + k; i < end; i++) {
+        sums[k] += s[i]*(int32_t)s[i - k];
+      }
+      absBits |= absBits64(sums[k]);
+    }
+    int shift = normalizationShift(absBits, 23);
+    int32_t r[MAX_LP_ORDER + 1];
+    for (int k = 0; k <= Format::MAX_LP_ORDER; k++) {
+      r[k] = (int32_t)(sums[k] >> shift);
+    }
+    return levinsonDurbin(r, Format::MAX_LP_ORDER, coefs);
+  }
+
+  // Quantize coefficients from levinsonDurbin to HIGH_ORDER_COEF_SHIFT fractional bits
+  static int16_t quantizeHighOrderCoef(int32_t coef) {
+    const int shift = LEVINSON_DURBIN_SHIFT - Format::HIGH_ORDER_COEF_SHIFT;
+    return (int16_t)saturate((coef + (1 << (shift - 1))) >> shift, HIGH_ORDER_COEF_MIN, HIGH_ORDER_COEF_MAX);
+  }
+
+  // Correlation sums of delta values for fitting linear prediction coefficients of order NUM_LP_COEFS. x is the independent channel
+  // and y is the dependent channel. x0x1 is the sum of x[j]*x[j + 1] over the fit window, and so on. The extra sums x1y2, x0y2 and y2y2
+  // are not needed for the fit.
+  struct FitSums {
+    int64_t x0x0, x1x1, x0x1, x0x2, x1x2;
+    int64_t y0y0, y1y1, y0y1, y0y2, y1y2;
+    int64_t x2x2, x2y2, y1x2, y0x2;
+    int64_t x1y2, x0y2, y2y2;
+  };
+
+  // Correlation sums of the independent and dependent channel of chMode, from those of the left (x) and right (y) channel.
+  // For CHMODE_MID_AND_SIDE, the sums are approximate and scaled by 4.
+  static FitSums chModeFitSums(int chMode, const FitSums &lr) {
+    FitSums sums;
+    if (chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+      sums.x0x0 = lr.y0y0;
+      sums.x1x1 = lr.y1y1;
+      sums.x0x1 = lr.y0y1;
+      sums.x0x2 = lr.y0y2;
+      sums.x1x2 = lr.y1y2;
+      sums.y0y0 = lr.x0x0;
+      sums.y1y1 = lr.x1x1;
+      sums.y0y1 = lr.x0x1;
+      sums.y0y2 = lr.x0x2;
+      sums.y1y2 = lr.x1x2;
+      sums.x2x2 = lr.y2y2;
+      sums.x2y2 = lr.x2y2;
+      sums.y1x2 = lr.x1y2;
+      sums.y0x2 = lr.x0y2;
+      sums.x1y2 = lr.y1x2;
+      sums.x0y2 = lr.y0x2;
+      sums.y2y2 = lr.x2x2;
+    } else if (chMode == CHMODE_MID_AND_SIDE) {
+      // mid = (left + right)/2 and side = left - right. Cross sums of left and right at the same lag are taken as equal.
+      int64_t lag0 = 2*lr.x2y2; // Both ways
+      int64_t lag1 = lr.x1y2 + lr.y1x2;
+      int64_t lag2 = lr.x0y2 + lr.y0x2;
+      sums.x0x0 = lr.x0x0 + lr.y0y0 + lag0;
+      sums.x1x1 = lr.x1x1 + lr.y1y1 + lag0;
+      sums.x0x1 = lr.x0x1 + lr.y0y1 + lag1;
+      sums.x0x2 = lr.x0x2 + lr.y0y2 + lag2;
+      sums.x1x2 = lr.x1x2 + lr.y1y2 + lag1;
+      sums.y0y0 = 4*(lr.x0x0 + lr.y0y0 - lag0);
+      sums.y1y1 = 4*(lr.x1x1 + lr.y1y1 - lag0);
+      sums.y0y1 = 4*(lr.x0x1 + lr.y0y1 - lag1);
+      sums.y0y2 = 4*(lr.x0x2 + lr.y0y2 - lag2);
+      sums.y1y2 = 4*(lr.x1x2 + lr.y1y2 - lag1);
+      sums.x2x2 = lr.x2x2 + lr.y2y2 + lag0;
+      sums.x2y2 = 2*(lr.x2x2 - lr.y2y2);
+      sums.y1x2 = 2*(lr.x1x2 - lr.y1y2 + lr.x1y2 - lr.y1x2);
+      sums.y0x2 = 2*(lr.x0x2 - lr.y0y2 + lr.x0y2 - lr.y0x2);
+      sums.x1y2 = 2*(lr.x1x2 - lr.y1y2 - lr.x1y2 + lr.y1x2);
+      sums.x0y2 = 2*(lr.x0x2 - lr.y0y2 - lr.x0y2 + lr.y0x2);
+      sums.y2y2 = 4*(lr.x2x2 + lr.y2y2 - lag0);
+    } else {
+      sums = lr;
+    }
+    return sums;
+  }
+
+  // Fit linear prediction coefficients of order NUM_LP_COEFS to the correlation sums, within the given coefficient ranges
+  static void fitCoefs(LPCoefs &c, const FitSums &sums, const int *xCoefMins, const int *xCoefMaxs, const int *yCoefMins, const int *yCoefMaxs) {
+    c.order = NUM_LP_COEFS;
+    // Cramer's rule in exact integer arithmetic so that the coefficients are the same on every platform. The sums are first
+    // normalized so that products of two (independent channel) or three (dependent channel) of them and the sums of those products fit in int64.
+    int xShift = normalizationShift(absBits64(sums.x0x0) | absBits64(sums.x1x1) | absBits64(sums.x0x1) | absBits64(sums.x0x2) | absBits64(sums.x1x2), 30);
+    int64_t x0x0n = sums.x0x0 >> xShift;
+    int64_t x1x1n = sums.x1x1 >> xShift;
+    int64_t x0x1n = sums.x0x1 >> xShift;
+    int64_t x0x2n = sums.x0x2 >> xShift;
+    int64_t x1x2n = sums.x1x2 >> xShift;
+    int64_t xDivisor = x0x0n*x1x1n - x0x1n*x0x1n;
+    if (xDivisor == 0) {
+      c.xc1 = saturate(0, xCoefMins[0], xCoefMaxs[0]);
+      c.xc2 = saturate(0, xCoefMins[1], xCoefMaxs[1]);
+    } else {
+      c.xc1 = fixedPointQuotient(x0x0n*x1x2n - x0x1n*x0x2n, xDivisor, Format::COEF_SHIFT, xCoefMins[0], xCoefMaxs[0]);
+      c.xc2 = fixedPointQuotient(x0x2n*x1x1n - x0x1n*x1x2n, xDivisor, Format::COEF_SHIFT, xCoefMins[1], xCoefMaxs[1]);
+    }
+    int yShift = normalizationShift(absBits64(sums.y0y0) | absBits64(sums.y1y1) | absBits64(sums.y0y1) | absBits64(sums.y0y2) | absBits64(sums.y1y2) | absBits64(sums.x2x2) | absBits64(sums.x2y2) | absBits64(sums.y1x2) | absBits64(sums.y0x2), 20);
+    int64_t y0y0n = sums.y0y0 >> yShift;
+    int64_t y1y1n = sums.y1y1 >> yShift;
+    int64_t y0y1n = sums.y0y1 >> yShift;
+    int64_t y0y2n = sums.y0y2 >> yShift;
+    int64_t y1y2n = sums.y1y2 >> yShift;
+    int64_t x2x2n = sums.x2x2 >> yShift;
+    int64_t x2y2n = sums.x2y2 >> yShift;
+    int64_t y1x2n = sums.y1x2 >> yShift;
+    int64_t y0x2n = sums.y0x2 >> yShift;
+    int64_t yDivisor = 2*y0y1n*y0x2n*y1x2n - y0y1n*y0y1n*x2x2n + y0y0n*y1y1n*x2x2n - y0y0n*y1x2n*y1x2n - y0x2n*y0x2n*y1y1n;
+    if (yDivisor == 0) {
+      c.yc1 = saturate(0, yCoefMins[0], yCoefMaxs[0]);
+      c.yc2 = saturate(0, yCoefMins[1], yCoefMaxs[1]);
+      c.yd0 = saturate(0, yCoefMins[2], yCoefMaxs[2]);
+    } else {
+      c.yc1 = fixedPointQuotient(y0y0n*y1y2n*x2x2n - y0y0n*y1x2n*x2y2n - y0y1n*y0y2n*x2x2n + y0y1n*y0x2n*x2y2n + y0y2n*y0x2n*y1x2n - y0x2n*y0x2n*y1y2n, yDivisor, Format::COEF_SHIFT, yCoefMins[0], yCoefMaxs[0]);
+      c.yc2 = fixedPointQuotient(y0y2n*y1y1n*x2x2n - y0y2n*y1x2n*y1x2n - y0y1n*y1y2n*x2x2n + y0y1n*y1x2n*x2y2n - y0x2n*y1y1n*x2y2n + y0x2n*y1y2n*y1x2n, yDivisor, Format::COEF_SHIFT, yCoefMins[1], yCoefMaxs[1]);
+      c.yd0 = fixedPointQuotient(y0y0n*y1y1n*x2y2n - y0y0n*y1y2n*y1x2n - y0y1n*y0y1n*x2y2n + y0y1n*y0y2n*y1x2n + y0y1n*y0x2n*y1y2n - y0y2n*y0x2n*y1y1n, yDivisor, Format::COEF_SHIFT, yCoefMins[2], yCoefMaxs[2]);
+    }
+  }
+
+  // Approximate base-2 logarithm of a positive value, in units of 2^-8
+  static int log2Q8(uint64_t value) {
+    int shift = normalizationShift(value, 8);
+    int mantissa = (int)(value >> shift);
+    return (mantissa < 128) ? 256*(shift + 7) - 2*(128 - mantissa) : 256*(shift + 7) + 2*(mantissa - 128);
+  }
+
+  // Estimated number of bits per residual of a channel of numResiduals residuals of energy energy*2^shift*2^(2*COEF_SHIFT), in units
+  // of 2^-8. A residual of the root mean square magnitude is taken to need a sign bit and half of the base-2 logarithm of the mean
+  // square, and no residual needs fewer bits than the shortest exp-Golomb-like code.
+  static int residualNumBitsQ8(int64_t energy, int shift, int numResiduals) {
+    int logMeanSquare = log2Q8((energy > 0) ? energy : 1) + 256*(shift - 2*Format::COEF_SHIFT) - log2Q8(numResiduals);
+    int numBits = logMeanSquare/2 + 256;
+    return (numBits > 256*Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) ? numBits + 256 : 256*(Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 1);
+  }
+
+  // Estimated number of bits per residual of the independent and dependent channel predicted by the coefficients c of order
+  // NUM_LP_COEFS, from the residual energies calculated from the correlation sums of numResiduals residuals in exact integer
+  // arithmetic, in units of 2^-8. scaleShift is the base-2 logarithm of the scale of the sums.
+  static int residualNumBitsQ8(const LPCoefs &c, const FitSums &sums, int numResiduals, int scaleShift) {
+    const int64_t one = 1 << Format::COEF_SHIFT;
+    int xShift = normalizationShift(absBits64(sums.x0x0) | absBits64(sums.x1x1) | absBits64(sums.x2x2) | absBits64(sums.x0x1) | absBits64(sums.x0x2) | absBits64(sums.x1x2), 26);
+    int64_t xEnergy = one*one*(sums.x2x2 >> xShift) - 2*one*(c.xc1*(sums.x1x2 >> xShift) + c.xc2*(sums.x0x2 >> xShift))
+      + c.xc1*c.xc1*(sums.x1x1 >> xShift) + 2*c.xc1*c.xc2*(sums.x0x1 >> xShift) + c.xc2*c.xc2*(sums.x0x0 >> xShift);
+    int numBits = residualNumBitsQ8(xEnergy, xShift - scaleShift, numResiduals);
+    if (STEREO) {
+      int yShift = normalizationShift(absBits64(sums.y0y0) | absBits64(sums.y1y1) | absBits64(sums.y2y2) | absBits64(sums.y0y1) | absBits64(sums.y0y2) | absBits64(sums.y1y2) | absBits64(sums.x2x2) | absBits64(sums.x2y2) | absBits64(sums.y1x2) | absBits64(sums.y0x2), 26);
+      int64_t yEnergy = one*one*(sums.y2y2 >> yShift) - 2*one*(c.yc1*(sums.y1y2 >> yShift) + c.yc2*(sums.y0y2 >> yShift) + c.yd0*(sums.x2y2 >> yShift))
+        + c.yc1*c.yc1*(sums.y1y1 >> yShift) + c.yc2*c.yc2*(sums.y0y0 >> yShift) + c.yd0*c.yd0*(sums.x2x2 >> yShift)
+        + 2*(c.yc1*c.yc2*(sums.y0y1 >> yShift) + c.yc1*c.yd0*(sums.y1x2 >> yShift) + c.yc2*c.yd0*(sums.y0x2 >> yShift));
+      numBits += residualNumBitsQ8(yEnergy, yShift - scaleShift, numResiduals);
+    }
+    return numBits;
+  }
+
+  // Choose the channel mode of the first fit of a block of numResiduals residuals and fit its coefficients. The channel mode is the
+  // one that needs the fewest bits per residual as estimated from the correlation sums, which takes a small fraction of the time of
+  // predicting with each channel mode. CHMODE_INDEPENDENT_AND_DEPENDENT wins ties, and is the only channel mode of mono.
+  static int chooseChMode(LPCoefs &c, const FitSums &lr, int numResiduals, const int *xCoefMins, const int *xCoefMaxs, const int *yCoefMins, const int *yCoefMaxs) {
+    static const int chModes[3] = {CHMODE_DEPENDENT_AND_INDEPENDENT, CHMODE_MID_AND_SIDE, CHMODE_INDEPENDENT_AND_DEPENDENT};
+    int bestChMode = CHMODE_INDEPENDENT_AND_DEPENDENT;
+    int bestNumBits = INT_MAX;
+    for (int k = STEREO ? 0 : 2; k < 3; k++) {
+      LPCoefs trial;
+      FitSums sums = chModeFitSums(chModes[k], lr);
+      fitCoefs(trial, sums, xCoefMins, xCoefMaxs, yCoefMins, yCoefMaxs);
+      int numBits = residualNumBitsQ8(trial, sums, numResiduals, (chModes[k] == CHMODE_MID_AND_SIDE) ? 2 : 0);
+      if (numBits <= bestNumBits) {
+        bestChMode = chModes[k];
+        bestNumBits = numBits;
+        c = trial;
+      }
+    }
+    return bestChMode;
+  }
+
+  // Point x and y to the independent and dependent channel of chMode. left and right are the delta values of the window
+  // of end sample tuples of the current block.
+  void setChMode(int chMode, int16_t *left, int16_t *right, int end) {
+    if (chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+      x = right;
+      y = left;
+    } else if (chMode == CHMODE_MID_AND_SIDE) {
+      for (int i = 0; i < end; i++) {
+        midBuf[i] = left[i];
+        sideBuf[i] = right[i];
+        midSide(midBuf[i], sideBuf[i]);
+      }
+      x = midBuf;
+      y = sideBuf;
+    } else {
+      x = left;
+      y = right;
+    }
+  }
+
+  // Number of bits of the warmup of x and y, 0 in a continuation block
+  int warmupNumBits() {
+    if (blockStart) {
+      return 0;
+    }
+    int numBits = valueToExpGolombLikeNumBits16(x[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(x[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    if (STEREO) {
+      numBits += valueToExpGolombLikeNumBits16(y[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(y[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    }
+    return numBits;
+  }
+
+  // Narrow the range of a coefficient to what can be coded relative to the previous value with the current coefficient coding
+  void limitCoefRange(int &coefMin, int &coefMax, int previous) {
+    if (coefCoding == COEF_CODING_DELTA) {
+      if (coefMin < previous + COEF_DELTA_MIN) {
+        coefMin = previous + COEF_DELTA_MIN;
+      }
+      if (coefMax > previous + COEF_DELTA_MAX) {
+        coefMax = previous + COEF_DELTA_MAX;
+      }
+    }
+  }
+
+public:
+  // Encoder effort level, EFFORT_FASTEST to EFFORT_MAX. Can be changed between calls to encode.
+  int effort;
+
+  // Stream mode: number of blocks from one independent block to the next in encodeNext. The blocks in between are continuation blocks
+  // that have no warmup and that code the coefficients relative to the previous block. They cannot be decoded if the blocks before them
+  // since the last independent block were lost. 1 = all blocks are independent. Can be changed between calls to encodeNext.
+  int independentBlockInterval;
+
+  // Lookahead mode: number of blocks over which encodeNext and encodeNextVariableLength place the end of the current block. 1 = the block
+  // is made as long as fits. Above 1, shorter lengths of the block are also tried, each followed by lookaheadNumBlocks - 1 blocks made
+  // as long as fit, and the length is kept that gives the most sample tuples per byte over the lookaheadNumBlocks packets. Ending a block
+  // before a transient lets the next block fit its coefficients to the transient. This pays off mostly with variable-length packets,
+  // where a shorter block also takes fewer bytes. With fixed-size packets the unused bits of a shortened block are lost, and the longest
+  // block is seldom beaten. The input must then contain at least lookaheadNumBlocks*blockMaxNumSampleTuples stereo samples, and
+  // encoding takes about 1 + lookaheadNumBlocks*(1 + LOOKAHEAD_NUM_CANDIDATES) times as long. Can be changed between calls.
+  int lookaheadNumBlocks;
+
+  // Fixed-frame mode for isochronous transports: number of sample tuples of every block, more than BLOCK_MIN_NUM_SAMPLETUPLES and at most
+  // blockMaxNumSampleTuples. 0 = off. The frame is coded losslessly if it fits, otherwise near-lossless at the highest true bit depth
+  // that fits, or as CHMODE_MSB. minNumSampleTuples and lookaheadNumBlocks are then ignored. The bits after numBitsWritten are free for
+  // other uses. Can be changed between calls.
+  int frameNumSampleTuples;
+
+  // Add triangular dither of 2 LSB peak to peak to float input of the converting entry points before rounding to 16 bits. Can be
+  // changed between calls.
+  bool dither;
+
+  // Maximum number of sample tuples of a block, more than BLOCK_MIN_NUM_SAMPLETUPLES and at most BLOCK_MAX_NUM_SAMPLETUPLES. The input
+  // only needs to contain this many sample tuples, so a lower value shortens the lookahead of the encoder. The format does not change,
+  // and any decoder of Format decodes the blocks. Can be changed between calls.
+  int blockMaxNumSampleTuples;
+
+  MLACBasicEncoder(): deltaOffset(0), numKeptDeltas(0), deltaLowShift(Format::LOW_NUM_BITS), lowTupleNumBits(0), numBlocksSinceIndependent(0), numKeptInputSampleTuples(0), ditherState(0x12345678), effort(EFFORT_DEFAULT), independentBlockInterval(1), lookaheadNumBlocks(1), frameNumSampleTuples(0), dither(false), blockMaxNumSampleTuples(BLOCK_MAX_NUM_SAMPLETUPLES) {
+    for (int i = 0; i < NUM_REFINEMENT_LEVELS; i++) {
+      refinementDurations[i] = std::chrono::steady_clock::duration::zero();
+    }
+  }
+
+  // Forget the previous input, so that the next call to encodeNext starts a new stream with an independent block
+  void restartStream() {
+    deltaOffset = 0;
+    numKeptDeltas = 0;
+    numKeptInputSampleTuples = 0;
+    stream.valid = false;
+  }
+
+  // MLAC encode the next block of a continuous stream. Arguments and return values are the same as of encode, and so is the output.
+  // The input must continue numSampleTuplesWritten sample tuples after the input of the previous call to encodeNext, unless
+  // restartStream or encode was called in between. Delta values of the overlapping sample tuples are reused rather than recalculated.
+  int encodeNext(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    int maxNumSampleTuples = (lookaheadNumBlocks > 1 && !frameNumSampleTuples) ? lookaheadBlockLength(input, minNumSampleTuples, false) : blockMaxNumSampleTuples;
+    return encodeNextBlock(input, output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, maxNumSampleTuples);
+  }
+
+  // MLAC encode the next block of a continuous stream as a variable-length packet for file storage, without the padding of the unused
+  // bits of the block. Arguments and return values are the same as of encodeNext, except that output must have room for
+  // Format::VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES bytes, and that numBytesWritten returns the number of bytes of the packet instead of
+  // numBitsWritten. The next packet can be written at output + numBytesWritten.
+  int encodeNextVariableLength(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBytesWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    int numBitsWritten;
+    int maxNumSampleTuples = (lookaheadNumBlocks > 1 && !frameNumSampleTuples) ? lookaheadBlockLength(input, minNumSampleTuples, true) : blockMaxNumSampleTuples;
+    int trueBitDepth = encodeNextBlock(input, &output[Format::PACKET_LENGTH_NUM_BYTES], timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, maxNumSampleTuples);
+    numBytesWritten = writePacketLength(output, numBitsWritten);
+    return trueBitDepth;
+  }
+
+  // MLAC encode the next block of a continuous stream as a variable-length packet, converting the input like encodeNext does.
+  // Arguments and return values are the same as of encodeNextVariableLength. lookaheadNumBlocks is not used.
+  template <class Sample>
+  int encodeNextVariableLength(const MLACInput<Sample> &input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBytesWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    int numBitsWritten;
+    int trueBitDepth = encodeNext(input, &output[Format::PACKET_LENGTH_NUM_BYTES], timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+    numBytesWritten = writePacketLength(output, numBitsWritten);
+    return trueBitDepth;
+  }
+
+  // MLAC encode
+  // Arguments:
+  //   input = pointer to begining of interleaved stereo 16-bit audio that must contain at least blockMaxNumSampleTuples stereo samples.
+  //           Of MLACMonoFormat, the audio is mono.
+  //   output = pointer to beginning of a block of encoded audio to be written. Will write BLOCK_NUM_BYTES bytes.
+  //   timeStamp = time stamp to be written, not yet implemented. NOTE: TIME STAMPS ARE NOT YET FUNCTIONAL AND ARE INSTEAD USED FOR STORING NUMBER OF SAMPLE TUPLES
+  // Returns:
+  //   numSampleTuplesWritten = number of stereo sample pairs encoded
+  //   numBitsWritten = number of bits written (if less than BLOCK_NUM_BYTES*8, then there is room for auxiliary data after encoded audio)
+  //   minNumSampleTuples = minimum number of stero samples that must fit to packet, range: BLOCK_MIN_NUM_SAMPLETUPLES inclusive to blockMaxNumSampleTuples inclusive.
+  //                        this setting can force lossy compression: near-lossless linear prediction at the highest true bit depth that fits,
+  //                        or if that is not better, the most significant bits as PCM. Lossy compression does not go below 8 bits, so a packet may have fewer
+  //                        stereo samples than asked if blockMaxNumSampleTuples is more than fit in a packet at 8 bits.
+  //   Return value = Effective resolution of audio in bits, 16 (24 of MLAC24BitFormat) for lossless compression, less for lossy compression
+  int encode(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    restartStream();
+    return encodeBlock(input, output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, false);
+  }
+
+  // MLAC encode, converting blockMaxNumSampleTuples stereo samples of the input to 16 bits in the same pass that calculates their
+  // delta values. Arguments and return values are the same as of encode, and so is the output for the converted input.
+  template <class Sample>
+  int encode(const MLACInput<Sample> &input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    restartStream();
+    const int16_t *converted = convertInput(input);
+    int trueBitDepth = encodeBlock(converted, output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, false);
+    numKeptDeltas = 0;
+    return trueBitDepth;
+  }
+
+  // MLAC encode the next block of a continuous stream, converting the input like encode does. Arguments and return values are the
+  // same as of encodeNext, and so is the output for the converted input. The input must continue numSampleTuplesWritten sample tuples
+  // after the input of the previous call, and the converted sample tuples that overlap are kept rather than converted again.
+  // lookaheadNumBlocks is not used.
+  template <class Sample>
+  int encodeNext(const MLACInput<Sample> &input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    const int16_t *converted = convertInput(input);
+    return encodeNextBlock(converted, output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, blockMaxNumSampleTuples);
+  }
+
+  // MLAC encode with a deadline (anytime encoding). Arguments and return values are the same as of encode, and also:
+  //   deadline = time by which to return
+  //   refinementLevel = highest refinement level reached, REFINEMENT_MSB or REFINEMENT_LPC + effort
+  // A CHMODE_MSB block is written first, without analysis, at the highest true bit depth that fits minNumSampleTuples. It is then
+  // refined by the blocks of encode at efforts EFFORT_FASTEST to effort, as long as the estimated time of the next level ends before
+  // the deadline, and the block with the highest true bit depth and then the most sample tuples is kept. The time of a level is
+  // estimated by the decaying maximum of its earlier durations, so a level that takes longer than before can still end late. A level
+  // that has not run yet is estimated to take no time, so warm up the encoder on similar audio before the deadline matters. The output
+  // is independent, as of encode. In fixed-frame mode, a REFINEMENT_MSB block is shorter than the frame if the frame does not fit at
+  // 8 bits.
+  int encodeAnytime(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, std::chrono::steady_clock::time_point deadline, int &refinementLevel, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    restartStream();
+    int numSampleTuples = frameNumSampleTuples ? frameNumSampleTuples : minNumSampleTuples;
+    int trueBitDepth = 16;
+    for (; trueBitDepth > 8; trueBitDepth--) {
+      if (Format::chModeMSBNumSampleTuples(trueBitDepth) >= numSampleTuples) break;
+    }
+    if (!frameNumSampleTuples || numSampleTuples > Format::chModeMSBNumSampleTuples(trueBitDepth)) {
+      numSampleTuples = Format::chModeMSBNumSampleTuples(trueBitDepth);
+    }
+    if (numSampleTuples > blockMaxNumSampleTuples) {
+      numSampleTuples = blockMaxNumSampleTuples;
+    }
+    trueBitDepth = encodeMSB(input, output, timeStamp, trueBitDepth, numSampleTuples, numSampleTuplesWritten, numBitsWritten);
+    MLACStreamState bestStream = stream;
+    refinementLevel = REFINEMENT_MSB;
+    updateRefinementDuration(REFINEMENT_MSB, std::chrono::steady_clock::now() - start);
+    int requestedEffort = effort;
+    for (effort = EFFORT_FASTEST; effort <= requestedEffort; effort++) {
+      start = std::chrono::steady_clock::now();
+      if (start + refinementDurations[REFINEMENT_LPC + effort] > deadline) {
+        // Let the estimate decay, so that a single late run does not rule out the level for good
+        updateRefinementDuration(REFINEMENT_LPC + effort, std::chrono::steady_clock::duration::zero());
+        break;
+      }
+      uint8_t trialOutput[BLOCK_NUM_BYTES];
+      int trialNumSampleTuplesWritten;
+      int trialNumBitsWritten;
+      restartStream();
+      int trialTrueBitDepth = encodeBlock(input, trialOutput, timeStamp, trialNumSampleTuplesWritten, trialNumBitsWritten, minNumSampleTuples, false);
+      updateRefinementDuration(REFINEMENT_LPC + effort, std::chrono::steady_clock::now() - start);
+      refinementLevel = REFINEMENT_LPC + effort;
+      if (trialTrueBitDepth > trueBitDepth || (trialTrueBitDepth == trueBitDepth && trialNumSampleTuplesWritten > numSampleTuplesWritten)) {
+        for (int i = 0; i < BLOCK_NUM_BYTES; i++) {
+          output[i] = trialOutput[i];
+        }
+        trueBitDepth = trialTrueBitDepth;
+        numSampleTuplesWritten = trialNumSampleTuplesWritten;
+        numBitsWritten = trialNumBitsWritten;
+        bestStream = stream;
+      }
+    }
+    effort = requestedEffort;
+    stream = bestStream;
+    numBlocksSinceIndependent = 0;
+    return trueBitDepth;
+  }
+
+private:
+  std::chrono::steady_clock::duration refinementDurations[NUM_REFINEMENT_LEVELS]; // Duration estimates of the refinement levels of encodeAnytime
+
+  // Write the length prefix of a variable-length packet of a block of numBitsWritten bits. Returns the number of bytes of the packet.
+  static int writePacketLength(uint8_t *output, int numBitsWritten) {
+    int numBytes = (numBitsWritten + 7) >> 3;
+    for (int i = 0; i < Format::PACKET_LENGTH_NUM_BYTES; i++) {
+      output[i] = (numBytes - 1) >> (8*(Format::PACKET_LENGTH_NUM_BYTES - 1 - i));
+    }
+    return Format::PACKET_LENGTH_NUM_BYTES + numBytes;
+  }
+
+  void updateRefinementDuration(int refinementLevel, std::chrono::steady_clock::duration duration) {
+    std::chrono::steady_clock::duration &estimate = refinementDurations[refinementLevel];
+    estimate -= estimate/REFINEMENT_DURATION_DECAY;
+    if (duration > estimate) {
+      estimate = duration;
+    }
+  }
+
+  // Encode the next block of a continuous stream, of at most maxNumSampleTuples sample tuples
+  int encodeNextBlock(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples, int maxNumSampleTuples) {
+    bool continuation = stream.valid && numBlocksSinceIndependent < independentBlockInterval - 1;
+    int trueBitDepth = encodeBlock(input, output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, continuation, maxNumSampleTuples);
+    // Slide the delta values that were not encoded to the beginning of the next block, and so also the converted input
+    bool converted = input == &inputBuf[deltaOffset*NUM_CHANNELS];
+    int numRemaining = blockMaxNumSampleTuples - numSampleTuplesWritten;
+    if (deltaOffset + numSampleTuplesWritten + BLOCK_MAX_NUM_SAMPLETUPLES > 2*BLOCK_MAX_NUM_SAMPLETUPLES) {
+      for (int i = 0; i < numRemaining; i++) {
+        xBuf[NUM_LP_COEFS + i] = xBuf[NUM_LP_COEFS + deltaOffset + numSampleTuplesWritten + i];
+        if (STEREO) {
+          yBuf[NUM_LP_COEFS + i] = yBuf[NUM_LP_COEFS + deltaOffset + numSampleTuplesWritten + i];
+        }
+      }
+      for (int i = 0; converted && i < numRemaining*NUM_CHANNELS; i++) {
+        inputBuf[i] = inputBuf[(deltaOffset + numSampleTuplesWritten)*NUM_CHANNELS + i];
+        if (Format::LOW_NUM_BITS) {
+          lowBuf[i] = lowBuf[(deltaOffset + numSampleTuplesWritten)*NUM_CHANNELS + i];
+        }
+      }
+      deltaOffset = 0;
+    } else {
+      deltaOffset += numSampleTuplesWritten;
+    }
+    numKeptDeltas = numRemaining;
+    numKeptInputSampleTuples = converted ? numRemaining : 0;
+    return trueBitDepth;
+  }
+
+  // Choose the maximum length of the next block of lookahead mode by trial encodes of the lookahead window with copies of the encoder.
+  // The candidate lengths are the greedy one and LOOKAHEAD_NUM_CANDIDATES evenly spaced shorter ones. Only a lossless greedy block
+  // is shortened, and not below minNumSampleTuples.
+  int lookaheadBlockLength(const int16_t *input, int minNumSampleTuples, bool variableLength) {
+    uint8_t trialOutput[BLOCK_NUM_BYTES];
+    int bestMaxNumSampleTuples = blockMaxNumSampleTuples;
+    int bestTotalNumSampleTuples = 0;
+    int bestTotalNumBytes = 1;
+    int greedyNumSampleTuples = 0;
+    int minMaxNumSampleTuples = (minNumSampleTuples > BLOCK_MIN_NUM_SAMPLETUPLES) ? minNumSampleTuples : BLOCK_MIN_NUM_SAMPLETUPLES + 1;
+    for (int k = 0; k <= LOOKAHEAD_NUM_CANDIDATES; k++) {
+      int maxNumSampleTuples = blockMaxNumSampleTuples;
+      if (k > 0) {
+        maxNumSampleTuples = greedyNumSampleTuples - k*(greedyNumSampleTuples - minMaxNumSampleTuples)/(LOOKAHEAD_NUM_CANDIDATES + 1);
+      }
+      MLACBasicEncoder trial(*this);
+      int totalNumSampleTuples = 0;
+      int totalNumBytes = 0;
+      for (int block = 0; block < lookaheadNumBlocks; block++) {
+        int numSampleTuplesWritten, numBitsWritten;
+        int trueBitDepth = trial.encodeNextBlock(&input[totalNumSampleTuples*NUM_CHANNELS], trialOutput, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples, (block == 0) ? maxNumSampleTuples : blockMaxNumSampleTuples);
+        if (k == 0 && block == 0) {
+          if (trueBitDepth != 16 + Format::LOW_NUM_BITS || numSampleTuplesWritten <= minMaxNumSampleTuples) {
+            return blockMaxNumSampleTuples;
+          }
+          greedyNumSampleTuples = numSampleTuplesWritten;
+        }
+        totalNumSampleTuples += numSampleTuplesWritten;
+        totalNumBytes += variableLength ? Format::PACKET_LENGTH_NUM_BYTES + ((numBitsWritten + 7) >> 3) : BLOCK_NUM_BYTES;
+      }
+      if (totalNumSampleTuples*(int64_t)bestTotalNumBytes > bestTotalNumSampleTuples*(int64_t)totalNumBytes) {
+        bestMaxNumSampleTuples = maxNumSampleTuples;
+        bestTotalNumSampleTuples = totalNumSampleTuples;
+        bestTotalNumBytes = totalNumBytes;
+      }
+    }
+    return bestMaxNumSampleTuples;
+  }
+
+  // Convert a sample to 16 + Format::LOW_NUM_BITS bits
+  static int32_t convertSample(int16_t sample, int shift, uint32_t *ditherState) {
+    return sample*(1 << Format::LOW_NUM_BITS);
+  }
+
+  static int32_t convertSample(int32_t sample, int shift, uint32_t *ditherState) {
+    const int32_t max = (0x8000 << Format::LOW_NUM_BITS) - 1;
+    int32_t value = (Format::LOW_NUM_BITS && shift < Format::LOW_NUM_BITS) ? sample*(1 << (Format::LOW_NUM_BITS - shift)) : sample >> (shift - Format::LOW_NUM_BITS);
+    return (value > max) ? max : (value < -max - 1) ? -max - 1 : value;
+  }
+
+  // Dither float samples if ditherState is not null
+  static int32_t convertSample(float sample, int shift, uint32_t *ditherState) {
+    const int32_t max = (0x8000 << Format::LOW_NUM_BITS) - 1;
+    float value = sample*(32768.0f*(1 << Format::LOW_NUM_BITS));
+    if (ditherState) {
+      // Difference of two uniform random values from 0 to 1 LSB, from the halves of a xorshift state
+      uint32_t state = *ditherState;
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      *ditherState = state;
+      value += ((int32_t)(state >> 16) - (int32_t)(state & 0xffff))*(1.0f/65536.0f);
+    }
+    value = floorf(value + 0.5f);
+    return (value > (float)max) ? max : (value < (float)(-max - 1)) ? -max - 1 : (int32_t)value;
+  }
+
+  // Split a converted sample to its 16 most significant bits and the low bits of MLAC24BitFormat
+  static void splitSample(int32_t value, int16_t &sample, uint8_t &low) {
+    sample = value >> Format::LOW_NUM_BITS;
+    if (Format::LOW_NUM_BITS) {
+      low = value & bitMasks[Format::LOW_NUM_BITS];
+    }
+  }
+
+  // Convert the input of a converting entry point to interleaved 16-bit sample tuples in inputBuf, at the offset of the delta values
+  // of the next block, and calculate their delta values while the block is in the cache. The sample tuples kept from the previous call
+  // to encodeNext are not converted again. Returns the converted input. Mono input is only read from input.left. The low bits of
+  // MLAC24BitFormat go to lowBuf.
+  template <class Sample>
+  const int16_t *convertInput(const MLACInput<Sample> &input) {
+    int16_t *converted = &inputBuf[deltaOffset*NUM_CHANNELS];
+    uint8_t *low = &lowBuf[Format::LOW_NUM_BITS ? deltaOffset*NUM_CHANNELS : 0];
+    int16_t *xDeltas = &xBuf[NUM_LP_COEFS + deltaOffset];
+    int16_t *yDeltas = &yBuf[NUM_LP_COEFS + deltaOffset];
+    int begin = numKeptInputSampleTuples;
+    if (dither) {
+      uint32_t state = ditherState;
+      for (int i = begin; i < blockMaxNumSampleTuples; i++) {
+        splitSample(convertSample(input.left[i*input.stride], input.shift, &state), converted[i*NUM_CHANNELS], low[i*NUM_CHANNELS]);
+        if (STEREO) {
+          splitSample(convertSample(input.right[i*input.stride], input.shift, &state), converted[i*2 + 1], low[i*2 + 1]);
+        }
+      }
+      ditherState = state;
+    } else {
+      for (int i = begin; i < blockMaxNumSampleTuples; i++) {
+        splitSample(convertSample(input.left[i*input.stride], input.shift, 0), converted[i*NUM_CHANNELS], low[i*NUM_CHANNELS]);
+        if (STEREO) {
+          splitSample(convertSample(input.right[i*input.stride], input.shift, 0), converted[i*2 + 1], low[i*2 + 1]);
+        }
+      }
+    }
+    // Kept delta values of shifted samples of MLAC24BitFormat are calculated again
+    for (int i = (begin > 1 && deltaLowShift == Format::LOW_NUM_BITS) ? begin : 1; i < blockMaxNumSampleTuples; i++) {
+      xDeltas[i] = converted[i*NUM_CHANNELS] - converted[(i - 1)*NUM_CHANNELS];
+      if (STEREO) {
+        yDeltas[i] = converted[i*2 + 1] - converted[(i - 1)*2 + 1];
+      }
+    }
+    numKeptDeltas = blockMaxNumSampleTuples;
+    deltaLowShift = Format::LOW_NUM_BITS;
+    return converted;
+  }
+
+  // Write a CHMODE_MSB block of numSampleTuples sample tuples at the given true bit depth. Returns the number of bits written.
+  static int writeMSB(const int16_t *input, uint8_t *output, uint8_t timeStamp, int trueBitDepth, int numSampleTuples) {
+    BitStreamWriter writer(output);
+    timeStamp = numSampleTuples; // Fake it! ***
+    writer.write(timeStamp, 8);
+    writer.write(CHMODE_MSB, Format::CHMODE_NUM_BITS);
+    // Write true bit depth
+    writer.write(trueBitDepth - TRUE_BITDEPTH_BIAS, 4);
+    // Write raw PCM audio
+    if (trueBitDepth == 16) {
+      for (int i = 0; i < numSampleTuples*NUM_CHANNELS; i++) {
+        writer.write(input[i], trueBitDepth);
+      }
+    } else {
+      for (int i = 0; i < numSampleTuples*NUM_CHANNELS; i++) {
+        writer.write(input[i] >> (16 - trueBitDepth), trueBitDepth);
+      }
+    }
+    return writer.numBitsWritten;
+  }
+
+  // Encode a CHMODE_MSB block of numSampleTuples sample tuples at the given true bit depth
+  int encodeMSB(const int16_t *input, uint8_t *output, uint8_t timeStamp, int trueBitDepth, int numSampleTuples, int &numSampleTuplesWritten, int &numBitsWritten) {
+    numBitsWritten = writeMSB(input, output, timeStamp, trueBitDepth, numSampleTuples);
+    // Update what the decoder knows
+    int16_t lastSampleTuples[(NUM_LP_COEFS + 1)*NUM_CHANNELS];
+    for (int i = 0; i < (NUM_LP_COEFS + 1)*NUM_CHANNELS; i++) {
+      int16_t sample = input[(numSampleTuples - NUM_LP_COEFS - 1)*NUM_CHANNELS + i];
+      lastSampleTuples[i] = (trueBitDepth == 16) ? sample : (int16_t)((sample & ~bitMasks[16 - trueBitDepth]) | (0x8000 >> trueBitDepth));
+    }
+    stream.update(lastSampleTuples, NUM_CHANNELS);
+    stream.lowShift = Format::LOW_NUM_BITS;
+    stream.c.reset<Format>();
+    stream.valid = true;
+    numBlocksSinceIndependent = 0;
+    numSampleTuplesWritten = numSampleTuples;
+    return trueBitDepth;
+  }
+
+  // Write a constant run block of numSampleTuples sample tuples equal to the first sample tuple of the input. Returns the number of
+  // bits written.
+  static int writeConstantRun(const int16_t *input, uint8_t *output, uint8_t timeStamp, int numSampleTuples) {
+    BitStreamWriter writer(output);
+    timeStamp = numSampleTuples; // Fake it! ***
+    writer.write(timeStamp, 8);
+    writer.write(CHMODE_MSB, Format::CHMODE_NUM_BITS);
+    writer.write(CONSTANT_RUN_CODE, 4);
+    for (int k = 0; k < NUM_CHANNELS; k++) {
+      writer.write((uint16_t)input[k], 16);
+    }
+    return writer.numBitsWritten;
+  }
+
+  // Number of sample tuples from the first one of the input that are equal to it, at most maxNumSampleTuples
+  static int numConstantSampleTuples(const int16_t *input, int maxNumSampleTuples) {
+    int numSampleTuples = 1;
+    while (numSampleTuples < maxNumSampleTuples && input[numSampleTuples*NUM_CHANNELS] == input[0] && (!STEREO || input[numSampleTuples*2 + 1] == input[1])) {
+      numSampleTuples++;
+    }
+    return numSampleTuples;
+  }
+
+  // Encode a constant run block of numSampleTuples sample tuples equal to the first sample tuple of the input
+  int encodeConstantRun(const int16_t *input, uint8_t *output, uint8_t timeStamp, int numSampleTuples, int &numSampleTuplesWritten, int &numBitsWritten) {
+    numBitsWritten = writeConstantRun(input, output, timeStamp, numSampleTuples);
+    // Update what the decoder knows
+    stream.update(&input[(numSampleTuples - NUM_LP_COEFS - 1)*NUM_CHANNELS], NUM_CHANNELS);
+    stream.lowShift = Format::LOW_NUM_BITS;
+    stream.c.reset<Format>();
+    stream.valid = true;
+    numBlocksSinceIndependent = 0;
+    numSampleTuplesWritten = numSampleTuples;
+    return 16 + Format::LOW_NUM_BITS;
+  }
+
+  // Quantize the residual of a sample of a near-lossless block, given the previous reconstructed sample and the prediction of the delta value.
+  // The reconstructed sample is the one nearest to the input sample that is representable with the shift and that does not wrap around.
+  // Returns the residual divided by 2^shift, sign-extended from 16 - shift bits, and updates previous and delta to the reconstructed sample.
+  static int16_t quantizeResidual(int16_t sample, int16_t prediction, int shift, int16_t &previous, int16_t &delta) {
+    int32_t predicted = previous + prediction;
+    int32_t q = (sample - predicted + (1 << (shift - 1))) >> shift;
+    int32_t reconstructed = predicted + q*(1 << shift);
+    if (reconstructed > 0x7fff) {
+      q--;
+      reconstructed -= 1 << shift;
+    } else if (reconstructed < -0x8000) {
+      q++;
+      reconstructed += 1 << shift;
+    }
+    delta = reconstructed - previous;
+    previous = reconstructed;
+    return (int16_t)((uint16_t)q << shift) >> shift;
+  }
+
+  // Exp-Golomb-like parameter that gives the fewest bits to quantized residuals of the given bit depth, of which bitDepthCounts[k] have
+  // bit depth k by bitDepth16(residual, 1). The parameter is kept high enough for the longest code to be readable by
+  // BitStreamReader::readExpGolombLike.
+  static int nearLosslessParameter(const int *bitDepthCounts, int bitDepth, int &numBits) {
+    int minParameter = 2*bitDepth - 1 - EXPGOLOMBLIKE_MAX_NUM_BITS;
+    if (minParameter < 1) {
+      minParameter = 1;
+    }
+    int bestParameter = bitDepth;
+    numBits = INT_MAX;
+    for (int parameter = minParameter; parameter <= bitDepth; parameter++) {
+      int parameterNumBits = 0;
+      for (int k = 1; k <= bitDepth; k++) {
+        parameterNumBits += bitDepthCounts[k]*bitDepthToExpGolombLikeNumBits16(k, parameter, bitDepth);
+      }
+      if (parameterNumBits < numBits) {
+        bestParameter = parameter;
+        numBits = parameterNumBits;
+      }
+    }
+    return bestParameter;
+  }
+
+  // Quantize the residuals of sample tuples NUM_LP_COEFS .. numSampleTuples - 1 of a near-lossless block with the given shift, in a
+  // closed loop that predicts from the reconstructed samples like the decoder does. The warmup is the first sample tuple and the delta
+  // value of the second, coded losslessly. If writer is given, the residuals are written with the given exp-Golomb-like parameters,
+  // and otherwise their bit depths are counted to xrBitDepthCounts and ydrBitDepthCounts. lastSampleTuples returns the last
+  // reconstructed sample tuples, with a silent right channel in mono.
+  static void nearLosslessResiduals(const int16_t *input, int numSampleTuples, const LPCoefs &c, int shift, BitStreamWriter *writer, int xrExpGolombLikeParameter, int ydrExpGolombLikeParameter, int *xrBitDepthCounts, int *ydrBitDepthCounts, int16_t *lastSampleTuples) {
+    int trueBitDepth = 16 - shift;
+    int16_t xPrevious = input[NUM_CHANNELS];
+    int16_t yPrevious = STEREO ? input[3] : 0;
+    // Delta values of the reconstructed samples of the two previous sample tuples, of the left (independent) and right (dependent)
+    // channel. The first is the warmup sample itself.
+    int16_t xm2 = input[0];
+    int16_t xm1 = input[NUM_CHANNELS] - input[0];
+    int16_t ym2 = STEREO ? input[1] : 0;
+    int16_t ym1 = STEREO ? input[3] - input[1] : 0;
+    for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+      int16_t x, y = 0;
+      int16_t xr = quantizeResidual(input[i*NUM_CHANNELS], predict<Format>(xm2, c.xc2, xm1, c.xc1), shift, xPrevious, x);
+      int16_t ydr = STEREO ? quantizeResidual(input[i*2 + 1], predict<Format>(ym2, c.yc2, ym1, c.yc1, x, c.yd0), shift, yPrevious, y) : 0;
+      if (writer) {
+        writer->writeExpGolombLike(xr, xrExpGolombLikeParameter, trueBitDepth);
+        if (STEREO) {
+          writer->writeExpGolombLike(ydr, ydrExpGolombLikeParameter, trueBitDepth);
+        }
+      } else {
+        xrBitDepthCounts[bitDepth16(xr, 1)]++;
+        if (STEREO) {
+          ydrBitDepthCounts[bitDepth16(ydr, 1)]++;
+        }
+      }
+      if (i >= numSampleTuples - NUM_LP_COEFS - 1) {
+        lastSampleTuples[(i - (numSampleTuples - NUM_LP_COEFS - 1))*2 + 0] = xPrevious;
+        lastSampleTuples[(i - (numSampleTuples - NUM_LP_COEFS - 1))*2 + 1] = yPrevious;
+      }
+      xm2 = xm1;
+      xm1 = x;
+      ym2 = ym1;
+      ym1 = y;
+    }
+  }
+
+  // Write a near-lossless block of numSampleTuples sample tuples with the smallest shift that fits, at a true bit depth of at least
+  // minTrueBitDepth. The coefficients are fitted to the input once, and the residuals are quantized in a closed loop by
+  // nearLosslessResiduals, once to choose the exp-Golomb-like parameters and once more to write them, so no residuals are stored.
+  // Returns the true bit depth, or 0 if no shift fits, in which case nothing is written. c and lastSampleTuples return what the decoder
+  // continues from.
+  static int writeNearLossless(const int16_t *input, uint8_t *output, uint8_t timeStamp, int numSampleTuples, int minTrueBitDepth, LPCoefs &c, int16_t *lastSampleTuples, int &numBitsWritten) {
+    // Correlation sums of the delta values of the input, of the left (independent) and right (dependent) channel
+    FitSums sums = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for (int j = 1; j < numSampleTuples - NUM_LP_COEFS; j++) {
+      int16_t left[3], right[3] = {0, 0, 0};
+      for (int k = 0; k < 3; k++) {
+        left[k] = input[(j + k)*NUM_CHANNELS] - input[(j + k - 1)*NUM_CHANNELS];
+        if (STEREO) {
+          right[k] = input[(j + k)*2 + 1] - input[(j + k - 1)*2 + 1];
+        }
+      }
+      sums.x0x0 += left[0]*(int32_t)left[0];
+      sums.x1x1 += left[1]*(int32_t)left[1];
+      sums.x0x1 += left[0]*(int32_t)left[1];
+      sums.x0x2 += left[0]*(int32_t)left[2];
+      sums.x1x2 += left[1]*(int32_t)left[2];
+      if (STEREO) {
+        sums.y0y0 += right[0]*(int32_t)right[0];
+        sums.y1y1 += right[1]*(int32_t)right[1];
+        sums.y0y1 += right[0]*(int32_t)right[1];
+        sums.y0y2 += right[0]*(int32_t)right[2];
+        sums.y1y2 += right[1]*(int32_t)right[2];
+        sums.x2x2 += left[2]*(int32_t)left[2];
+        sums.x2y2 += left[2]*(int32_t)right[2];
+        sums.y1x2 += right[1]*(int32_t)left[2];
+        sums.y0x2 += right[0]*(int32_t)left[2];
+      }
+    }
+    const int xCoefMins[2] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS};
+    const int xCoefMaxs[2] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS};
+    const int yCoefMins[3] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS, D0_MIN + Format::D0_BIAS};
+    const int yCoefMaxs[3] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS, D0_MAX + Format::D0_BIAS};
+    fitCoefs(c, sums, xCoefMins, xCoefMaxs, yCoefMins, yCoefMaxs);
+
+    // Warmup of the left (independent) and right (dependent) channel
+    int16_t xWarmup[2] = {input[0], (int16_t)(input[NUM_CHANNELS] - input[0])};
+    int16_t yWarmup[2] = {STEREO ? input[1] : (int16_t)0, STEREO ? (int16_t)(input[3] - input[1]) : (int16_t)0};
+    int headerNumBits = 8 + Format::CHMODE_NUM_BITS + 4 + NEAR_LOSSLESS_SHIFT_NUM_BITS + NEAR_LOSSLESS_PARAMETER_NUM_BITS
+      + valueToExpGolombLikeNumBits16(xWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(xWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER)
+      + valueToExpGolombLikeNumBits16(c.xc1 - Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.xc2 - Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+    if (STEREO) {
+      headerNumBits += NEAR_LOSSLESS_PARAMETER_NUM_BITS
+        + valueToExpGolombLikeNumBits16(yWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(yWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER)
+        + valueToExpGolombLikeNumBits16(c.yc1 - Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(c.yc2 - Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER)
+        + valueToExpGolombLikeNumBits16(c.yd0 - Format::D0_BIAS, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+    }
+    for (int shift = 1; 16 - shift >= minTrueBitDepth; shift++) {
+      int trueBitDepth = 16 - shift;
+      int xrBitDepthCounts[17] = {0};
+      int ydrBitDepthCounts[17] = {0};
+      nearLosslessResiduals(input, numSampleTuples, c, shift, 0, 0, 0, xrBitDepthCounts, ydrBitDepthCounts, lastSampleTuples);
+      int xrNumBits, ydrNumBits = 0;
+      int xrExpGolombLikeParameter = nearLosslessParameter(xrBitDepthCounts, trueBitDepth, xrNumBits);
+      int ydrExpGolombLikeParameter = STEREO ? nearLosslessParameter(ydrBitDepthCounts, trueBitDepth, ydrNumBits) : 1;
+      if (headerNumBits + xrNumBits + ydrNumBits > BLOCK_NUM_BYTES*8) {
+        continue;
+      }
+      BitStreamWriter writer(output);
+      timeStamp = numSampleTuples; // Fake it! ***
+      writer.write(timeStamp, 8);
+      writer.write(CHMODE_MSB, Format::CHMODE_NUM_BITS);
+      writer.write(NEAR_LOSSLESS_CODE, 4);
+      writer.write(shift, NEAR_LOSSLESS_SHIFT_NUM_BITS);
+      writer.writeExpGolombLike(xWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(xWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      if (STEREO) {
+        writer.writeExpGolombLike(yWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(yWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      }
+      writer.write(xrExpGolombLikeParameter - 1, NEAR_LOSSLESS_PARAMETER_NUM_BITS);
+      writer.writeExpGolombLike(c.xc1 - Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(c.xc2 - Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+      if (STEREO) {
+        writer.write(ydrExpGolombLikeParameter - 1, NEAR_LOSSLESS_PARAMETER_NUM_BITS);
+        writer.writeExpGolombLike(c.yc1 - Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(c.yc2 - Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(c.yd0 - Format::D0_BIAS, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+      }
+      nearLosslessResiduals(input, numSampleTuples, c, shift, &writer, xrExpGolombLikeParameter, ydrExpGolombLikeParameter, 0, 0, lastSampleTuples);
+      numBitsWritten = writer.numBitsWritten;
+      return trueBitDepth;
+    }
+    return 0;
+  }
+
+  // Encode a near-lossless block of numSampleTuples sample tuples by writeNearLossless. Returns the true bit depth, or 0 if no shift
+  // fits, in which case nothing is written.
+  int encodeNearLossless(const int16_t *input, uint8_t *output, uint8_t timeStamp, int numSampleTuples, int minTrueBitDepth, int &numSampleTuplesWritten, int &numBitsWritten) {
+    LPCoefs c;
+    int16_t lastSampleTuples[(NUM_LP_COEFS + 1)*2];
+    int trueBitDepth = writeNearLossless(input, output, timeStamp, numSampleTuples, minTrueBitDepth, c, lastSampleTuples, numBitsWritten);
+    if (trueBitDepth) {
+      // Update what the decoder knows. The right channel of mono stays silent.
+      stream.update(lastSampleTuples);
+      stream.lowShift = Format::LOW_NUM_BITS;
+      stream.c = c;
+      stream.valid = true;
+      numBlocksSinceIndependent = 0;
+      numSampleTuplesWritten = numSampleTuples;
+    }
+    return trueBitDepth;
+  }
+
+  // Encode a lossy block in place of a lossless block that would be shorter than minNumSampleTuples: a near-lossless block of
+  // minNumSampleTuples sample tuples, if one fits at a true bit depth above that of a CHMODE_MSB block of minNumSampleTuples sample tuples,
+  // and otherwise the CHMODE_MSB block of at most maxNumSampleTuples sample tuples. If minNumSampleTuples is more than fit at 8 bits,
+  // CHMODE_MSB settles for 8 bits. In fixed-frame mode, a near-lossless block may go below 8 bits if CHMODE_MSB cannot fit the frame.
+  int encodeLossy(const int16_t *input, uint8_t *output, uint8_t timeStamp, int minNumSampleTuples, int maxNumSampleTuples, int &numSampleTuplesWritten, int &numBitsWritten) {
+    int trueBitDepth = 16;
+    for (; trueBitDepth > 8; trueBitDepth--) {
+      if (Format::chModeMSBNumSampleTuples(trueBitDepth) >= minNumSampleTuples) break;
+    }
+    int numSampleTuples = (minNumSampleTuples < maxNumSampleTuples) ? minNumSampleTuples : maxNumSampleTuples;
+    int minTrueBitDepth = (frameNumSampleTuples && Format::chModeMSBNumSampleTuples(trueBitDepth) < minNumSampleTuples) ? 1 : trueBitDepth + 1;
+    int nearLosslessBitDepth = encodeNearLossless(input, output, timeStamp, numSampleTuples, minTrueBitDepth, numSampleTuplesWritten, numBitsWritten);
+    if (nearLosslessBitDepth) {
+      return nearLosslessBitDepth;
+    }
+    numSampleTuples = Format::chModeMSBNumSampleTuples(trueBitDepth);
+    if (numSampleTuples > maxNumSampleTuples) {
+      numSampleTuples = maxNumSampleTuples;
+    }
+    return encodeMSB(input, output, timeStamp, trueBitDepth, numSampleTuples, numSampleTuplesWritten, numBitsWritten);
+  }
+
+  // Encode a block of at most maxNumSampleTuples sample tuples, which must be more than BLOCK_MIN_NUM_SAMPLETUPLES and not less than
+  // minNumSampleTuples. In fixed-frame mode, both are frameNumSampleTuples. None is more than blockMaxNumSampleTuples.
+  int encodeBlock(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples, bool continuation, int maxNumSampleTuples = BLOCK_MAX_NUM_SAMPLETUPLES) {
+    if (frameNumSampleTuples) {
+      minNumSampleTuples = frameNumSampleTuples;
+      maxNumSampleTuples = frameNumSampleTuples;
+    }
+    if (maxNumSampleTuples > blockMaxNumSampleTuples) {
+      maxNumSampleTuples = blockMaxNumSampleTuples;
+    }
+    if (minNumSampleTuples > maxNumSampleTuples) {
+      minNumSampleTuples = maxNumSampleTuples;
+    }
+
+    int trueBitDepth = 16;
+    BitStreamWriter writer(output);
+
+    // Low bits of MLAC24BitFormat, which only converted input has. Linear prediction codes the samples shifted right by lowShift bits,
+    // the fewest that bring all of the sample tuples available to 16 bits, so that quiet audio is predicted at its full resolution. The
+    // lowShift bits below come after the residuals as they are, leaving out low bits that are zero in all of the sample tuples, for
+    // example of 16-bit audio in a 24-bit stream. A continuation block keeps the shift of the stream, or is made independent if the
+    // shift is too small.
+    const uint8_t *low = (Format::LOW_NUM_BITS && input == &inputBuf[deltaOffset*NUM_CHANNELS]) ? &lowBuf[deltaOffset*NUM_CHANNELS] : 0;
+    const int16_t *predicted = input; // Samples that linear prediction codes
+    int lowShift = Format::LOW_NUM_BITS;
+    int numZeroLowBits = Format::LOW_NUM_BITS; // Number of low bits that are zero in all of the sample tuples
+    int lowNumBits = 0;
+    if (low) {
+      uint32_t lowBits = 0;
+      int32_t minValue = 0;
+      int32_t maxValue = 0;
+      for (int i = 0; i < maxNumSampleTuples*NUM_CHANNELS; i++) {
+        int32_t value = input[i]*(1 << Format::LOW_NUM_BITS) + low[i];
+        lowBits |= low[i];
+        minValue = (value < minValue) ? value : minValue;
+        maxValue = (value > maxValue) ? value : maxValue;
+      }
+      int minLowShift = 0;
+      while (minLowShift < Format::LOW_NUM_BITS && (minValue < -(0x8000 << minLowShift) || maxValue >= (0x8000 << minLowShift))) {
+        minLowShift++;
+      }
+      numZeroLowBits = 0;
+      while (numZeroLowBits < Format::LOW_NUM_BITS && !((lowBits >> numZeroLowBits) & 1)) {
+        numZeroLowBits++;
+      }
+      lowShift = (numZeroLowBits > minLowShift) ? numZeroLowBits : minLowShift;
+      if (continuation) {
+        if (stream.lowShift >= minLowShift) {
+          lowShift = stream.lowShift;
+        } else {
+          continuation = false;
+        }
+      }
+      lowNumBits = (lowShift > numZeroLowBits) ? lowShift - numZeroLowBits : 0;
+      if (lowShift < Format::LOW_NUM_BITS) {
+        for (int i = 0; i < blockMaxNumSampleTuples*NUM_CHANNELS; i++) {
+          shiftedBuf[i] = (input[i]*(1 << Format::LOW_NUM_BITS) + low[i]) >> lowShift;
+        }
+        predicted = shiftedBuf;
+      }
+    }
+    lowTupleNumBits = NUM_CHANNELS*lowNumBits;
+
+    // Delta values
+    
+    x = &xBuf[NUM_LP_COEFS + deltaOffset];
+    y = &yBuf[NUM_LP_COEFS + deltaOffset];
+    if (continuation) {
+      x[0] = predicted[0] - stream.xLast;
+      y[0] = STEREO ? predicted[1] - stream.yLast : 0;
+    } else {
+      x[0] = predicted[0];
+      y[0] = STEREO ? predicted[1] : 0;
+    }
+    for (int i = (numKeptDeltas > 1 && deltaLowShift == lowShift) ? numKeptDeltas : 1; i < blockMaxNumSampleTuples; i++) {
+      x[i] = predicted[i*NUM_CHANNELS] - predicted[(i - 1)*NUM_CHANNELS];
+      if (STEREO) {
+        y[i] = predicted[i*2 + 1] - predicted[(i - 1)*2 + 1];
+      }
+    }
+    deltaLowShift = lowShift;
+
+    // Digital silence or other constant input needs no analysis. Shorter constant runs are left to linear prediction,
+    // which can continue the block past the end of the run. The delta values above are still needed, as encodeNext keeps
+    // those after the end of a fixed-frame constant run.
+    if (numConstantSampleTuples(input, maxNumSampleTuples) == maxNumSampleTuples && numZeroLowBits == Format::LOW_NUM_BITS) {
+      return encodeConstantRun(input, output, timeStamp, maxNumSampleTuples, numSampleTuplesWritten, numBitsWritten);
+    }
+
+    if (continuation) {
+      for (int k = 0; k < NUM_LP_COEFS; k++) {
+        x[k - NUM_LP_COEFS] = stream.xDeltas[k];
+        y[k - NUM_LP_COEFS] = stream.yDeltas[k];
+      }
+      x -= NUM_LP_COEFS;
+      y -= NUM_LP_COEFS;
+      blockStart = NUM_LP_COEFS;
+      coefCoding = COEF_CODING_DELTA;
+    } else {
+      blockStart = 0;
+      coefCoding = COEF_CODING_INDEPENDENT;
+    }
+    blockEnd = blockStart + maxNumSampleTuples;
+
+    // Coefficient ranges: independent channel c1, c2, dependent channel c1, c2, d0
+    int xCoefMins[2] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS};
+    int xCoefMaxs[2] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS};
+    int yCoefMins[3] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS, D0_MIN + Format::D0_BIAS};
+    int yCoefMaxs[3] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS, D0_MAX + Format::D0_BIAS};
+    limitCoefRange(xCoefMins[0], xCoefMaxs[0], stream.c.xc1);
+    limitCoefRange(xCoefMins[1], xCoefMaxs[1], stream.c.xc2);
+    limitCoefRange(yCoefMins[0], yCoefMaxs[0], stream.c.yc1);
+    limitCoefRange(yCoefMins[1], yCoefMaxs[1], stream.c.yc2);
+    limitCoefRange(yCoefMins[2], yCoefMaxs[2], stream.c.yd0);
+
+    // Correlation sums of the left (x) and right (y) channel delta values
+    int16_t *const left = x;
+    int16_t *const right = y;
+    int j = 2;
+
+    int64_t x1x1Pre = left[1]*(int32_t)left[1];
+    int64_t x0x0Pre = left[0]*(int32_t)left[0] + x1x1Pre;
+    int64_t x1x2Pre = left[1]*(int32_t)left[2];
+    int64_t x0x1Pre = left[0]*(int32_t)left[1] + x1x2Pre;
+    int64_t x0x2 = left[0]*(int32_t)left[2] + left[1]*(int32_t)left[3];
+
+    // Mono has no right channel sums
+    int64_t y1y1Pre = STEREO ? right[1]*(int32_t)right[1] : 0;
+    int64_t y0y0Pre = STEREO ? right[0]*(int32_t)right[0] + y1y1Pre : 0;
+    int64_t y1y2Pre = STEREO ? right[1]*(int32_t)right[2] : 0;
+    int64_t y0y1Pre = STEREO ? right[0]*(int32_t)right[1] + y1y2Pre : 0;
+    int64_t y0y2 = STEREO ? right[0]*(int32_t)right[2] + right[1]*(int32_t)right[3] : 0;
+    
+    int64_t x2y2 = STEREO ? left[0 + 2]*(int32_t)right[0 + 2] + left[1 + 2]*(int32_t)right[1 + 2] : 0;
+    int64_t y1x2 = STEREO ? right[0 + 1]*(int32_t)left[0 + 2] + right[1 + 1]*(int32_t)left[1 + 2] : 0;
+    int64_t y0x2 = STEREO ? right[0]*(int32_t)left[0 + 2] + right[1]*(int32_t)left[1 + 2] : 0;
+    int64_t x1y2 = STEREO ? left[0 + 1]*(int32_t)right[0 + 2] + left[1 + 1]*(int32_t)right[1 + 2] : 0;
+    int64_t x0y2 = STEREO ? left[0]*(int32_t)right[0 + 2] + left[1]*(int32_t)right[1 + 2] : 0;
+    
+    int64_t xx0 = 0;
+    int64_t xx1 = 0;
+    
+    int64_t yy0 = 0;
+    int64_t yy1 = 0;
+        
+    int bestChMode = CHMODE_MSB;
+    LPCoefs c;
+    c.order = NUM_LP_COEFS;
+    LPCoefs bestc = c;
+    int bestCoefCoding = coefCoding;
+    int bestNumSampleTuples = blockStart + BLOCK_MIN_NUM_SAMPLETUPLES;
+    int bestNumBits = 8 + 2 + 1 + BLOCK_MIN_NUM_SAMPLETUPLES*2*16;
+
+    int commonNumBits =
+      ( 8
+        // time stamp      
+        + Format::CHMODE_NUM_BITS // chmode
+        + 1 // continuation
+        + (continuation ? 1 : 0) // coefficient reuse
+        + (Format::RANS_RESIDUALS ? 1 : 0) // rANS residual coding
+        + (Format::ADAPTIVE_RESIDUALS ? 1 : 0) // adaptive residual coding
+        + (Format::LOW_NUM_BITS ? 2*LOW_NUM_BITS_NUM_BITS + (NUM_LP_COEFS - blockStart)*lowTupleNumBits : 0) // shift, number of low bits, low bits of warmup
+        );
+    int chMode = CHMODE_INDEPENDENT_AND_DEPENDENT; // Channel mode of linear prediction
+    int numAvailableBits = BLOCK_NUM_BYTES*8 - commonNumBits - warmupNumBits(); // Warmup depends on the channel mode
+    int targetNumSampleTuples = blockStart + BLOCK_MIN_NUM_SAMPLETUPLES + 1;
+    int bestxrExpGolombLikeParameter;
+    int bestydrExpGolombLikeParameter;
+    int numIterations = (effort >= EFFORT_REFIT) ? REFIT_NUM_ITERATIONS : 1;
+    bool reselectParameters = effort >= EFFORT_RESELECT_PARAMETERS;
+    bool bestResidualsValid = false; // Do xr and ydr hold the residuals for bestc?
+
+    for (int iteration = 0; iteration < numIterations; iteration++) {
+
+      // Calculate linear prediction coefficients. Aim a bit higher with numSampleTuples than we are sure we can go.
+      
+      for (; j < targetNumSampleTuples - NUM_LP_COEFS - 1; j += 2) { // This unrolled loop gives 3 % speedup on BeagleBone Black. This loop be removed without further modifications.
+        xx0 -= (int32_t) - (left[j]*(int32_t)left[j]) - left[j + 1]*(int32_t)left[j + 1]; // Dual 16x16 multiply and 32-bit subtractive accumulate (- 0x40000000 - 0x40000000 is valid).
+        xx1 -= (int32_t) - (left[j]*(int32_t)left[j + 1]) - left[j + 1]*(int32_t)left[j + 2];
+        x0x2 -= (int32_t) - (left[j]*(int32_t)left[j + 2]) - left[j + 1]*(int32_t)left[j + 3];
+        if (!STEREO) continue;
+
+        yy0 -= (int32_t) - (right[j]*(int32_t)right[j]) - right[j + 1]*(int32_t)right[j + 1];
+        yy1 -= (int32_t) - (right[j]*(int32_t)right[j + 1]) - right[j + 1]*(int32_t)right[j + 2];
+        y0y2 -= (int32_t) - (right[j]*(int32_t)right[j + 2]) - right[j + 1]*(int32_t)right[j + 3];
+
+	x2y2 -= (int32_t) - (left[j + 2]*(int32_t)right[j + 2]) - left[j + 3]*(int32_t)right[j + 3];
+	y1x2 -= (int32_t) - (right[j + 1]*(int32_t)left[j + 2]) - right[j + 2]*(int32_t)left[j + 3];
+	y0x2 -= (int32_t) - (right[j]*(int32_t)left[j + 2]) - right[j + 1]*(int32_t)left[j + 3];
+	x1y2 -= (int32_t) - (left[j + 1]*(int32_t)right[j + 2]) - left[j + 2]*(int32_t)right[j + 3];
+	x0y2 -= (int32_t) - (left[j]*(int32_t)right[j + 2]) - left[j + 1]*(int32_t)right[j + 3];
+      }
+      for (; j < targetNumSampleTuples - NUM_LP_COEFS; j++) {
+        xx0 += left[j]*(int32_t)left[j];
+        xx1 += left[j]*(int32_t)left[j + 1];
+        x0x2 += left[j]*(int32_t)left[j + 2];
+        if (!STEREO) continue;
+
+        yy0 += right[j]*(int32_t)right[j];
+        yy1 += right[j]*(int32_t)right[j + 1];
+        y0y2 += right[j]*(int32_t)right[j + 2];
+
+	x2y2 += left[j + 2]*(int32_t)right[j + 2];
+	y1x2 += right[j + 1]*(int32_t)left[j + 2];
+	y0x2 += right[j]*(int32_t)left[j + 2];        
+	x1y2 += left[j + 1]*(int32_t)right[j + 2];
+	x0y2 += left[j]*(int32_t)right[j + 2];
+      }
+
+      // 01234.............j 
+      // PP++++++++++++++++   x0x0
+      //  P++++++++++++++++P  x1x1
+      //   ++++++++++++++++PP x2x2
+      // 012345............j
+      // PP++++++++++++++++   x0x1
+      //  P++++++++++++++++P  x1x2
+      // 012345............j
+      // PP++++++++++++++++   x0x2
+
+      int64_t x0x0 = x0x0Pre + xx0;
+      int64_t x1x1 = x1x1Pre + xx0 + left[j]*(int32_t)left[j];
+      int64_t x2x2 = xx0 + (left[j]*(int32_t)left[j] + left[j + 1]*(int32_t)left[j + 1]);
+      int64_t x0x1 = x0x1Pre + xx1;
+      int64_t x1x2 = x1x2Pre + xx1 + left[j]*(int32_t)left[j + 1];
+
+      int64_t y0y0 = y0y0Pre + yy0;
+      int64_t y1y1 = y1y1Pre + yy0 + (STEREO ? right[j]*(int32_t)right[j] : 0);
+      int64_t y0y1 = y0y1Pre + yy1;
+      int64_t y1y2 = y1y2Pre + yy1 + (STEREO ? right[j]*(int32_t)right[j + 1] : 0);
+      int64_t y2y2 = yy0 + (STEREO ? right[j]*(int32_t)right[j] + right[j + 1]*(int32_t)right[j + 1] : 0);
+
+      // The above is an optimization of:
+      /*
+      for (; j < targetNumSampleTuples - NUM_LP_COEFS; j++) {
+        x0x0 += left[j]*(int32_t)left[j];
+	x0x1 += left[j]*(int32_t)left[j + 1];
+	x0x2 += left[j]*(int32_t)left[j + 2];
+	x1x1 += left[j + 1]*(int32_t)left[j + 1];
+	x1x2 += left[j + 1]*(int32_t)left[j + 2];
+	x2x2 += left[j + 2]*(int32_t)left[j + 2];
+	y0y0 += right[j]*(int32_t)right[j];
+	y0y1 += right[j]*(int32_t)right[j + 1];
+	y0y2 += right[j]*(int32_t)right[j + 2];
+	y1x2 += right[j + 1]*(int32_t)left[j + 2];
+	y1y1 += right[j + 1]*(int32_t)right[j + 1];
+	y1y2 += right[j + 1]*(int32_t)right[j + 2];
+	y0x2 += right[j]*(int32_t)left[j + 2];
+      }
+      */
+      FitSums lr = {x0x0, x1x1, x0x1, x0x2, x1x2, y0y0, y1y1, y0y1, y0y2, y1y2, x2x2, x2y2, y1x2, y0x2, x1y2, x0y2, y2y2};
+
+      // Do linear prediction with the new coefficients
+
+      int numBits;
+      if (iteration == 0) {
+        chMode = chooseChMode(c, lr, targetNumSampleTuples - NUM_LP_COEFS, xCoefMins, xCoefMaxs, yCoefMins, yCoefMaxs);
+        setChMode(chMode, left, right, blockEnd);
+        numAvailableBits = BLOCK_NUM_BYTES*8 - commonNumBits - warmupNumBits();
+        numBits = predictIndependent(c, targetNumSampleTuples) + predictDependent(c, targetNumSampleTuples);
+      } else {
+        fitCoefs(c, chModeFitSums(chMode, lr), xCoefMins, xCoefMaxs, yCoefMins, yCoefMaxs);
+        numBits = predictIndependent(c, targetNumSampleTuples) + predictDependent(c, targetNumSampleTuples);
+      }
+      if (numBits > numAvailableBits) {
+	//	printf("Early out\n");
+        bestResidualsValid = false;
+        break;
+      } 
+      bestChMode = chMode;
+      bestc = c;
+      bestNumSampleTuples = targetNumSampleTuples;
+      bestNumBits = numBits;
+      bestxrExpGolombLikeParameter = xr.expGolombLikeParameter;
+      bestydrExpGolombLikeParameter = ydr.expGolombLikeParameter;
+      bestResidualsValid = true;
+      extend(c, bestNumSampleTuples, bestNumBits, bestxrExpGolombLikeParameter, bestydrExpGolombLikeParameter, numAvailableBits, reselectParameters);
+      if (bestNumSampleTuples == blockEnd) {
+        break;
+      }
+      targetNumSampleTuples = bestNumSampleTuples + 1;
+    }
+
+    if (effort >= EFFORT_REFIT && Format::MAX_LP_ORDER > NUM_LP_COEFS) {
+      // See if a higher prediction order is better. Fit a bit further than the block length found so far.
+      int numSampleTuples = (bestChMode == CHMODE_MSB) ? blockStart + BLOCK_MIN_NUM_SAMPLETUPLES + 1 : bestNumSampleTuples;
+      int fitEnd = (numSampleTuples < blockEnd) ? numSampleTuples + 1 : blockEnd;
+      int historyStart = continuation ? 0 : 1;
+      int32_t xLDCoefs[MAX_LP_ORDER + 1][MAX_LP_ORDER + 1];
+      int32_t yLDCoefs[MAX_LP_ORDER + 1][MAX_LP_ORDER + 1];
+      int maxOrder = fitHighOrder(x, historyStart, fitEnd, xLDCoefs);
+      int yMaxOrder = STEREO ? fitHighOrder(y, historyStart, fitEnd, yLDCoefs) : maxOrder;
+      if (yMaxOrder < maxOrder) {
+        maxOrder = yMaxOrder;
+      }
+      // Coefficients of order NUM_LP_COEFS are carried over as the decoder does
+      LPCoefs c = stream.c;
+      if (!continuation) {
+        c.reset<Format>();
+      }
+      LPCoefs bestHighOrderc;
+      int bestHighOrderNumBits = INT_MAX;
+      for (int order = NUM_LP_COEFS + 1; order <= maxOrder; order++) {
+        c.order = order;
+        for (int k = 1; k <= order; k++) {
+          c.xcn[k] = quantizeHighOrderCoef(xLDCoefs[order][k]);
+          c.ycn[k] = STEREO ? quantizeHighOrderCoef(yLDCoefs[order][k]) : 0;
+        }
+        // Least squares fit of the coefficient for the left channel to what the right channel predictor leaves
+        int64_t ex = 0;
+        int64_t xx = 0;
+        for (int i = historyStart + order; STEREO && i < fitEnd; i++) {
+          int32_t e = (int32_t)y[i]*(1 << Format::HIGH_ORDER_COEF_SHIFT);
+          for (int k = 1; k <= order; k++) {
+            e -= (int32_t)y[i - k]*c.ycn[k];
+          }
+          ex += (int64_t)e*x[i];
+          xx += x[i]*(int32_t)x[i];
+        }
+        c.ycn[0] = (xx == 0) ? 0 : fixedPointQuotient(ex, xx, 0, HIGH_ORDER_COEF_MIN, HIGH_ORDER_COEF_MAX);
+        int numBits = predictIndependent(c, numSampleTuples) + predictDependent(c, numSampleTuples);
+        if (numBits < bestHighOrderNumBits) {
+          bestHighOrderc = c;
+          bestHighOrderNumBits = numBits;
+        }
+      }
+      if (bestHighOrderNumBits <= numAvailableBits) {
+        // Extend the block with the best order and keep it if it is longer, or as long with fewer bits
+        predictIndependent(bestHighOrderc, numSampleTuples);
+        predictDependent(bestHighOrderc, numSampleTuples);
+        int xrExpGolombLikeParameter = xr.expGolombLikeParameter;
+        int ydrExpGolombLikeParameter = ydr.expGolombLikeParameter;
+        int numBits = bestHighOrderNumBits;
+        extend(bestHighOrderc, numSampleTuples, numBits, xrExpGolombLikeParameter, ydrExpGolombLikeParameter, numAvailableBits, reselectParameters);
+        if (bestChMode == CHMODE_MSB || numSampleTuples > bestNumSampleTuples || (numSampleTuples == bestNumSampleTuples && numBits < bestNumBits)) {
+          bestChMode = chMode;
+          bestc = bestHighOrderc;
+          bestNumSampleTuples = numSampleTuples;
+          bestNumBits = numBits;
+          bestxrExpGolombLikeParameter = xrExpGolombLikeParameter;
+          bestydrExpGolombLikeParameter = ydrExpGolombLikeParameter;
+          bestResidualsValid = true;
+        } else {
+          bestResidualsValid = false;
+        }
+      } else if (maxOrder > NUM_LP_COEFS) {
+        bestResidualsValid = false;
+      }
+    }
+
+    if (effort >= EFFORT_MAX && bestChMode != CHMODE_MSB) {
+      // Search for better coefficients for the block length found so far, and if found, try to extend the block with them
+      LPCoefs c = bestc;
+      int numBits;
+      if (c.order == NUM_LP_COEFS) {
+        int16_t *const xCoefs[2] = {&c.xc1, &c.xc2};
+        int16_t *const yCoefs[3] = {&c.yc1, &c.yc2, &c.yd0};
+        numBits = searchNeighbourCoefs(c, xCoefs, xCoefMins, xCoefMaxs, 2, &MLACBasicEncoder::predictIndependent, bestNumSampleTuples);
+        numBits += STEREO ? searchNeighbourCoefs(c, yCoefs, yCoefMins, yCoefMaxs, 3, &MLACBasicEncoder::predictDependent, bestNumSampleTuples) : predictDependent(c, bestNumSampleTuples);
+      } else {
+        int16_t *xCoefs[MAX_LP_ORDER];
+        int16_t *yCoefs[MAX_LP_ORDER + 1];
+        int coefMins[MAX_LP_ORDER + 1];
+        int coefMaxs[MAX_LP_ORDER + 1];
+        for (int k = 0; k <= c.order; k++) {
+          if (k < c.order) {
+            xCoefs[k] = &c.xcn[k + 1];
+          }
+          yCoefs[k] = &c.ycn[k];
+          coefMins[k] = HIGH_ORDER_COEF_MIN;
+          coefMaxs[k] = HIGH_ORDER_COEF_MAX;
+        }
+        numBits = searchNeighbourCoefs(c, xCoefs, coefMins, coefMaxs, c.order, &MLACBasicEncoder::predictIndependent, bestNumSampleTuples);
+        numBits += STEREO ? searchNeighbourCoefs(c, yCoefs, coefMins, coefMaxs, c.order + 1, &MLACBasicEncoder::predictDependent, bestNumSampleTuples) : predictDependent(c, bestNumSampleTuples);
+      }
+      if (numBits < bestNumBits) {
+        bestc = c;
+        bestNumBits = numBits;
+        bestxrExpGolombLikeParameter = xr.expGolombLikeParameter;
+        bestydrExpGolombLikeParameter = ydr.expGolombLikeParameter;
+        bestResidualsValid = true;
+        extend(c, bestNumSampleTuples, bestNumBits, bestxrExpGolombLikeParameter, bestydrExpGolombLikeParameter, numAvailableBits, true);
+      } else {
+        bestResidualsValid = false;
+      }
+    }
+
+    if (continuation) {
+      // See if reusing the coefficients of the previous block is better
+      coefCoding = COEF_CODING_REUSE;
+      int numSampleTuples = (bestChMode == CHMODE_MSB) ? blockStart + BLOCK_MIN_NUM_SAMPLETUPLES + 1 : bestNumSampleTuples;
+      int numBits = predictIndependent(stream.c, numSampleTuples) + predictDependent(stream.c, numSampleTuples);
+      if (numBits <= numAvailableBits && (bestChMode == CHMODE_MSB || numBits < bestNumBits)) {
+        bestChMode = chMode;
+        bestCoefCoding = COEF_CODING_REUSE;
+        bestc = stream.c;
+        bestNumSampleTuples = numSampleTuples;
+        bestNumBits = numBits;
+        bestxrExpGolombLikeParameter = xr.expGolombLikeParameter;
+        bestydrExpGolombLikeParameter = ydr.expGolombLikeParameter;
+        bestResidualsValid = true;
+        extend(bestc, bestNumSampleTuples, bestNumBits, bestxrExpGolombLikeParameter, bestydrExpGolombLikeParameter, numAvailableBits, reselectParameters);
+      } else {
+        bestResidualsValid = false;
+      }
+    }
+
+    if (!bestResidualsValid && bestChMode != CHMODE_MSB) {
+      residuals(bestc, NUM_LP_COEFS, bestNumSampleTuples);
+    }
+
+    if ((Format::ADAPTIVE_RESIDUALS || Format::RANS_RESIDUALS) && bestChMode != CHMODE_MSB) {
+      // Residuals of the rest of the sample tuples available, for the other residual codings
+      residuals(bestc, bestNumSampleTuples, blockEnd);
+    }
+
+    bool bestAdaptive = false;
+    if (Format::ADAPTIVE_RESIDUALS && bestChMode != CHMODE_MSB) {
+      // See if adaptive exp-Golomb-like parameters fit more sample tuples, or as many in fewer bits
+      int xrExpGolombLikeParameter = adaptiveInitialParameter(xr.s, bestNumSampleTuples, bestxrExpGolombLikeParameter);
+      int ydrExpGolombLikeParameter = STEREO ? adaptiveInitialParameter(ydr.s, bestNumSampleTuples, bestydrExpGolombLikeParameter) : bestydrExpGolombLikeParameter;
+      int numSampleTuples;
+      int numBits = independentSideInfoNumBits<Format>(bestc, xrExpGolombLikeParameter, bestCoefCoding, stream.c) + dependentSideInfoNumBits<Format>(bestc, ydrExpGolombLikeParameter, bestCoefCoding, stream.c);
+      extendAdaptive(xrExpGolombLikeParameter, ydrExpGolombLikeParameter, blockEnd, numSampleTuples, numBits, numAvailableBits);
+      if (numSampleTuples > bestNumSampleTuples || (numSampleTuples == bestNumSampleTuples && numBits < bestNumBits)) {
+        bestAdaptive = true;
+        bestNumSampleTuples = numSampleTuples;
+        bestNumBits = numBits;
+        bestxrExpGolombLikeParameter = xrExpGolombLikeParameter;
+        bestydrExpGolombLikeParameter = ydrExpGolombLikeParameter;
+      }
+    }
+
+    bool bestRANS = false;
+    RANSChannel xrRANS, ydrRANS;
+    if (Format::RANS_RESIDUALS && bestChMode != CHMODE_MSB) {
+      // See if rANS fits more sample tuples, or as many in fewer bits. A rANS block has no adaptive residual coding flag.
+      int adaptiveFlagNumBits = Format::ADAPTIVE_RESIDUALS ? 1 : 0;
+      int ransNumAvailableBits = numAvailableBits + adaptiveFlagNumBits;
+      int sideInfoNumBits = independentSideInfoNumBits<Format>(bestc, bestxrExpGolombLikeParameter, bestCoefCoding, stream.c) + dependentSideInfoNumBits<Format>(bestc, bestydrExpGolombLikeParameter, bestCoefCoding, stream.c)
+        - residualExpGolombLikeParameterEncodingNumBits[bestxrExpGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] - (STEREO ? residualExpGolombLikeParameterEncodingNumBits[bestydrExpGolombLikeParameter - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] : 0)
+        + NUM_CHANNELS*(RANS_RAW_NUM_BITS_NUM_BITS + RANS_TABLE_NUM_BITS);
+      // Extend the block as far as the estimated number of bits allows
+      int numSampleTuples = bestNumSampleTuples;
+      int estimatedNumBits = ((sideInfoNumBits + NUM_CHANNELS*RANS_PROB_BITS + (numSampleTuples - NUM_LP_COEFS)*lowTupleNumBits) << RANS_COST_SHIFT) + chooseRANSTable(xr.s, numSampleTuples, xrRANS) + (STEREO ? chooseRANSTable(ydr.s, numSampleTuples, ydrRANS) : 0);
+      for (; numSampleTuples < blockEnd; numSampleTuples++) {
+        int candidateNumBits = estimatedNumBits + ransNumBits(xr.s[numSampleTuples], xrRANS) + (STEREO ? ransNumBits(ydr.s[numSampleTuples], ydrRANS) : 0) + (lowTupleNumBits << RANS_COST_SHIFT);
+        if (candidateNumBits > ransNumAvailableBits << RANS_COST_SHIFT) {
+          break;
+        }
+        estimatedNumBits = candidateNumBits;
+      }
+      // Shorten the block until it fits
+      int numBits;
+      for (;;) {
+        numBits = sideInfoNumBits + encodeRANS(xrRANS, ydrRANS, numSampleTuples) + (numSampleTuples - NUM_LP_COEFS)*lowTupleNumBits;
+        if (numBits <= ransNumAvailableBits || numSampleTuples <= bestNumSampleTuples) {
+          break;
+        }
+        numSampleTuples--;
+      }
+      if (numBits <= ransNumAvailableBits && (numSampleTuples > bestNumSampleTuples || (numSampleTuples == bestNumSampleTuples && numBits - adaptiveFlagNumBits < bestNumBits))) {
+        bestRANS = true;
+        bestAdaptive = false;
+        bestNumSampleTuples = numSampleTuples;
+        bestNumBits = numBits - adaptiveFlagNumBits;
+      }
+    }
+
+    // A block shorter than minNumSampleTuples is replaced by a lossy block. The choice above does not depend on minNumSampleTuples.
+    // CHMODE_MSB blocks of MLAC24BitFormat are lossy.
+    int numLosslessSampleTuples = (bestChMode == CHMODE_MSB) ? (Format::LOW_NUM_BITS ? 0 : Format::chModeMSBNumSampleTuples(16)) : bestNumSampleTuples - blockStart;
+    if (numLosslessSampleTuples < minNumSampleTuples) {
+      return encodeLossy(input, output, timeStamp, minNumSampleTuples, maxNumSampleTuples, numSampleTuplesWritten, numBitsWritten);
+    }
+
+    // Write time stamp
+    if (bestChMode == CHMODE_MSB) {
+      bestNumSampleTuples = Format::chModeMSBNumSampleTuples(trueBitDepth);
+      if (bestNumSampleTuples > maxNumSampleTuples) {
+        bestNumSampleTuples = maxNumSampleTuples;
+      }
+      return encodeMSB(input, output, timeStamp, trueBitDepth, bestNumSampleTuples, numSampleTuplesWritten, numBitsWritten);
+    }
+    bestNumSampleTuples -= blockStart;
+    timeStamp = bestNumSampleTuples; // Fake it! ***    
+    writer.write(timeStamp, 8);
+    // Write channel mode
+    writer.write(bestChMode, Format::CHMODE_NUM_BITS);
+    // Write continuation flag
+    writer.write(continuation, 1);
+    if (continuation) {
+      // Write coefficient reuse flag
+      writer.write(bestCoefCoding == COEF_CODING_REUSE, 1);
+    } else {
+      // Write independent channel warmup
+      writer.writeExpGolombLike(x[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(x[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      // Write dependent channel warmup
+      if (STEREO) {
+        writer.writeExpGolombLike(y[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(y[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      }
+    }
+    bool highOrderCoefs = bestCoefCoding != COEF_CODING_REUSE && bestc.order != NUM_LP_COEFS;
+    if (bestCoefCoding != COEF_CODING_REUSE && Format::MAX_LP_ORDER > NUM_LP_COEFS) {
+      // Write prediction order
+      writer.write(bestc.order != NUM_LP_COEFS, 1);
+      if (bestc.order != NUM_LP_COEFS) {
+        writer.write(bestc.order - NUM_LP_COEFS - 1, LP_ORDER_NUM_BITS);
+      }
+    }
+    if (Format::RANS_RESIDUALS) {
+      // Write rANS residual coding flag
+      writer.write(bestRANS, 1);
+    }
+    if (Format::ADAPTIVE_RESIDUALS && !bestRANS) {
+      // Write adaptive residual coding flag
+      writer.write(bestAdaptive, 1);
+    }
+    // Write independent channel exp-Golomb-like parameter or rANS raw number of bits and table, and coefficients
+    if (bestRANS) {
+      writer.write(xrRANS.rawNumBits, RANS_RAW_NUM_BITS_NUM_BITS);
+      writer.write(xrRANS.table, RANS_TABLE_NUM_BITS);
+    } else {
+      writer.writeResidualExpGolombLikeParameter(bestxrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    }
+    if (highOrderCoefs) {
+      for (int k = 1; k <= bestc.order; k++) {
+        writer.writeExpGolombLike(bestc.xcn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
+      }
+    } else if (bestCoefCoding == COEF_CODING_INDEPENDENT) {
+      writer.writeExpGolombLike(bestc.xc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(bestc.xc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+    } else if (bestCoefCoding == COEF_CODING_DELTA) {
+      writer.writeExpGolombLike(bestc.xc1-stream.c.xc1, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(bestc.xc2-stream.c.xc2, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+    }
+    // Write dependent channel exp-Golomb-like parameter or rANS raw number of bits and table, and coefficients
+    if (STEREO) {
+      if (bestRANS) {
+        writer.write(ydrRANS.rawNumBits, RANS_RAW_NUM_BITS_NUM_BITS);
+        writer.write(ydrRANS.table, RANS_TABLE_NUM_BITS);
+      } else {
+        writer.writeResidualExpGolombLikeParameter(bestydrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+      }
+      if (highOrderCoefs) {
+        for (int k = 0; k <= bestc.order; k++) {
+          writer.writeExpGolombLike(bestc.ycn[k], Format::HIGH_ORDER_COEF_EXPGOLOMBLIKE_PARAMETER);
+        }
+      } else if (bestCoefCoding == COEF_CODING_INDEPENDENT) {
+        writer.writeExpGolombLike(bestc.yc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(bestc.yc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);      
+        writer.writeExpGolombLike(bestc.yd0-Format::D0_BIAS, Format::D0_EXPGOLOMBLIKE_PARAMETER);      
+      } else if (bestCoefCoding == COEF_CODING_DELTA) {
+        writer.writeExpGolombLike(bestc.yc1-stream.c.yc1, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(bestc.yc2-stream.c.yc2, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+        writer.writeExpGolombLike(bestc.yd0-stream.c.yd0, Format::COEF_DELTA_EXPGOLOMBLIKE_PARAMETER);
+      }
+    }
+    // Write audio data residues
+    if (bestRANS) {
+      writer.write(xrRANS.state & bitMasks[RANS_PROB_BITS], RANS_PROB_BITS);
+      if (STEREO) {
+        writer.write(ydrRANS.state & bitMasks[RANS_PROB_BITS], RANS_PROB_BITS);
+      }
+      for (int k = numRANSChunks - 1; k >= 0; k--) {
+        writer.write(ransBits[k], ransChunkNumBits[k]);
+      }
+    } else if (bestAdaptive) {
+      writeResiduals(writer, blockStart + bestNumSampleTuples, AdaptiveExpGolombLikeParameter<Format>(bestxrExpGolombLikeParameter), AdaptiveExpGolombLikeParameter<Format>(STEREO ? bestydrExpGolombLikeParameter : bestxrExpGolombLikeParameter));
+    } else {
+      writeResiduals(writer, blockStart + bestNumSampleTuples, FixedExpGolombLikeParameter(bestxrExpGolombLikeParameter), FixedExpGolombLikeParameter(bestydrExpGolombLikeParameter));
+    }
+    if (Format::LOW_NUM_BITS) {
+      // Write shift, number of low bits and low bits
+      writer.write(lowShift, LOW_NUM_BITS_NUM_BITS);
+      writer.write(lowNumBits, LOW_NUM_BITS_NUM_BITS);
+      for (int i = 0; lowNumBits && i < bestNumSampleTuples*NUM_CHANNELS; i++) {
+        writer.write((low[i] & bitMasks[lowShift]) >> numZeroLowBits, lowNumBits);
+      }
+    }
+    // Update what the decoder knows
+    stream.c = bestc;
+    stream.update(&predicted[(bestNumSampleTuples - NUM_LP_COEFS - 1)*NUM_CHANNELS], NUM_CHANNELS);
+    stream.lowShift = lowShift;
+    if (continuation) {
+      numBlocksSinceIndependent++;
+    } else {
+      stream.valid = true;
+      numBlocksSinceIndependent = 0;
+    }
+    numSampleTuplesWritten = bestNumSampleTuples;
+    numBitsWritten = writer.numBitsWritten;
+    return trueBitDepth + Format::LOW_NUM_BITS;
+  }
+};
+
+// Encoder of independent blocks for devices with little RAM. It keeps no buffers: the delta values and residuals of a block are
+// calculated from the input as they are needed, in a pass that sums the correlations for the coefficients, a pass that finds how many
+// sample tuples fit and a pass that writes them, and lossy blocks are written the same way. The instance holds only its options, and a
+// call needs under 2 kB of stack. The blocks are the same as those of MLACBasicEncoder::encode at effort EFFORT_FASTEST, except that
+// formats with adaptive or rANS residuals get only blocks with fixed exp-Golomb-like parameters. MLAC24BitFormat is not supported.
+template <class Format>
+class MLACBasicCompactEncoder {
+  typedef MLACBasicEncoder<Format> Encoder;
+  typedef typename Encoder::FitSums FitSums;
+  static const int BLOCK_NUM_BYTES = Format::BLOCK_NUM_BYTES;
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  static const int BLOCK_MIN_NUM_SAMPLETUPLES = Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+  static const int NUM_CHANNELS = Format::NUM_CHANNELS;
+  static const bool STEREO = NUM_CHANNELS == 2;
+  static_assert(Format::LOW_NUM_BITS == 0, "The low bits of MLAC24BitFormat need MLACBasicEncoder");
+
+  // Delta values of sample tuple i of the input in the independent (x) and dependent (y) channel of chMode. Sample tuple 0 is the
+  // first sample tuple itself, the warmup of an independent block. The dependent channel of mono is silent.
+  static void deltas(const int16_t *input, int chMode, int i, int16_t &x, int16_t &y) {
+    int16_t left = input[i*NUM_CHANNELS];
+    int16_t right = STEREO ? input[i*2 + 1] : 0;
+    if (i > 0) {
+      left -= input[(i - 1)*NUM_CHANNELS];
+      if (STEREO) {
+        right -= input[(i - 1)*2 + 1];
+      }
+    }
+    if (chMode == CHMODE_DEPENDENT_AND_INDEPENDENT) {
+      x = right;
+      y = left;
+    } else {
+      if (chMode == CHMODE_MID_AND_SIDE) {
+        midSide(left, right);
+      }
+      x = left;
+      y = right;
+    }
+  }
+
+  // Linear prediction of the delta values of the input in the channels of chMode with the coefficients c, a sample tuple at a time
+  struct Predictor {
+    const int16_t *input;
+    int chMode;
+    const LPCoefs &c;
+    int16_t xm2, xm1, ym2, ym1; // Delta values of the two previous sample tuples
+    Predictor(const int16_t *input, int chMode, const LPCoefs &c): input(input), chMode(chMode), c(c) {
+      deltas(input, chMode, 0, xm2, ym2);
+      deltas(input, chMode, 1, xm1, ym1);
+    }
+    // Residuals of sample tuple i, which must be NUM_LP_COEFS on the first call and one more on each call after it
+    void residuals(int i, int16_t &xr, int16_t &ydr) {
+      int16_t x, y;
+      deltas(input, chMode, i, x, y);
+      xr = x - predict<Format>(xm2, c.xc2, xm1, c.xc1);
+      ydr = STEREO ? (int16_t)(y - predict<Format>(ym2, c.yc2, ym1, c.yc1, x, c.yd0)) : 0;
+      xm2 = xm1;
+      xm1 = x;
+      ym2 = ym1;
+      ym1 = y;
+    }
+  };
+
+  // Encode a lossy block in place of a lossless block shorter than minNumSampleTuples, the same way as MLACBasicEncoder::encodeLossy
+  int encodeLossy(const int16_t *input, uint8_t *output, uint8_t timeStamp, int minNumSampleTuples, int maxNumSampleTuples, int &numSampleTuplesWritten, int &numBitsWritten) {
+    int trueBitDepth = 16;
+    for (; trueBitDepth > 8; trueBitDepth--) {
+      if (Format::chModeMSBNumSampleTuples(trueBitDepth) >= minNumSampleTuples) break;
+    }
+    LPCoefs c;
+    int16_t lastSampleTuples[(NUM_LP_COEFS + 1)*2];
+    int nearLosslessBitDepth = Encoder::writeNearLossless(input, output, timeStamp, minNumSampleTuples, trueBitDepth + 1, c, lastSampleTuples, numBitsWritten);
+    if (nearLosslessBitDepth) {
+      numSampleTuplesWritten = minNumSampleTuples;
+      return nearLosslessBitDepth;
+    }
+    int numSampleTuples = Format::chModeMSBNumSampleTuples(trueBitDepth);
+    if (numSampleTuples > maxNumSampleTuples) {
+      numSampleTuples = maxNumSampleTuples;
+    }
+    numBitsWritten = Encoder::writeMSB(input, output, timeStamp, trueBitDepth, numSampleTuples);
+    numSampleTuplesWritten = numSampleTuples;
+    return trueBitDepth;
+  }
+
+public:
+  // Maximum number of sample tuples of a block, as MLACBasicEncoder::blockMaxNumSampleTuples. Can be changed between calls.
+  int blockMaxNumSampleTuples;
+
+  MLACBasicCompactEncoder(): blockMaxNumSampleTuples(BLOCK_MAX_NUM_SAMPLETUPLES) {
+  }
+
+  // MLAC encode an independent block. Arguments and return values are the same as of MLACBasicEncoder::encode, and so is the output
+  // at effort EFFORT_FASTEST.
+  int encode(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    int maxNumSampleTuples = blockMaxNumSampleTuples;
+    if (minNumSampleTuples > maxNumSampleTuples) {
+      minNumSampleTuples = maxNumSampleTuples;
+    }
+    if (Encoder::numConstantSampleTuples(input, maxNumSampleTuples) == maxNumSampleTuples) {
+      numBitsWritten = Encoder::writeConstantRun(input, output, timeStamp, maxNumSampleTuples);
+      numSampleTuplesWritten = maxNumSampleTuples;
+      return 16;
+    }
+
+    // Correlation sums of the left (x) and right (y) channel delta values of the first fit, of BLOCK_MIN_NUM_SAMPLETUPLES + 1 sample tuples
+    int fitEnd = BLOCK_MIN_NUM_SAMPLETUPLES + 1;
+    FitSums lr = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    int16_t left[3], right[3];
+    deltas(input, CHMODE_INDEPENDENT_AND_DEPENDENT, 0, left[0], right[0]);
+    deltas(input, CHMODE_INDEPENDENT_AND_DEPENDENT, 1, left[1], right[1]);
+    for (int j = 0; j < fitEnd - NUM_LP_COEFS; j++) {
+      deltas(input, CHMODE_INDEPENDENT_AND_DEPENDENT, j + 2, left[2], right[2]);
+      lr.x0x0 += left[0]*(int32_t)left[0];
+      lr.x1x1 += left[1]*(int32_t)left[1];
+      lr.x0x1 += left[0]*(int32_t)left[1];
+      lr.x0x2 += left[0]*(int32_t)left[2];
+      lr.x1x2 += left[1]*(int32_t)left[2];
+      lr.x2x2 += left[2]*(int32_t)left[2];
+      if (STEREO) {
+        lr.y0y0 += right[0]*(int32_t)right[0];
+        lr.y1y1 += right[1]*(int32_t)right[1];
+        lr.y0y1 += right[0]*(int32_t)right[1];
+        lr.y0y2 += right[0]*(int32_t)right[2];
+        lr.y1y2 += right[1]*(int32_t)right[2];
+        lr.y2y2 += right[2]*(int32_t)right[2];
+        lr.x2y2 += left[2]*(int32_t)right[2];
+        lr.y1x2 += right[1]*(int32_t)left[2];
+        lr.y0x2 += right[0]*(int32_t)left[2];
+        lr.x1y2 += left[1]*(int32_t)right[2];
+        lr.x0y2 += left[0]*(int32_t)right[2];
+      }
+      for (int k = 0; k < 2; k++) {
+        left[k] = left[k + 1];
+        right[k] = right[k + 1];
+      }
+    }
+    const int xCoefMins[2] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS};
+    const int xCoefMaxs[2] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS};
+    const int yCoefMins[3] = {C1_MIN + Format::C1_BIAS, C2_MIN + Format::C2_BIAS, D0_MIN + Format::D0_BIAS};
+    const int yCoefMaxs[3] = {C1_MAX + Format::C1_BIAS, C2_MAX + Format::C2_BIAS, D0_MAX + Format::D0_BIAS};
+    LPCoefs c;
+    int chMode = Encoder::chooseChMode(c, lr, fitEnd - NUM_LP_COEFS, xCoefMins, xCoefMaxs, yCoefMins, yCoefMaxs);
+    int16_t xWarmup[2], yWarmup[2];
+    deltas(input, chMode, 0, xWarmup[0], yWarmup[0]);
+    deltas(input, chMode, 1, xWarmup[1], yWarmup[1]);
+    int numAvailableBits = BLOCK_NUM_BYTES*8 - (8 + Format::CHMODE_NUM_BITS + 1 + (Format::RANS_RESIDUALS ? 1 : 0) + (Format::ADAPTIVE_RESIDUALS ? 1 : 0))
+      - valueToExpGolombLikeNumBits16(xWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) - valueToExpGolombLikeNumBits16(xWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    if (STEREO) {
+      numAvailableBits -= valueToExpGolombLikeNumBits16(yWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER) + valueToExpGolombLikeNumBits16(yWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    }
+
+    // Choose the exp-Golomb-like parameters for the residuals of the first fit, and extend the block with them as far as it fits
+    int xrBitDepthCounts[17 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] = {0};
+    int ydrBitDepthCounts[17 - RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER] = {0};
+    Predictor predictor(input, chMode, c);
+    for (int i = NUM_LP_COEFS; i < fitEnd; i++) {
+      int16_t xr, ydr;
+      predictor.residuals(i, xr, ydr);
+      xrBitDepthCounts[bitDepth16(xr, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]++;
+      if (STEREO) {
+        ydrBitDepthCounts[bitDepth16(ydr, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) - Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER]++;
+      }
+    }
+    int xrNumBits, ydrNumBits = 0;
+    int xrExpGolombLikeParameter = bestExpGolombLikeParameter16(xrBitDepthCounts, xrNumBits, fitEnd - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    int ydrExpGolombLikeParameter = STEREO ? bestExpGolombLikeParameter16(ydrBitDepthCounts, ydrNumBits, fitEnd - NUM_LP_COEFS, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER) : Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER;
+    int numBits = xrNumBits + independentSideInfoNumBits<Format>(c, xrExpGolombLikeParameter, COEF_CODING_INDEPENDENT, c) + ydrNumBits + dependentSideInfoNumBits<Format>(c, ydrExpGolombLikeParameter, COEF_CODING_INDEPENDENT, c);
+    int numSampleTuples = 0; // Of the linear prediction block, 0 if none fits
+    if (numBits <= numAvailableBits) {
+      numSampleTuples = fitEnd;
+      for (int i = fitEnd; i < maxNumSampleTuples; i++) {
+        int16_t xr, ydr;
+        predictor.residuals(i, xr, ydr);
+        numBits += valueToExpGolombLikeNumBits16(xr, xrExpGolombLikeParameter) + (STEREO ? valueToExpGolombLikeNumBits16(ydr, ydrExpGolombLikeParameter) : 0);
+        if (numBits > numAvailableBits) {
+          break;
+        }
+        numSampleTuples = i + 1;
+      }
+    }
+
+    // A block shorter than minNumSampleTuples is replaced by a lossy block
+    if ((numSampleTuples ? numSampleTuples : Format::chModeMSBNumSampleTuples(16)) < minNumSampleTuples) {
+      return encodeLossy(input, output, timeStamp, minNumSampleTuples, maxNumSampleTuples, numSampleTuplesWritten, numBitsWritten);
+    }
+    if (!numSampleTuples) {
+      numSampleTuples = (Format::chModeMSBNumSampleTuples(16) < maxNumSampleTuples) ? Format::chModeMSBNumSampleTuples(16) : maxNumSampleTuples;
+      numBitsWritten = Encoder::writeMSB(input, output, timeStamp, 16, numSampleTuples);
+      numSampleTuplesWritten = numSampleTuples;
+      return 16;
+    }
+
+    BitStreamWriter writer(output);
+    timeStamp = numSampleTuples; // Fake it! ***
+    writer.write(timeStamp, 8);
+    writer.write(chMode, Format::CHMODE_NUM_BITS);
+    // Write continuation flag and warmup
+    writer.write(0, 1);
+    writer.writeExpGolombLike(xWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    writer.writeExpGolombLike(xWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    if (STEREO) {
+      writer.writeExpGolombLike(yWarmup[0], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(yWarmup[1], Format::WARMUP_EXPGOLOMBLIKE_PARAMETER);
+    }
+    // Write prediction order, rANS and adaptive residual coding flags, of which none is used
+    if (Format::MAX_LP_ORDER > NUM_LP_COEFS) {
+      writer.write(0, 1);
+    }
+    if (Format::RANS_RESIDUALS) {
+      writer.write(0, 1);
+    }
+    if (Format::ADAPTIVE_RESIDUALS) {
+      writer.write(0, 1);
+    }
+    // Write exp-Golomb-like parameters and coefficients
+    writer.writeResidualExpGolombLikeParameter(xrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+    writer.writeExpGolombLike(c.xc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+    writer.writeExpGolombLike(c.xc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+    if (STEREO) {
+      writer.writeResidualExpGolombLikeParameter(ydrExpGolombLikeParameter, Format::RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER);
+      writer.writeExpGolombLike(c.yc1-Format::C1_BIAS, Format::C1_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(c.yc2-Format::C2_BIAS, Format::C2_EXPGOLOMBLIKE_PARAMETER);
+      writer.writeExpGolombLike(c.yd0-Format::D0_BIAS, Format::D0_EXPGOLOMBLIKE_PARAMETER);
+    }
+    // Write audio data residues, predicted again
+    Predictor writePredictor(input, chMode, c);
+    for (int i = NUM_LP_COEFS; i < numSampleTuples; i++) {
+      int16_t xr, ydr;
+      writePredictor.residuals(i, xr, ydr);
+      writer.writeExpGolombLike(xr, xrExpGolombLikeParameter);
+      if (STEREO) {
+        writer.writeExpGolombLike(ydr, ydrExpGolombLikeParameter);
+      }
+    }
+    numSampleTuplesWritten = numSampleTuples;
+    numBitsWritten = writer.numBitsWritten;
+    return 16;
+  }
+};
+
+// Encoder of a bitrate ladder: the same input as independent blocks at several minimum numbers of sample tuples per block (rungs),
+// one block stream per rung. The lossless block that encodeBlock searches for does not depend on the minimum, so rungs whose next block
+// starts at the same sample tuple share the search. It is run once, at the smallest minimum of those rungs, and a rung that the
+// lossless block is too short for gets a lossy block of its own minimum without a search. The output of each rung is the same as
+// that of a separate MLACBasicEncoder::encode. Rungs stay at the same position as long as the lossless blocks are long enough for
+// all of them, and drift apart where some of them need lossy blocks.
+template <class Format, int numRungs>
+class MLACBasicLadderEncoder {
+  typedef MLACBasicEncoder<Format> Encoder;
+  static const int BLOCK_NUM_BYTES = Format::BLOCK_NUM_BYTES;
+  static const int BLOCK_MAX_NUM_SAMPLETUPLES = Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+
+public:
+  // Encoder of all rungs. Set the options here.
+  Encoder encoder;
+
+  // MLAC encode a block of each rung. The arguments and return values are arrays of those of MLACBasicEncoder::encode, one element
+  // per rung, and so is the output. The input of each rung is at the position of that rung in the common input.
+  void encode(const int16_t *const *inputs, uint8_t *const *outputs, const uint8_t *timeStamps, const int *minNumSampleTuples, int *numSampleTuplesWritten, int *numBitsWritten, int *trueBitDepths) {
+    bool done[numRungs] = {};
+    for (int rung = 0; rung < numRungs; rung++) {
+      if (done[rung]) {
+        continue;
+      }
+      // Search with the smallest minimum of the rungs at the same position
+      int first = rung;
+      for (int other = rung + 1; other < numRungs; other++) {
+        if (inputs[other] == inputs[rung] && minNumSampleTuples[other] < minNumSampleTuples[first]) {
+          first = other;
+        }
+      }
+      trueBitDepths[first] = encoder.encode(inputs[first], outputs[first], timeStamps[first], numSampleTuplesWritten[first], numBitsWritten[first], minNumSampleTuples[first]);
+      done[first] = true;
+      for (int other = rung; other < numRungs; other++) {
+        if (done[other] || inputs[other] != inputs[first]) {
+          continue;
+        }
+        if (encoder.frameNumSampleTuples || minNumSampleTuples[other] == minNumSampleTuples[first] || (trueBitDepths[first] == 16 + Format::LOW_NUM_BITS && numSampleTuplesWritten[first] >= minNumSampleTuples[other])) {
+          // The same block
+          for (int i = 0; i < BLOCK_NUM_BYTES; i++) {
+            outputs[other][i] = outputs[first][i];
+          }
+          trueBitDepths[other] = trueBitDepths[first];
+          numSampleTuplesWritten[other] = numSampleTuplesWritten[first];
+          numBitsWritten[other] = numBitsWritten[first];
+        } else {
+          trueBitDepths[other] = encoder.encodeLossy(inputs[other], outputs[other], timeStamps[other], minNumSampleTuples[other], encoder.blockMaxNumSampleTuples, numSampleTuplesWritten[other], numBitsWritten[other]);
+        }
+        done[other] = true;
+      }
+    }
+  }
+};
+
+// Encoder of interleaved audio of numChannels channels, at least 2. Channels 2k and 2k + 1 are coded as the left and right channel of
+// stereo stream k, with cross-channel prediction within the pair, and if numChannels is odd, the last channel is coded as a mono stream.
+// The streams advance at their own pace, and their blocks are multiplexed in the order of nextStream, which the decoder follows too.
+template <class Format, int numChannels>
+class MLACBasicMultiChannelEncoder {
+  static_assert(numChannels >= 2, "Use MLACBasicEncoder of MLACMonoFormat for mono");
+  static const int BLOCK_MIN_NUM_SAMPLETUPLES = Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+
+  // Input of the channels of a stream, from sample tuple positions[stream] on
+  MLACInput<int16_t> streamInput(int stream, const int16_t *input) {
+    MLACInput<int16_t> channels = {&input[stream*2], &input[stream*2 + 1], numChannels, 0};
+    return channels;
+  }
+
+public:
+  static const int NUM_PAIRS = numChannels/2;
+  static const int NUM_STREAMS = (numChannels + 1)/2;
+
+  // Encoders of the channel pairs and of the last channel of an odd numChannels, unused otherwise. Set the options of each stream here.
+  MLACBasicEncoder<Format> pairs[NUM_PAIRS];
+  MLACBasicEncoder<MLACMonoFormat<Format> > last;
+
+  // Number of sample tuples encoded by each stream
+  long positions[NUM_STREAMS];
+
+  MLACBasicMultiChannelEncoder() {
+    restartStream();
+  }
+
+  // Start new streams from sample tuple 0
+  void restartStream() {
+    for (int stream = 0; stream < NUM_STREAMS; stream++) {
+      positions[stream] = 0;
+    }
+    for (int pair = 0; pair < NUM_PAIRS; pair++) {
+      pairs[pair].restartStream();
+    }
+    last.restartStream();
+  }
+
+  // The stream whose next block is encoded or decoded next: the one that is furthest behind, the lowest of those on ties
+  int nextStream() const {
+    int next = 0;
+    for (int stream = 1; stream < NUM_STREAMS; stream++) {
+      if (positions[stream] < positions[next]) {
+        next = stream;
+      }
+    }
+    return next;
+  }
+
+  // MLAC encode the next block of the stream of nextStream. input = pointer to sample tuple positions[nextStream()] of interleaved 16-bit
+  // audio of numChannels channels, with at least BLOCK_MAX_NUM_SAMPLETUPLES sample tuples from there on. The other arguments and the return
+  // values are the same as of MLACBasicEncoder::encodeNext, and stream returns the stream of the block.
+  int encodeNext(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &stream, int &numSampleTuplesWritten, int &numBitsWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    stream = nextStream();
+    int trueBitDepth = (stream < NUM_PAIRS) ? pairs[stream].encodeNext(streamInput(stream, input), output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples)
+      : last.encodeNext(streamInput(stream, input), output, timeStamp, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+    positions[stream] += numSampleTuplesWritten;
+    return trueBitDepth;
+  }
+
+  // Same as encodeNext, as a variable-length packet of MLACBasicEncoder::encodeNextVariableLength
+  int encodeNextVariableLength(const int16_t *input, uint8_t *output, uint8_t timeStamp, int &stream, int &numSampleTuplesWritten, int &numBytesWritten, int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES) {
+    stream = nextStream();
+    int trueBitDepth = (stream < NUM_PAIRS) ? pairs[stream].encodeNextVariableLength(streamInput(stream, input), output, timeStamp, numSampleTuplesWritten, numBytesWritten, minNumSampleTuples)
+      : last.encodeNextVariableLength(streamInput(stream, input), output, timeStamp, numSampleTuplesWritten, numBytesWritten, minNumSampleTuples);
+    positions[stream] += numSampleTuplesWritten;
+    return trueBitDepth;
+  }
+};
+
+// Decoder of the blocks of MLACBasicMultiChannelEncoder, in the same order
+template <class Format, int numChannels>
+class MLACBasicMultiChannelDecoder {
+  static_assert(numChannels >= 2, "Use MLACBasicDecoder of MLACMonoFormat for mono");
+
+  // Output to the channels of a stream, from sample tuple positions[stream] on
+  MLACOutput<int16_t> streamOutput(int stream, int16_t *output) {
+    MLACOutput<int16_t> channels = {&output[stream*2], &output[stream*2 + 1], numChannels, 0};
+    return channels;
+  }
+
+public:
+  static const int NUM_PAIRS = numChannels/2;
+  static const int NUM_STREAMS = (numChannels + 1)/2;
+
+  MLACBasicDecoder<Format> pairs[NUM_PAIRS];
+  MLACBasicDecoder<MLACMonoFormat<Format> > last;
+
+  // Number of sample tuples decoded by each stream
+  long positions[NUM_STREAMS];
+
+  MLACBasicMultiChannelDecoder() {
+    restartStream();
+  }
+
+  // Start new streams from sample tuple 0, as after MLACBasicMultiChannelEncoder::restartStream
+  void restartStream() {
+    for (int stream = 0; stream < NUM_STREAMS; stream++) {
+      positions[stream] = 0;
+    }
+    for (int pair = 0; pair < NUM_PAIRS; pair++) {
+      pairs[pair].restartStream();
+    }
+    last.restartStream();
+  }
+
+  // Same as MLACBasicMultiChannelEncoder::nextStream
+  int nextStream() const {
+    int next = 0;
+    for (int stream = 1; stream < NUM_STREAMS; stream++) {
+      if (positions[stream] < positions[next]) {
+        next = stream;
+      }
+    }
+    return next;
+  }
+
+  // MLAC decode the next block, of the stream of nextStream. output = pointer to sample tuple positions[nextStream()] of interleaved 16-bit
+  // audio of numChannels channels, with room for BLOCK_MAX_NUM_SAMPLETUPLES sample tuples from there on. Only the channels of the stream
+  // are written. The other arguments and the return values are the same as of MLACBasicDecoder::decode, and stream returns the stream of
+  // the block.
+  int decode(const uint8_t *input, int16_t *output, uint8_t &timeStamp, int &stream, int &numSampleTuplesRead, int numBytes = Format::BLOCK_NUM_BYTES) {
+    stream = nextStream();
+    int trueBitDepth = (stream < NUM_PAIRS) ? pairs[stream].decode(input, streamOutput(stream, output), timeStamp, numSampleTuplesRead, numBytes)
+      : last.decode(input, streamOutput(stream, output), timeStamp, numSampleTuplesRead, numBytes);
+    positions[stream] += numSampleTuplesRead;
+    return trueBitDepth;
+  }
+
+  // Same as decode, for a variable-length packet of MLACBasicMultiChannelEncoder::encodeNextVariableLength
+  int decodeVariableLength(const uint8_t *input, int16_t *output, uint8_t &timeStamp, int &stream, int &numSampleTuplesRead, int &numBytesRead) {
+    stream = nextStream();
+    int trueBitDepth = (stream < NUM_PAIRS) ? pairs[stream].decodeVariableLength(input, streamOutput(stream, output), timeStamp, numSampleTuplesRead, numBytesRead)
+      : last.decodeVariableLength(input, streamOutput(stream, output), timeStamp, numSampleTuplesRead, numBytesRead);
+    positions[stream] += numSampleTuplesRead;
+    return trueBitDepth;
+  }
+};
+
+typedef MLACBasicDecoder<MLACDefaultFormat> MLACDecoder;
+typedef MLACBasicEncoder<MLACDefaultFormat> MLACEncoder;
+typedef MLACBasicCompactEncoder<MLACDefaultFormat> MLACCompactEncoder;
+typedef MLACBasicIncrementalDecoder<MLACDefaultFormat> MLACIncrementalDecoder;
+typedef MLACBasicDecoder<MLACMonoFormat<MLACDefaultFormat> > MLACMonoDecoder;
+typedef MLACBasicEncoder<MLACMonoFormat<MLACDefaultFormat> > MLACMonoEncoder;
@@ -3,7 +3,7 @@
 // Copyright 2020 Olli Niemitalo (o@iki.fi)
 //
 // Input.wav will be read.
-// Output.mlac will be written.
+// Output.mlac will be written, as variable-length packets.
 // Output.wav will be written.
 //
 // For Emacs: -*- compile-command: "make -C .. transcode" -*-
@@ -37,14 +37,71 @@ class StereoFIFO {
   }
 };
 
+// Transcode mono audio losslessly. Returns the number of sample tuples transcoded.
+long int transcodeMono(short *inBuf, short *outBuf, long int totalNumSampleTuples, std::ofstream &mlacFile, int effort, int independentBlockInterval, long int &numMLACFileBytes, int &numBlocks) {
+  uint8_t encodeBuf[MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES];
+  MLACMonoEncoder mlacEncoder;
+  MLACMonoDecoder mlacDecoder;
+  mlacEncoder.effort = effort;
+  mlacEncoder.independentBlockInterval = independentBlockInterval;
+  long int i;
+  for (i = 0; i < totalNumSampleTuples - MLAC_BLOCK_MAX_NUM_SAMPLETUPLES;) {
+    int numSampleTuplesWritten;
+    int numBytesWritten;
+    mlacEncoder.encodeNextVariableLength((int16_t *)&inBuf[i], encodeBuf, 0, numSampleTuplesWritten, numBytesWritten);
+    mlacFile.write((char *)encodeBuf, numBytesWritten);
+    numMLACFileBytes += numBytesWritten;
+    uint8_t compareTimeStamp;
+    int compareNumSampleTuples;
+    int compareNumBytes;
+    mlacDecoder.decodeVariableLength(encodeBuf, (int16_t *)&outBuf[i], compareTimeStamp, compareNumSampleTuples, compareNumBytes);
+    i += numSampleTuplesWritten;
+    numBlocks++;
+  }
+  return i;
+}
+
+// Transcode audio of more than 2 channels losslessly, as streams of channel pairs. Returns the number of sample tuples transcoded.
+template <int numChannels>
+long int transcodeMultiChannel(short *inBuf, short *outBuf, long int totalNumSampleTuples, std::ofstream &mlacFile, int effort, int independentBlockInterval, long int &numMLACFileBytes, int &numBlocks) {
+  uint8_t encodeBuf[MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES];
+  MLACBasicMultiChannelEncoder<MLACDefaultFormat, numChannels> mlacEncoder;
+  MLACBasicMultiChannelDecoder<MLACDefaultFormat, numChannels> mlacDecoder;
+  for (int pair = 0; pair < mlacEncoder.NUM_PAIRS; pair++) {
+    mlacEncoder.pairs[pair].effort = effort;
+    mlacEncoder.pairs[pair].independentBlockInterval = independentBlockInterval;
+  }
+  mlacEncoder.last.effort = effort;
+  mlacEncoder.last.independentBlockInterval = independentBlockInterval;
+  for (;;) {
+    long int i = mlacEncoder.positions[mlacEncoder.nextStream()];
+    if (i >= totalNumSampleTuples - MLAC_BLOCK_MAX_NUM_SAMPLETUPLES) {
+      return i;
+    }
+    int stream;
+    int numSampleTuplesWritten;
+    int numBytesWritten;
+    mlacEncoder.encodeNextVariableLength((int16_t *)&inBuf[i*numChannels], encodeBuf, 0, stream, numSampleTuplesWritten, numBytesWritten);
+    mlacFile.write((char *)encodeBuf, numBytesWritten);
+    numMLACFileBytes += numBytesWritten;
+    uint8_t compareTimeStamp;
+    int compareNumSampleTuples;
+    int compareNumBytes;
+    mlacDecoder.decodeVariableLength(encodeBuf, (int16_t *)&outBuf[mlacDecoder.positions[stream]*numChannels], compareTimeStamp, stream, compareNumSampleTuples, compareNumBytes);
+    numBlocks++;
+  }
+}
+
 int main (int argc, char *argv[]) {
   bool info = true;
 
   int latency_ms = 100;
   int bitrate_kbps = 1500;
+  int effort = EFFORT_DEFAULT;
+  int independentBlockInterval = 1;
     
   if (argc < 3) {
-    printf("Usage: %s input.wav output.wav [bitrate_kbps] [latency_ms]\n", argv[0]);
+    printf("Usage: %s input.wav output.wav [bitrate_kbps] [latency_ms] [effort] [independent_block_interval]\n", argv[0]);
     return 1;
   }
   if (argc >= 4) {
@@ -53,8 +110,16 @@ int main (int argc, char *argv[]) {
   if (argc >= 5) {
     latency_ms = strToInt(argv[4]);
   }
+  if (argc >= 6) {
+    effort = strToInt(argv[5]);
+  }
+  if (argc >= 7) {
+    independentBlockInterval = strToInt(argv[6]);
+  }
   if (info) printf("Latency = %d ms\n", latency_ms);
   if (info) printf("Bitrate = %d kbps\n", bitrate_kbps);
+  if (info) printf("Effort = %d\n", effort);
+  if (info) printf("Independent block interval = %d\n", independentBlockInterval);
   SF_INFO sfInfo;
   SNDFILE *inputSndFile = sf_open(argv[1], SFM_READ, &sfInfo);
   if (!inputSndFile) {
@@ -66,8 +131,8 @@ int main (int argc, char *argv[]) {
   if (info) printf("Sampling frequency: %d Hz\n", sfInfo.samplerate);
   if (info) printf("Number of channels: %d\n", sfInfo.channels);
   if (info) printf("Format code: 0x%x\n", sfInfo.format);
-  if (sfInfo.channels != 2) {
-    printf("Error: input audio file must have %d channels", 2);
+  if (sfInfo.channels < 1 || sfInfo.channels > 8) {
+    printf("Error: input audio file must have 1 to %d channels", 8);
     return 1;
   }
   if (SHRT_MAX != 0x7fff) {
@@ -78,18 +143,21 @@ int main (int argc, char *argv[]) {
     printf("Error: C int must be 32-bit\n");
     return 1;
   }
-  short *inBuf = new short[totalNumSampleTuples*2];
-  sf_read_short(inputSndFile, inBuf, totalNumSampleTuples*2);
+  int numChannels = sfInfo.channels;
+  short *inBuf = new short[totalNumSampleTuples*numChannels];
+  sf_read_short(inputSndFile, inBuf, totalNumSampleTuples*numChannels);
   sf_close(inputSndFile);
   SNDFILE *outputSndFile = sf_open(argv[2], SFM_WRITE, &sfInfo);
   if (!outputSndFile) {
     printf("Error: could not open %s\n", argv[2]);
     return 1;
   }
-  short *outBuf = new short[totalNumSampleTuples*2];
-  uint8_t encodeBuf[MLAC_BLOCK_NUM_BYTES];
+  short *outBuf = new short[totalNumSampleTuples*numChannels];
+  uint8_t encodeBuf[MLAC_VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES];
   MLACEncoder mlacEncoder;
   MLACDecoder mlacDecoder;
+  mlacEncoder.effort = effort;
+  mlacEncoder.independentBlockInterval = independentBlockInterval;
 
   double requiredCompressionRate = 1411.2/bitrate_kbps;
   int requiredNumSampleTuples = ceil(MLAC_BLOCK_NUM_BYTES/4*requiredCompressionRate);
@@ -123,18 +191,39 @@ int main (int argc, char *argv[]) {
   char mlacFileName[65536];
   sprintf(mlacFileName, "%s_%dkbps.mlac", argv[2], bitrate_kbps);
   std::ofstream mlacFile(mlacFileName, std::ios::out | std::ios::binary);
-  
+  long int numMLACFileBytes = 0;
+
+  // Other than stereo is transcoded losslessly, without the rate control
+  if (numChannels != 2) {
+    switch (numChannels) {
+    case 1: i = transcodeMono(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    case 3: i = transcodeMultiChannel<3>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    case 4: i = transcodeMultiChannel<4>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    case 5: i = transcodeMultiChannel<5>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    case 6: i = transcodeMultiChannel<6>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    case 7: i = transcodeMultiChannel<7>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    default: i = transcodeMultiChannel<8>(inBuf, outBuf, totalNumSampleTuples, mlacFile, effort, independentBlockInterval, numMLACFileBytes, numBlocks); break;
+    }
+    if (info) printf("Blocks: %d\n", numBlocks);
+    if (info) printf("MLAC file: %ld bytes, %ld bytes as fixed-length packets\n", numMLACFileBytes, (long int)numBlocks*MLAC_BLOCK_NUM_BYTES);
+    sf_write_short(outputSndFile, outBuf, i*numChannels);
+    sf_close(outputSndFile);
+    return 0;
+  }
+
   for (i = 0; i < totalNumSampleTuples - MLAC_BLOCK_MAX_NUM_SAMPLETUPLES;) {    
       int numSampleTuplesWritten;
-      int numBitsWritten;
+      int numBytesWritten;
       int forkTopNumSampleTuples = MLAC_BLOCK_MAX_NUM_SAMPLETUPLES;
       int forkBottomNumSampleTuples = MLAC_BLOCK_MIN_NUM_SAMPLETUPLES;
       int forkNumSampleTuples = (MLAC_BLOCK_MAX_NUM_SAMPLETUPLES + MLAC_BLOCK_MIN_NUM_SAMPLETUPLES + 1) / 2;
-      int bitDepth = mlacEncoder.encode((int16_t *)&inBuf[i*2], encodeBuf, 0, numSampleTuplesWritten, numBitsWritten, requiredNumSampleTuples);
-      mlacFile.write((char *)encodeBuf, MLAC_BLOCK_NUM_BYTES);
+      int bitDepth = mlacEncoder.encodeNextVariableLength((int16_t *)&inBuf[i*2], encodeBuf, 0, numSampleTuplesWritten, numBytesWritten, requiredNumSampleTuples);
+      mlacFile.write((char *)encodeBuf, numBytesWritten);
+      numMLACFileBytes += numBytesWritten;
       uint8_t compareTimeStamp;
       int compareNumSampleTuples;
-      int trueBitDepth = mlacDecoder.decode(encodeBuf, &outBuf[i*2], compareTimeStamp, compareNumSampleTuples);
+      int compareNumBytes;
+      int trueBitDepth = mlacDecoder.decodeVariableLength(encodeBuf, &outBuf[i*2], compareTimeStamp, compareNumSampleTuples, compareNumBytes);
       if (trueBitDepth != 16) {
 	if (info) printf("lossy %ld %d %d\n", i, trueBitDepth, numSampleTuplesWritten);
       }
@@ -150,6 +239,7 @@ int main (int argc, char *argv[]) {
   }
   if (info) printf("Lossy blocks / total blocks: %d/%d = %f\n", numLossyBlocks, numBlocks, numLossyBlocks/(float)numBlocks);
   if (info) printf("Average bit depth: %f\n", (bitDepthAccu*10/i)/10.0);
+  if (info) printf("MLAC file: %ld bytes, %ld bytes as fixed-length packets\n", numMLACFileBytes, (long int)numBlocks*MLAC_BLOCK_NUM_BYTES);
   sf_write_short(outputSndFile, outBuf, i*2);
   sf_close(outputSndFile);
   return 0;
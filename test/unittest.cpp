@@ -7,6 +7,7 @@
 #include <climits>
 #include <cstdint>
 #include <stdio.h>
+#include <string.h>
 #include <sndfile.h>
 #include <math.h>
 #include <algorithm>
@@ -20,9 +21,34 @@
 #define UNITTEST_TOTAL_EXPGOLOMBLIKE_NUM_BITS_16
 #define UNITTEST_BEST_EXPGOLOMBLIKE_PARAMETER_16
 #define UNITTEST_EXPGOLOMBLIKE_CODE
+#define UNITTEST_FIXED_POINT_QUOTIENT
 #define UNITTEST_BITSTREAMWRITEREAD
 #define UNITTEST_BISTREAM_WRITE_READ_EXPGOLOMBLIKE
 #define UNITTEST_LOSSLESS_TRANSCODE
+#define UNITTEST_ENCODER_EFFORT
+#define UNITTEST_FORMATS
+#define UNITTEST_ENCODE_NEXT
+#define UNITTEST_STREAM_MODE
+#define UNITTEST_HIGH_ORDER
+#define UNITTEST_CHANNEL_MODES
+#define UNITTEST_ADAPTIVE_RESIDUALS
+#define UNITTEST_RANS_RESIDUALS
+#define UNITTEST_CONSTANT_RUN
+#define UNITTEST_LONG_BLOCKS
+#define UNITTEST_MAX_LENGTH
+#define UNITTEST_VARIABLE_LENGTH_PACKETS
+#define UNITTEST_NEAR_LOSSLESS
+#define UNITTEST_LOOKAHEAD
+#define UNITTEST_FIXED_FRAMES
+#define UNITTEST_ANYTIME
+#define UNITTEST_LADDER
+#define UNITTEST_COMPACT_ENCODER
+#define UNITTEST_CONVERTED_INPUT
+#define UNITTEST_CONVERTED_OUTPUT
+#define UNITTEST_MONO
+#define UNITTEST_MULTI_CHANNEL
+#define UNITTEST_24_BIT
+#define UNITTEST_INCREMENTAL_DECODING
 #define UNITTEST_BITSTREAM_WRITE_READ_RESIDUAL_EXPGOLOMBLIKE_PARAMETER
 
 // Speed tests, uncomment to enable
@@ -127,6 +153,430 @@ timespec timeDiff(timespec t0, timespec t1)
   return td;
 }
 
+// Random stereo impulses and sine waves, sometimes clipping
+static void randomTestAudio(int16_t *sourceBuf, int numSampleTuples) {
+  double *audioBuf = new double[numSampleTuples*2];
+  for (int i = 0; i < numSampleTuples; i++) {
+    audioBuf[i*2] = 0;
+    audioBuf[i*2 + 1] = 0;
+  }
+  // Stereo impulses
+  int numImpulses = rand()%10;
+  for (int j = 0; j < numImpulses; j++) {
+    int pos = rand()%numSampleTuples;
+    audioBuf[pos*2] += rand()/(RAND_MAX*2.0) - 0.5;
+    audioBuf[pos*2 + 1] += rand()/(RAND_MAX*2.0) - 0.5;
+  }
+  // Sine waves
+  int numSineWaves = rand()%10;
+  for (int j = 0; j < numSineWaves; j++) {
+    double phaseL = rand()/(double)RAND_MAX*M_PI;
+    double phaseR = rand()/(double)RAND_MAX*M_PI;
+    double ampL = rand()/(double)RAND_MAX;
+    double ampR = rand()/(double)RAND_MAX;
+    double w = rand()/(double)RAND_MAX*M_PI;
+    //      printf("phaseL=%f, phaseR=%f, ampL=%f, ampR=%f, w=%f\n", phaseL, phaseR, ampL, ampR, w);
+    for (int i = 0; i < numSampleTuples; i++) {
+      audioBuf[i*2] += sin(phaseL + i*w)*ampL;
+      audioBuf[i*2 + 1] += sin(phaseR + i*w)*ampR;
+    }
+  }
+  double peak = 0;
+  for (int i = 0; i < numSampleTuples; i++) {
+    if (peak < audioBuf[i*2]) {
+      peak = audioBuf[i*2];
+    }
+    if (peak < audioBuf[i*2 + 1]) {
+      peak = audioBuf[i*2 + 1];
+    }
+  }
+  double normFactor = pow(2, (rand()%1600)/100.0); // Will clip sometimes
+  for (int i = 0; i < numSampleTuples*2; i++) {
+    audioBuf[i] *= normFactor;
+    if (audioBuf[i] > 0x7fff) {
+      audioBuf[i] = 0x7fff;
+    }
+    if (audioBuf[i] < -0x8000) {
+      audioBuf[i] = -0x8000;
+    }
+    sourceBuf[i] = audioBuf[i];
+  }
+  delete[] audioBuf;
+}
+
+// Lossless transcode of random audio using the encoder and decoder of the given format. Returns true on pass.
+template <class Format>
+static bool formatTranscodeTest(int numTests) {
+  MLACBasicEncoder<Format> encoder;
+  MLACBasicDecoder<Format> decoder;
+  int16_t sourceBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*2];
+  uint8_t dataBuf[Format::BLOCK_NUM_BYTES];
+  int16_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*2];
+  for (int k = 0; k < numTests; k++) {
+    randomTestAudio(sourceBuf, Format::BLOCK_MAX_NUM_SAMPLETUPLES);
+    uint8_t timeStamp = 0;
+    int numSampleTuplesWritten;
+    int numBitsWritten;
+    int bitDepth = encoder.encode(sourceBuf, dataBuf, timeStamp, numSampleTuplesWritten, numBitsWritten);
+    int numSampleTuplesRead;
+    int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+    if (numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numSampleTuplesRead > Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+      printf("Error: BLOCK_NUM_BYTES=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, bitDepth=%d, decodedBitDepth=%d\n", Format::BLOCK_NUM_BYTES, numSampleTuplesWritten, numSampleTuplesRead, bitDepth, decodedBitDepth);
+      return false;
+    }
+    for (int i = 0; bitDepth == 16 && i < numSampleTuplesWritten*2; i++) {
+      if (destBuf[i] != sourceBuf[i]) {
+        printf("Error: BLOCK_NUM_BYTES=%d, i=%d, source: %d, dest: %d\n", Format::BLOCK_NUM_BYTES, i, sourceBuf[i], destBuf[i]);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Lossless stream mode round trip of random audio in the given format with all effort levels and different independent block intervals,
+// encoded with the given lookahead
+template <class Format>
+static bool formatStreamTest(int numTests, int lookaheadNumBlocks = 1) {
+  const int numSampleTuples = 10*Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+  MLACBasicEncoder<Format> encoder;
+  uint8_t dataBuf[Format::BLOCK_NUM_BYTES];
+  int16_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*2];
+  bool pass = true;
+  for (int k = 0; k < numTests && pass; k++) {
+    randomTestAudio(sourceBuf, numSampleTuples);
+    MLACBasicDecoder<Format> decoder;
+    encoder.effort = k % (EFFORT_MAX + 1);
+    encoder.independentBlockInterval = 1 + k % 8;
+    encoder.lookaheadNumBlocks = lookaheadNumBlocks;
+    encoder.restartStream();
+    for (int i = 0; i <= numSampleTuples - lookaheadNumBlocks*Format::BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      int bitDepth = encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      if (numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth) {
+        printf("Error: BLOCK_NUM_BYTES=%d, MAX_LP_ORDER=%d, k=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, bitDepth=%d, decodedBitDepth=%d\n", Format::BLOCK_NUM_BYTES, Format::MAX_LP_ORDER, k, numSampleTuplesWritten, numSampleTuplesRead, bitDepth, decodedBitDepth);
+        pass = false;
+      }
+      for (int j = 0; pass && bitDepth == 16 && j < numSampleTuplesWritten*2; j++) {
+        if (destBuf[j] != sourceBuf[i*2 + j]) {
+          printf("Error: BLOCK_NUM_BYTES=%d, MAX_LP_ORDER=%d, k=%d, i=%d, source: %d, dest: %d\n", Format::BLOCK_NUM_BYTES, Format::MAX_LP_ORDER, k, i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+        }
+      }
+      i += numSampleTuplesWritten;
+    }
+  }
+  delete[] sourceBuf;
+  return pass;
+}
+
+// Lossless stream of random audio as variable-length packets in the given format, each decoded from a buffer of its exact length,
+// encoded with the given lookahead. Returns true on pass.
+template <class Format>
+static bool formatVariableLengthTest(int numTests, int lookaheadNumBlocks = 1) {
+  const int numSampleTuples = 10*Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  const int maxNumPackets = numSampleTuples/Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+  int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+  uint8_t *dataBuf = new uint8_t[maxNumPackets*Format::VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES];
+  int16_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*2];
+  MLACBasicEncoder<Format> encoder;
+  bool pass = true;
+  for (int k = 0; k < numTests && pass; k++) {
+    randomTestAudio(sourceBuf, numSampleTuples);
+    encoder.effort = k % (EFFORT_MAX + 1);
+    encoder.independentBlockInterval = 1 + k % 8;
+    encoder.lookaheadNumBlocks = lookaheadNumBlocks;
+    encoder.restartStream();
+    // Encode all packets back to back
+    int numPackets = 0;
+    int numBytes = 0;
+    int i = 0;
+    for (; i <= numSampleTuples - lookaheadNumBlocks*Format::BLOCK_MAX_NUM_SAMPLETUPLES; numPackets++) {
+      int numSampleTuplesWritten;
+      int numBytesWritten;
+      encoder.encodeNextVariableLength(&sourceBuf[i*2], &dataBuf[numBytes], 0, numSampleTuplesWritten, numBytesWritten);
+      if (numBytesWritten > Format::VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES) {
+        printf("Error: BLOCK_NUM_BYTES=%d, k=%d, numBytesWritten=%d\n", Format::BLOCK_NUM_BYTES, k, numBytesWritten);
+        pass = false;
+      }
+      numBytes += numBytesWritten;
+      i += numSampleTuplesWritten;
+    }
+    // Decode them one by one
+    MLACBasicDecoder<Format> decoder;
+    int numSampleTuplesDecoded = 0;
+    for (int pos = 0, b = 0; b < numPackets && pass; b++) {
+      int length = 0;
+      for (int j = 0; j < Format::PACKET_LENGTH_NUM_BYTES; j++) {
+        length = (length << 8) | dataBuf[pos + j];
+      }
+      int numPacketBytes = Format::PACKET_LENGTH_NUM_BYTES + length + 1;
+      uint8_t *packet = new uint8_t[numPacketBytes];
+      memcpy(packet, &dataBuf[pos], numPacketBytes);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int numBytesRead;
+      int bitDepth = decoder.decodeVariableLength(packet, destBuf, timeStamp, numSampleTuplesRead, numBytesRead);
+      delete[] packet;
+      if (numBytesRead != numPacketBytes) {
+        printf("Error: BLOCK_NUM_BYTES=%d, k=%d, b=%d, numBytesRead=%d, expected %d\n", Format::BLOCK_NUM_BYTES, k, b, numBytesRead, numPacketBytes);
+        pass = false;
+      }
+      for (int j = 0; pass && bitDepth == 16 && j < numSampleTuplesRead*2; j++) {
+        if (destBuf[j] != sourceBuf[numSampleTuplesDecoded*2 + j]) {
+          printf("Error: BLOCK_NUM_BYTES=%d, k=%d, i=%d, source: %d, dest: %d\n", Format::BLOCK_NUM_BYTES, k, numSampleTuplesDecoded + j/2, sourceBuf[numSampleTuplesDecoded*2 + j], destBuf[j]);
+          pass = false;
+        }
+      }
+      pos += numBytesRead;
+      numSampleTuplesDecoded += numSampleTuplesRead;
+    }
+    if (pass && numSampleTuplesDecoded != i) {
+      printf("Error: BLOCK_NUM_BYTES=%d, k=%d, numSampleTuplesDecoded=%d, numSampleTuplesEncoded=%d\n", Format::BLOCK_NUM_BYTES, k, numSampleTuplesDecoded, i);
+      pass = false;
+    }
+  }
+  delete[] sourceBuf;
+  delete[] dataBuf;
+  return pass;
+}
+
+// Mono stream round trip in MLACMonoFormat of Format, of the left channel of random audio with a constant run and a noisy stretch, with
+// all effort levels and different independent block intervals and minimum numbers of sample tuples. Lossy blocks must stay within the
+// quantization step of their bit depth. Also encodes the same audio in both channels of Format, and returns the number of blocks of each
+// in numMonoBlocks and numStereoBlocks. Returns true on pass.
+template <class Format>
+static bool formatMonoTest(int numTests, long &numMonoBlocks, long &numStereoBlocks) {
+  typedef MLACMonoFormat<Format> MonoFormat;
+  const int numSampleTuples = 20*Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  int16_t *stereoBuf = new int16_t[numSampleTuples*2];
+  int16_t *sourceBuf = new int16_t[numSampleTuples];
+  uint8_t dataBuf[Format::BLOCK_NUM_BYTES];
+  int16_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES];
+  MLACBasicEncoder<MonoFormat> encoder;
+  MLACBasicEncoder<Format> stereoEncoder;
+  bool pass = true;
+  numMonoBlocks = 0;
+  numStereoBlocks = 0;
+  for (int k = 0; k < numTests && pass; k++) {
+    randomTestAudio(stereoBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples; i++) {
+      sourceBuf[i] = stereoBuf[i*2];
+      if (i >= 3*Format::BLOCK_MAX_NUM_SAMPLETUPLES && i < 6*Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+        sourceBuf[i] = -321;
+      } else if (i >= 10*Format::BLOCK_MAX_NUM_SAMPLETUPLES && i < 14*Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+        sourceBuf[i] = sourceBuf[i]/2 + rand()%4096 - 2048;
+      }
+      stereoBuf[i*2] = sourceBuf[i];
+      stereoBuf[i*2 + 1] = sourceBuf[i];
+    }
+    MLACBasicDecoder<MonoFormat> decoder;
+    encoder.effort = k % (EFFORT_MAX + 1);
+    encoder.independentBlockInterval = 1 + k % 3;
+    encoder.frameNumSampleTuples = (k % 5 == 4) ? Format::BLOCK_MAX_NUM_SAMPLETUPLES : 0;
+    encoder.restartStream();
+    stereoEncoder.effort = encoder.effort;
+    stereoEncoder.independentBlockInterval = encoder.independentBlockInterval;
+    stereoEncoder.frameNumSampleTuples = encoder.frameNumSampleTuples;
+    stereoEncoder.restartStream();
+    bool forceLossy = k % 3 == 2;
+    for (int i = 0; i <= numSampleTuples - Format::BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+      int minNumSampleTuples = forceLossy ? MonoFormat::chModeMSBNumSampleTuples(12) : Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      int bitDepth = encoder.encodeNext(&sourceBuf[i], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      if (numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numBitsWritten > Format::BLOCK_NUM_BYTES*8) {
+        printf("Error: MAX_LP_ORDER=%d, k=%d, i=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, bitDepth=%d, decodedBitDepth=%d\n", Format::MAX_LP_ORDER, k, i, numSampleTuplesWritten, numSampleTuplesRead, bitDepth, decodedBitDepth);
+        pass = false;
+      }
+      for (int j = 0; pass && j < numSampleTuplesWritten; j++) {
+        if (abs(destBuf[j] - sourceBuf[i + j]) >= (1 << (16 - bitDepth))) {
+          printf("Error: MAX_LP_ORDER=%d, k=%d, i=%d, bitDepth=%d, source: %d, dest: %d\n", Format::MAX_LP_ORDER, k, i + j, bitDepth, sourceBuf[i + j], destBuf[j]);
+          pass = false;
+        }
+      }
+      i += numSampleTuplesWritten;
+      numMonoBlocks += !forceLossy;
+    }
+    for (int i = 0; !forceLossy && i <= numSampleTuples - Format::BLOCK_MAX_NUM_SAMPLETUPLES;) {
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      stereoEncoder.encodeNext(&stereoBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      i += numSampleTuplesWritten;
+      numStereoBlocks++;
+    }
+  }
+  delete[] stereoBuf;
+  delete[] sourceBuf;
+  return pass;
+}
+
+// 24-bit stream round trip in Format, an MLAC24BitFormat, through MLACInput<int32_t> and MLACOutput<int32_t>, of random audio with
+// random low bits, with low bits of zero, with only the upper half of the low bits, with digital silence, and quiet at a level that
+// depends on the test, with all effort levels and different independent block intervals, some blocks forced lossy. Lossless blocks must
+// be exact, and lossy blocks within the quantization step of their bit depth and the low bits. The blocks are also decoded to
+// MLACOutput<int16_t> and MLACOutput<float>, which must have the same samples converted. Returns the number of lossless blocks in
+// numLosslessBlocks, and true on pass.
+template <class Format>
+static bool format24BitTest(int numTests, long &numLosslessBlocks) {
+  const int numChannels = Format::NUM_CHANNELS;
+  const int numSampleTuples = 20*Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  int16_t *stereoBuf = new int16_t[numSampleTuples*2];
+  int32_t *sourceBuf = new int32_t[numSampleTuples*numChannels];
+  uint8_t dataBuf[Format::BLOCK_NUM_BYTES];
+  int32_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*numChannels];
+  int16_t int16DestBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*numChannels];
+  float floatDestBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*numChannels];
+  bool pass = true;
+  numLosslessBlocks = 0;
+  for (int k = 0; k < numTests && pass; k++) {
+    randomTestAudio(stereoBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples; i++) {
+      int segment = i/(4*Format::BLOCK_MAX_NUM_SAMPLETUPLES);
+      for (int channel = 0; channel < numChannels; channel++) {
+        int32_t low = (segment == 1) ? 0 : (segment == 3) ? rand() & 0xf0 : rand() & 0xff;
+        sourceBuf[i*numChannels + channel] = (segment == 2) ? 0 : (segment == 4) ? (stereoBuf[i*2 + channel]*256 + low) >> (k % 10) : stereoBuf[i*2 + channel]*256 + low;
+      }
+    }
+    MLACBasicEncoder<Format> encoder;
+    MLACBasicDecoder<Format> decoder;
+    MLACBasicDecoder<Format> int16Decoder;
+    MLACBasicDecoder<Format> floatDecoder;
+    encoder.effort = k % (EFFORT_MAX + 1);
+    encoder.independentBlockInterval = 1 + k % 3;
+    MLACInput<int32_t> input = {sourceBuf, sourceBuf + numChannels - 1, numChannels, 8};
+    MLACOutput<int32_t> output = {destBuf, destBuf + numChannels - 1, numChannels, 8};
+    MLACOutput<int16_t> int16Output = {int16DestBuf, int16DestBuf + numChannels - 1, numChannels, 0};
+    MLACOutput<float> floatOutput = {floatDestBuf, floatDestBuf + numChannels - 1, numChannels, 0};
+    for (int i = 0, block = 0; i <= numSampleTuples - Format::BLOCK_MAX_NUM_SAMPLETUPLES && pass; block++) {
+      bool forceLossy = block % 7 == 6;
+      int minNumSampleTuples = forceLossy ? Format::BLOCK_MAX_NUM_SAMPLETUPLES : Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      int bitDepth = encoder.encodeNext(input, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int decodedBitDepth = decoder.decode(dataBuf, output, timeStamp, numSampleTuplesRead);
+      int16Decoder.decode(dataBuf, int16Output, timeStamp, numSampleTuplesRead);
+      floatDecoder.decode(dataBuf, floatOutput, timeStamp, numSampleTuplesRead);
+      if (numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numBitsWritten > Format::BLOCK_NUM_BYTES*8) {
+        printf("Error: k=%d, i=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, bitDepth=%d, decodedBitDepth=%d\n", k, i, numSampleTuplesWritten, numSampleTuplesRead, bitDepth, decodedBitDepth);
+        pass = false;
+      }
+      int32_t maxError = (bitDepth == 24) ? 0 : (1 << (25 - bitDepth)) - 1;
+      for (int j = 0; pass && j < numSampleTuplesWritten*numChannels; j++) {
+        if (abs(destBuf[j] - sourceBuf[i*numChannels + j]) > maxError) {
+          printf("Error: k=%d, i=%d, bitDepth=%d, source: %d, dest: %d\n", k, i + j/numChannels, bitDepth, sourceBuf[i*numChannels + j], destBuf[j]);
+          pass = false;
+        }
+        if (pass && (int16DestBuf[j] != destBuf[j] >> 8 || floatDestBuf[j] != destBuf[j]*(1.0f/8388608.0f))) {
+          printf("Error: k=%d, i=%d, bitDepth=%d, int32_t: %d, int16_t: %d, float: %.9f\n", k, i + j/numChannels, bitDepth, destBuf[j], int16DestBuf[j], floatDestBuf[j]);
+          pass = false;
+        }
+      }
+      input.left += numSampleTuplesWritten*numChannels;
+      input.right += numSampleTuplesWritten*numChannels;
+      i += numSampleTuplesWritten;
+      numLosslessBlocks += bitDepth == 24;
+    }
+  }
+  delete[] stereoBuf;
+  delete[] sourceBuf;
+  return pass;
+}
+
+// Stream of random audio with a constant run and a noisy stretch in the given format, with all effort levels and different independent
+// block intervals, some blocks forced lossy, and a restart of the stream. Each block is fed to MLACBasicIncrementalDecoder in fragments
+// of random lengths, and the sample tuples it has written after each fragment must be those of MLACBasicDecoder. Returns the number of
+// sample tuples written before the last fragment of their block in numEarlySampleTuples, of all in numSampleTuplesDecoded, and true on pass.
+template <class Format>
+static bool formatIncrementalTest(int numTests, long &numEarlySampleTuples, long &numSampleTuplesDecoded) {
+  const int numChannels = Format::NUM_CHANNELS;
+  const int numSampleTuples = 20*Format::BLOCK_MAX_NUM_SAMPLETUPLES;
+  int16_t *stereoBuf = new int16_t[numSampleTuples*2];
+  int16_t *sourceBuf = new int16_t[numSampleTuples*numChannels];
+  uint8_t dataBuf[Format::BLOCK_NUM_BYTES];
+  int16_t referenceBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*numChannels];
+  int16_t destBuf[Format::BLOCK_MAX_NUM_SAMPLETUPLES*numChannels];
+  bool pass = true;
+  numEarlySampleTuples = 0;
+  numSampleTuplesDecoded = 0;
+  for (int k = 0; k < numTests && pass; k++) {
+    randomTestAudio(stereoBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples; i++) {
+      for (int channel = 0; channel < numChannels; channel++) {
+        int16_t sample = stereoBuf[i*2 + channel];
+        if (i >= 3*Format::BLOCK_MAX_NUM_SAMPLETUPLES && i < 5*Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+          sample = -321;
+        } else if (i >= 10*Format::BLOCK_MAX_NUM_SAMPLETUPLES && i < 14*Format::BLOCK_MAX_NUM_SAMPLETUPLES) {
+          sample = sample/2 + rand()%4096 - 2048;
+        }
+        sourceBuf[i*numChannels + channel] = sample;
+      }
+    }
+    MLACBasicEncoder<Format> encoder;
+    MLACBasicDecoder<Format> referenceDecoder;
+    MLACBasicIncrementalDecoder<Format> decoder;
+    encoder.effort = k % (EFFORT_MAX + 1);
+    encoder.independentBlockInterval = 1 + k % 4;
+    for (int i = 0, block = 0; i <= numSampleTuples - Format::BLOCK_MAX_NUM_SAMPLETUPLES && pass; block++) {
+      bool forceLossy = block % 5 == 4;
+      int minNumSampleTuples = forceLossy ? Format::chModeMSBNumSampleTuples(8) : Format::BLOCK_MIN_NUM_SAMPLETUPLES;
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      encoder.encodeNext(&sourceBuf[i*numChannels], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+      if (block == 7) {
+        // As after a lost block
+        referenceDecoder.restartStream();
+        decoder.restartStream();
+      }
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int bitDepth = referenceDecoder.decode(dataBuf, referenceBuf, timeStamp, numSampleTuplesRead);
+      int decodedBitDepth = -1;
+      int numSampleTuplesIncrementallyRead = 0;
+      int numIncrementallyDecoded = 0;
+      for (int pos = 0; pos < Format::BLOCK_NUM_BYTES && pass;) {
+        int numFragmentBytes = std::min(1 + rand()%40, Format::BLOCK_NUM_BYTES - pos);
+        int numDecoded;
+        decodedBitDepth = decoder.decodeFragment(&dataBuf[pos], numFragmentBytes, destBuf, timeStamp, numSampleTuplesIncrementallyRead, numDecoded);
+        pos += numFragmentBytes;
+        if (numDecoded < numIncrementallyDecoded || numDecoded > numSampleTuplesRead || (pos == Format::BLOCK_NUM_BYTES && numDecoded != numSampleTuplesRead)) {
+          printf("Error: k=%d, i=%d, pos=%d, numDecoded=%d, previously %d, numSampleTuplesRead=%d\n", k, i, pos, numDecoded, numIncrementallyDecoded, numSampleTuplesRead);
+          pass = false;
+        }
+        for (int j = 0; pass && j < numDecoded*numChannels; j++) {
+          if (destBuf[j] != referenceBuf[j]) {
+            printf("Error: k=%d, i=%d, pos=%d, reference: %d, dest: %d\n", k, i + j/numChannels, pos, referenceBuf[j], destBuf[j]);
+            pass = false;
+          }
+        }
+        if (pos < Format::BLOCK_NUM_BYTES) {
+          numEarlySampleTuples += numDecoded - numIncrementallyDecoded;
+        }
+        numIncrementallyDecoded = numDecoded;
+      }
+      if (pass && (numSampleTuplesIncrementallyRead != numSampleTuplesRead || decodedBitDepth != bitDepth)) {
+        printf("Error: k=%d, i=%d, numSampleTuplesRead=%d, incrementally %d, bitDepth=%d, incrementally %d\n", k, i, numSampleTuplesRead, numSampleTuplesIncrementallyRead, bitDepth, decodedBitDepth);
+        pass = false;
+      }
+      i += numSampleTuplesWritten;
+      numSampleTuplesDecoded += numSampleTuplesRead;
+    }
+  }
+  delete[] stereoBuf;
+  delete[] sourceBuf;
+  return pass;
+}
+
 int main() {
   unsigned int randomSeed = 1522866229;
   printf("randomSeed=%d\n", randomSeed);
@@ -245,6 +695,46 @@ int main() {
   }
   printPass(pass);
 #endif  
+#ifdef UNITTEST_FIXED_POINT_QUOTIENT
+  printf("UNITTEST_FIXED_POINT_QUOTIENT: fixedPointQuotient\n");
+  pass = true;
+  for (int i = 0; i < 1000000 && pass; i++) {
+    // Small values against a direct calculation
+    int64_t numerator = (rand() % (1 << 24)) - (1 << 23);
+    int64_t denominator = (rand() % (1 << (1 + rand() % 24))) - (1 << 23);
+    int shift = 1 + rand() % 12;
+    if (denominator == 0) {
+      continue;
+    }
+    int64_t scaled = ((numerator < 0) ? -numerator : numerator)*((int64_t)2 << shift)/((denominator < 0) ? -denominator : denominator);
+    int64_t expected = (scaled + 1) >> 1;
+    if ((numerator < 0) != (denominator < 0)) {
+      expected = -expected;
+    }
+    expected = (expected > 4095) ? 4095 : (expected < -4096) ? -4096 : expected;
+    int32_t result = fixedPointQuotient(numerator, denominator, shift, -4096, 4095);
+    // Large values that are multiples of each other
+    int64_t largeDenominator = (int64_t)(rand() % (1 << 26) + 1) << 31;
+    int multiple = rand() % 65 - 32;
+    int32_t largeResult = fixedPointQuotient(largeDenominator*multiple, -largeDenominator, 4, -4096, 4095);
+    // Quotients just below 2^24 with shifts that take them beyond int32
+    int64_t nearDenominator = rand() % (1 << 20) + 1;
+    int64_t nearNumerator = ((1 << 24) - 1 - rand() % 256)*nearDenominator + rand() % nearDenominator;
+    int nearShift = 8 + rand() % 5;
+    int64_t nearExpected = ((nearNumerator*((int64_t)2 << nearShift)/nearDenominator) + 1) >> 1;
+    if (rand() % 2) {
+      nearNumerator = -nearNumerator;
+      nearExpected = -nearExpected;
+    }
+    nearExpected = (nearExpected > INT32_MAX) ? INT32_MAX : (nearExpected < INT32_MIN) ? INT32_MIN : nearExpected;
+    int32_t nearResult = fixedPointQuotient(nearNumerator, nearDenominator, nearShift, INT32_MIN, INT32_MAX);
+    if (result != expected || largeResult != -multiple*16 || nearResult != nearExpected) {
+      printf("Error: %lld/%lld << %d = %d, expected %lld; %d*%lld/%lld << 4 = %d; %lld/%lld << %d = %d, expected %lld\n", (long long)numerator, (long long)denominator, shift, result, (long long)expected, multiple, (long long)largeDenominator, (long long)-largeDenominator, largeResult, (long long)nearNumerator, (long long)nearDenominator, nearShift, nearResult, (long long)nearExpected);
+      pass = false;
+    }
+  }
+  printPass(pass);
+#endif
 #ifdef UNITTEST_EXPGOLOMBLIKE_CODE
   printf("UNITTEST_EXPGOLOMBLIKE_CODE: expGolombLikeEncode16, expGolombLikeDecode16\n");
   pass = true;
@@ -367,54 +857,9 @@ int main() {
   pass = true;
   MLACEncoder encoder;
   MLACDecoder decoder;
-  double audioBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
   int16_t sourceBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
   for (int k = 0; k < 10000; k++) {
-    for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
-      audioBuf[i*2] = 0;
-      audioBuf[i*2 + 1] = 0;
-    }
-    // Stereo impulses
-    int numImpulses = rand()%10;
-    for (int j = 0; j < numImpulses; j++) {
-      int pos = rand()%BLOCK_MAX_NUM_SAMPLETUPLES;
-      audioBuf[pos*2] += rand()/(RAND_MAX*2.0) - 0.5;
-      audioBuf[pos*2 + 1] += rand()/(RAND_MAX*2.0) - 0.5;
-    }
-    // Sine waves
-    int numSineWaves = rand()%10;
-    for (int j = 0; j < numSineWaves; j++) {
-      double phaseL = rand()/(double)RAND_MAX*M_PI;
-      double phaseR = rand()/(double)RAND_MAX*M_PI;
-      double ampL = rand()/(double)RAND_MAX;
-      double ampR = rand()/(double)RAND_MAX;
-      double w = rand()/(double)RAND_MAX*M_PI;
-      //      printf("phaseL=%f, phaseR=%f, ampL=%f, ampR=%f, w=%f\n", phaseL, phaseR, ampL, ampR, w);
-      for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
-        audioBuf[i*2] += sin(phaseL + i*w)*ampL;
-        audioBuf[i*2 + 1] += sin(phaseR + i*w)*ampR;
-      }
-    }
-    double peak = 0;
-    for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
-      if (peak < audioBuf[i*2]) {
-        peak = audioBuf[i*2];
-      }
-      if (peak < audioBuf[i*2 + 1]) {
-        peak = audioBuf[i*2 + 1];
-      }
-    }
-    double normFactor = pow(2, (rand()%1600)/100.0); // Will clip sometimes
-    for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES*2; i++) {
-      audioBuf[i] *= normFactor;
-      if (audioBuf[i] > 0x7fff) {
-        audioBuf[i] = 0x7fff;
-      }
-      if (audioBuf[i] < -0x8000) {
-        audioBuf[i] = -0x8000;
-      }
-      sourceBuf[i] = audioBuf[i];
-    }
+    randomTestAudio(sourceBuf, BLOCK_MAX_NUM_SAMPLETUPLES);
     uint8_t dataBuf[BLOCK_NUM_BYTES];
     uint8_t timeStamp = (int8_t) rand();
     int numSampleTuplesWritten;
@@ -444,6 +889,1125 @@ int main() {
   }
   printPass(pass);
 #endif
+#ifdef UNITTEST_ENCODER_EFFORT
+  printf("UNITTEST_ENCODER_EFFORT: MLACEncoder.effort\n");
+  pass = true;
+  {
+    MLACEncoder encoder;
+    MLACDecoder decoder;
+    int16_t sourceBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+    for (int k = 0; k < 2000; k++) {
+      randomTestAudio(sourceBuf, BLOCK_MAX_NUM_SAMPLETUPLES);
+      int lastNumSampleTuplesWritten = 0;
+      for (int effort = EFFORT_FASTEST; effort <= EFFORT_MAX; effort++) {
+        encoder.effort = effort;
+        uint8_t dataBuf[BLOCK_NUM_BYTES];
+        uint8_t timeStamp = 0;
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int bitDepth = encoder.encode(sourceBuf, dataBuf, timeStamp, numSampleTuplesWritten, numBitsWritten);
+        int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+        int numSampleTuplesRead;
+        decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+        if (numSampleTuplesRead != numSampleTuplesWritten) {
+          printf("Error: effort=%d, numSampleTuplesRead=%d != numSampleTuplesWritten=%d\n", effort, numSampleTuplesRead, numSampleTuplesWritten);
+          pass = false;
+        }
+        for (int i = 0; bitDepth == 16 && i < numSampleTuplesWritten*2; i++) {
+          if (destBuf[i] != sourceBuf[i]) {
+            printf("Error: effort=%d, i=%d, source: %d, dest: %d\n", effort, i, sourceBuf[i], destBuf[i]);
+            pass = false;
+            break;
+          }
+        }
+        // Higher effort must never fit fewer sample tuples
+        if (bitDepth == 16 && numSampleTuplesWritten < lastNumSampleTuplesWritten) {
+          printf("Error: effort=%d, numSampleTuplesWritten=%d < %d\n", effort, numSampleTuplesWritten, lastNumSampleTuplesWritten);
+          pass = false;
+        }
+        if (bitDepth == 16) {
+          lastNumSampleTuplesWritten = numSampleTuplesWritten;
+        }
+      }
+    }
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_FORMATS
+  printf("UNITTEST_FORMATS: MLACBasicEncoder, MLACBasicDecoder with different formats side by side\n");
+  pass = formatTranscodeTest<MLACDefaultFormat>(1000);
+  pass = formatTranscodeTest<MLACFormat<128, 63, 32> >(1000) && pass;
+  pass = formatTranscodeTest<MLACFormat<512, 255, 120> >(1000) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_ENCODE_NEXT
+  printf("UNITTEST_ENCODE_NEXT: MLACEncoder.encodeNext gives the same output as MLACEncoder.encode\n");
+  pass = true;
+  {
+    const int numSampleTuples = 50*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *streamBuf = new int16_t[numSampleTuples*2];
+    MLACEncoder encoder;
+    MLACEncoder streamEncoder;
+    for (int k = 0; k < 100 && pass; k++) {
+      randomTestAudio(streamBuf, numSampleTuples);
+      encoder.effort = k % (EFFORT_MAX + 1);
+      streamEncoder.effort = encoder.effort;
+      streamEncoder.restartStream();
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES] = {0};
+        uint8_t streamDataBuf[BLOCK_NUM_BYTES] = {0};
+        int numSampleTuplesWritten, streamNumSampleTuplesWritten;
+        int numBitsWritten, streamNumBitsWritten;
+        encoder.encode(&streamBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+        streamEncoder.encodeNext(&streamBuf[i*2], streamDataBuf, 0, streamNumSampleTuplesWritten, streamNumBitsWritten);
+        if (numSampleTuplesWritten != streamNumSampleTuplesWritten || numBitsWritten != streamNumBitsWritten || memcmp(dataBuf, streamDataBuf, BLOCK_NUM_BYTES)) {
+          printf("Error: k=%d, i=%d, numSampleTuplesWritten=%d, streamNumSampleTuplesWritten=%d\n", k, i, numSampleTuplesWritten, streamNumSampleTuplesWritten);
+          pass = false;
+          break;
+        }
+        i += numSampleTuplesWritten;
+      }
+    }
+    delete[] streamBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_STREAM_MODE
+  printf("UNITTEST_STREAM_MODE: MLACEncoder.independentBlockInterval, MLACDecoder.restartStream\n");
+  pass = true;
+  {
+    const int numSampleTuples = 50*BLOCK_MAX_NUM_SAMPLETUPLES;
+    const int maxNumBlocks = numSampleTuples/BLOCK_MIN_NUM_SAMPLETUPLES;
+    int16_t *streamBuf = new int16_t[numSampleTuples*2];
+    int16_t *destBuf = new int16_t[(numSampleTuples + BLOCK_MAX_NUM_SAMPLETUPLES)*2];
+    uint8_t *dataBuf = new uint8_t[maxNumBlocks*BLOCK_NUM_BYTES];
+    int *bitDepths = new int[maxNumBlocks];
+    int *positions = new int[maxNumBlocks + 1];
+    MLACEncoder encoder;
+    for (int k = 0; k < 100 && pass; k++) {
+      randomTestAudio(streamBuf, numSampleTuples);
+      // White noise in the middle to get lossy blocks in between
+      for (int i = numSampleTuples/2; i < numSampleTuples/2 + 2*BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
+        streamBuf[i*2] = rand();
+        streamBuf[i*2 + 1] = rand();
+      }
+      encoder.effort = k % (EFFORT_MAX + 1);
+      encoder.independentBlockInterval = 1 + k % 20;
+      encoder.restartStream();
+      int numBlocks = 0;
+      positions[0] = 0;
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES; numBlocks++) {
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int minNumSampleTuples = (k % 2) ? BLOCK_MAX_NUM_SAMPLETUPLES : BLOCK_MIN_NUM_SAMPLETUPLES; // Odd k forces lossy noise blocks
+        bitDepths[numBlocks] = encoder.encodeNext(&streamBuf[i*2], &dataBuf[numBlocks*BLOCK_NUM_BYTES], 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+        i += numSampleTuplesWritten;
+        positions[numBlocks + 1] = i;
+      }
+      // Decode all blocks, then decode again with one block lost
+      for (int lostBlock = -1; lostBlock < numBlocks && pass; lostBlock += (lostBlock < 0) ? 1 + rand() % numBlocks : numBlocks) {
+        MLACDecoder decoder;
+        bool recovered = true;
+        for (int b = 0; b < numBlocks; b++) {
+          if (b == lostBlock) {
+            decoder.restartStream();
+            recovered = false;
+            continue;
+          }
+          uint8_t timeStamp;
+          int numSampleTuplesRead;
+          int16_t *output = &destBuf[positions[b]*2];
+          int16_t expected[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+          for (int i = 0; lostBlock >= 0 && i < (positions[b + 1] - positions[b])*2; i++) {
+            expected[i] = output[i];
+          }
+          int bitDepth = decoder.decode(&dataBuf[b*BLOCK_NUM_BYTES], output, timeStamp, numSampleTuplesRead);
+          if (bitDepth != 0) {
+            recovered = true;
+          }
+          if (numSampleTuplesRead != positions[b + 1] - positions[b] || (bitDepth != bitDepths[b] && (recovered || bitDepth != 0))) {
+            printf("Error: k=%d, lostBlock=%d, b=%d, numSampleTuplesRead=%d, bitDepth=%d, encoded bitDepth=%d\n", k, lostBlock, b, numSampleTuplesRead, bitDepth, bitDepths[b]);
+            pass = false;
+            break;
+          }
+          for (int i = 0; bitDepth != 0 && i < numSampleTuplesRead*2; i++) {
+            if ((bitDepth == 16 && output[i] != streamBuf[positions[b]*2 + i]) || (lostBlock >= 0 && output[i] != expected[i])) {
+              printf("Error: k=%d, lostBlock=%d, b=%d, i=%d, source: %d, dest: %d\n", k, lostBlock, b, i, streamBuf[positions[b]*2 + i], output[i]);
+              pass = false;
+              break;
+            }
+          }
+        }
+      }
+    }
+    delete[] streamBuf;
+    delete[] destBuf;
+    delete[] dataBuf;
+    delete[] bitDepths;
+    delete[] positions;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_HIGH_ORDER
+  printf("UNITTEST_HIGH_ORDER: levinsonDurbin, MLACFormat with MAX_LP_ORDER above NUM_LP_COEFS\n");
+  pass = true;
+  {
+    // Autocorrelation of a first order autoregressive process with coefficient 0.75 and of a sinusoid
+    int32_t ar1[MAX_LP_ORDER + 1];
+    int32_t sinusoid[MAX_LP_ORDER + 1];
+    for (int k = 0; k <= MAX_LP_ORDER; k++) {
+      ar1[k] = (int32_t)round(pow(0.75, k)*(1 << 23));
+      sinusoid[k] = (int32_t)round(cos(k*0.5)*(1 << 23));
+    }
+    int32_t coefs[MAX_LP_ORDER + 1][MAX_LP_ORDER + 1];
+    int maxOrder = levinsonDurbin(ar1, MAX_LP_ORDER, coefs);
+    if (maxOrder != MAX_LP_ORDER || abs(coefs[1][1] - (3 << LEVINSON_DURBIN_SHIFT >> 2)) > 16 || abs(coefs[MAX_LP_ORDER][1] - (3 << LEVINSON_DURBIN_SHIFT >> 2)) > 16 || abs(coefs[MAX_LP_ORDER][2]) > 16) {
+      printf("Error: AR(1), maxOrder=%d, coefs[1][1]=%d, coefs[%d][1]=%d, coefs[%d][2]=%d\n", maxOrder, coefs[1][1], MAX_LP_ORDER, coefs[MAX_LP_ORDER][1], MAX_LP_ORDER, coefs[MAX_LP_ORDER][2]);
+      pass = false;
+    }
+    // A sinusoid is perfectly predicted at order 2 with coefficients 2 cos(w) and -1, after which the recursion stops
+    maxOrder = levinsonDurbin(sinusoid, MAX_LP_ORDER, coefs);
+    if (maxOrder < 2 || abs(coefs[2][1] - (int32_t)round(2*cos(0.5)*(1 << LEVINSON_DURBIN_SHIFT))) > 1024 || abs(coefs[2][2] + (1 << LEVINSON_DURBIN_SHIFT)) > 1024) {
+      printf("Error: sinusoid, maxOrder=%d, coefs[2][1]=%d, coefs[2][2]=%d\n", maxOrder, coefs[2][1], coefs[2][2]);
+      pass = false;
+    }
+  }
+  pass = formatStreamTest<MLACFormat<BLOCK_NUM_BYTES, BLOCK_MAX_NUM_SAMPLETUPLES, BLOCK_MIN_NUM_SAMPLETUPLES, MAX_LP_ORDER> >(200) && pass;
+  pass = formatStreamTest<MLACFormat<512, 255, 120, 5> >(200) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_CHANNEL_MODES
+  printf("UNITTEST_CHANNEL_MODES: CHMODE_DEPENDENT_AND_INDEPENDENT, CHMODE_MID_AND_SIDE, midSide\n");
+  pass = true;
+  for (int i = -0x8000; i < 0x8000 && pass; i += 7) {
+    for (int j = -0x8000; j < 0x8000; j += 13) {
+      int16_t a = i;
+      int16_t b = j;
+      midSide(a, b);
+      inverseMidSide(a, b);
+      if (a != i || b != j) {
+        printf("Error: left=%d, right=%d, decoded left=%d, decoded right=%d\n", i, j, a, b);
+        pass = false;
+        break;
+      }
+    }
+  }
+  {
+    MLACEncoder encoder;
+    MLACDecoder decoder;
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    int chModeCounts[4] = {0, 0, 0, 0};
+    for (int k = 0; k < 200 && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      // Dominant right channel, near mono, or anti-phase with wrap-around in the mid and side channel
+      for (int i = 0; i < numSampleTuples; i++) {
+        int noise = rand() % 9 - 4;
+        if (k % 3 == 0) {
+          sourceBuf[i*2] = sourceBuf[i*2]/64 + noise;
+        } else if (k % 3 == 1) {
+          sourceBuf[i*2] = saturate(sourceBuf[i*2 + 1] + noise, -0x8000, 0x7fff);
+        } else {
+          sourceBuf[i*2 + 1] = -1 - sourceBuf[i*2];
+        }
+      }
+      encoder.effort = k % (EFFORT_MAX + 1);
+      encoder.independentBlockInterval = 1 + k % 5;
+      encoder.restartStream();
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES];
+        int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int bitDepth = encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+        BitStreamReader reader(dataBuf, BLOCK_NUM_BYTES);
+        uint32_t chMode;
+        reader.read(chMode, 8);
+        reader.read(chMode, 2);
+        chModeCounts[chMode]++;
+        uint8_t timeStamp;
+        int numSampleTuplesRead;
+        decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+        for (int j = 0; bitDepth == 16 && j < numSampleTuplesWritten*2; j++) {
+          if (destBuf[j] != sourceBuf[i*2 + j]) {
+            printf("Error: k=%d, chMode=%d, i=%d, source: %d, dest: %d\n", k, chMode, i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+            pass = false;
+            break;
+          }
+        }
+        i += numSampleTuplesWritten;
+      }
+    }
+    if (chModeCounts[CHMODE_DEPENDENT_AND_INDEPENDENT] == 0 || chModeCounts[CHMODE_MID_AND_SIDE] == 0) {
+      printf("Error: channel modes not used, counts: %d, %d, %d, %d\n", chModeCounts[0], chModeCounts[1], chModeCounts[2], chModeCounts[3]);
+      pass = false;
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_ADAPTIVE_RESIDUALS
+  printf("UNITTEST_ADAPTIVE_RESIDUALS: AdaptiveExpGolombLikeParameter, MLACFormat with adaptiveResiduals\n");
+  pass = true;
+  {
+    // Write and read residuals of a decaying envelope with adaptive parameters
+    const int numValues = 200;
+    int16_t values[numValues];
+    uint8_t buf[numValues*4];
+    for (int k = 0; k < 100 && pass; k++) {
+      double envelope = pow(2, (rand()%1500)/100.0);
+      for (int i = 0; i < numValues; i++) {
+        values[i] = saturate((int32_t)round((rand()/(double)RAND_MAX - 0.5)*envelope), -0x8000, 0x7fff);
+        envelope *= 0.97;
+      }
+      int initialParameter = RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + k % 9;
+      BitStreamWriter writer(buf);
+      AdaptiveExpGolombLikeParameter<MLACDefaultFormat> writeParameter(initialParameter);
+      for (int i = 0; i < numValues; i++) {
+        writer.writeExpGolombLike(values[i], writeParameter.parameter);
+        writeParameter.update(values[i]);
+      }
+      BitStreamReader reader(buf, numValues*4);
+      AdaptiveExpGolombLikeParameter<MLACDefaultFormat> readParameter(initialParameter);
+      for (int i = 0; i < numValues; i++) {
+        int16_t value;
+        reader.readExpGolombLike(value, readParameter.parameter);
+        readParameter.update(value);
+        if (value != values[i] || readParameter.parameter < RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER || readParameter.parameter > RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER + 8) {
+          printf("Error: k=%d, i=%d, value=%d, read value=%d, parameter=%d\n", k, i, values[i], value, readParameter.parameter);
+          pass = false;
+          break;
+        }
+      }
+      if (pass && reader.numBitsRead != writer.numBitsWritten) {
+        printf("Error: k=%d, numBitsWritten=%d, numBitsRead=%d\n", k, writer.numBitsWritten, reader.numBitsRead);
+        pass = false;
+      }
+    }
+  }
+  pass = formatStreamTest<MLACFormat<BLOCK_NUM_BYTES, BLOCK_MAX_NUM_SAMPLETUPLES, BLOCK_MIN_NUM_SAMPLETUPLES, NUM_LP_COEFS, true> >(200) && pass;
+  pass = formatStreamTest<MLACFormat<512, 255, 120, MAX_LP_ORDER, true> >(200) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_RANS_RESIDUALS
+  printf("UNITTEST_RANS_RESIDUALS: MLACFormat with ransResiduals\n");
+  pass = true;
+  {
+    // rANS tables must be complete and costs must match the frequencies
+    for (int table = 0; table < RANS_NUM_TABLES; table++) {
+      if (ransCumFreqs[table][0] != 0 || ransCumFreqs[table][RANS_NUM_SYMBOLS] != 1 << RANS_PROB_BITS) {
+        printf("Error: table=%d, cumulative frequencies do not sum to 2^RANS_PROB_BITS\n", table);
+        pass = false;
+      }
+      for (int symbol = 0; symbol < RANS_NUM_SYMBOLS; symbol++) {
+        int freq = ransCumFreqs[table][symbol + 1] - ransCumFreqs[table][symbol];
+        if (freq < 1 || abs(ransSymbolCosts[table][symbol] - (int)round(-log2(freq/(double)(1 << RANS_PROB_BITS))*(1 << RANS_COST_SHIFT))) > 1) {
+          printf("Error: table=%d, symbol=%d, frequency=%d, cost=%d\n", table, symbol, freq, ransSymbolCosts[table][symbol]);
+          pass = false;
+        }
+      }
+    }
+    // Quiet noise compresses beyond 16 bits per residual only with rANS, as exp-Golomb-like codes need at least 1 + RESIDUAL_EXPGOLOMBLIKE_MIN_PARAMETER bits
+    typedef MLACFormat<BLOCK_NUM_BYTES, 255, BLOCK_MIN_NUM_SAMPLETUPLES> ExpGolombLikeFormat;
+    typedef MLACFormat<BLOCK_NUM_BYTES, 255, BLOCK_MIN_NUM_SAMPLETUPLES, NUM_LP_COEFS, false, true> RANSFormat;
+    const int numSampleTuples = 20*255;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    for (int i = 0; i < numSampleTuples*2; i++) {
+      sourceBuf[i] = rand() % 7 - 3;
+    }
+    MLACBasicEncoder<ExpGolombLikeFormat> expGolombLikeEncoder;
+    MLACBasicEncoder<RANSFormat> ransEncoder;
+    MLACBasicDecoder<RANSFormat> ransDecoder;
+    int expGolombLikeNumSampleTuples = 0;
+    int ransNumSampleTuples = 0;
+    for (int i = 0; i <= numSampleTuples - 255 && pass;) {
+      uint8_t dataBuf[BLOCK_NUM_BYTES];
+      int16_t destBuf[255*2];
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      expGolombLikeEncoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      expGolombLikeNumSampleTuples += numSampleTuplesWritten;
+      ransEncoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      ransDecoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+        if (destBuf[j] != sourceBuf[i*2 + j] || numSampleTuplesRead != numSampleTuplesWritten) {
+          printf("Error: i=%d, source: %d, dest: %d\n", i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+          break;
+        }
+      }
+      i += numSampleTuplesWritten;
+      ransNumSampleTuples += numSampleTuplesWritten;
+    }
+    if (ransNumSampleTuples <= expGolombLikeNumSampleTuples) {
+      printf("Error: rANS did not compress better, %d versus %d sample tuples\n", ransNumSampleTuples, expGolombLikeNumSampleTuples);
+      pass = false;
+    }
+    delete[] sourceBuf;
+  }
+  pass = formatStreamTest<MLACFormat<BLOCK_NUM_BYTES, BLOCK_MAX_NUM_SAMPLETUPLES, BLOCK_MIN_NUM_SAMPLETUPLES, NUM_LP_COEFS, false, true> >(200) && pass;
+  pass = formatStreamTest<MLACFormat<512, 255, 120, MAX_LP_ORDER, true, true> >(200) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_CONSTANT_RUN
+  printf("UNITTEST_CONSTANT_RUN: CONSTANT_RUN_CODE, MLACEncoder.encodeNext on digital silence and DC\n");
+  pass = true;
+  {
+    // Silence, then DC, then test audio, then silence again
+    const int numSampleTuples = 40*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples; i++) {
+      int segment = i/(10*BLOCK_MAX_NUM_SAMPLETUPLES);
+      if (segment == 0 || segment == 3) {
+        sourceBuf[i*2] = 0;
+        sourceBuf[i*2 + 1] = 0;
+      } else if (segment == 1) {
+        sourceBuf[i*2] = -0x8000;
+        sourceBuf[i*2 + 1] = 1234;
+      }
+    }
+    MLACEncoder encoder;
+    MLACDecoder decoder;
+    int numConstantRunBlocks = 0;
+    for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+      uint8_t dataBuf[BLOCK_NUM_BYTES];
+      int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      BitStreamReader reader(dataBuf, BLOCK_NUM_BYTES);
+      uint32_t count, chMode, trueBitDepth;
+      reader.read(count, 8);
+      reader.read(chMode, 2);
+      reader.read(trueBitDepth, 4);
+      if (chMode == CHMODE_MSB && trueBitDepth == CONSTANT_RUN_CODE) {
+        numConstantRunBlocks++;
+        if (numBitsWritten != 8 + 2 + 4 + 2*16 || numSampleTuplesWritten != BLOCK_MAX_NUM_SAMPLETUPLES) {
+          printf("Error: i=%d, constant run block with numBitsWritten=%d, numSampleTuplesWritten=%d\n", i, numBitsWritten, numSampleTuplesWritten);
+          pass = false;
+        }
+      }
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+        if (destBuf[j] != sourceBuf[i*2 + j] || numSampleTuplesRead != numSampleTuplesWritten) {
+          printf("Error: i=%d, source: %d, dest: %d\n", i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+          break;
+        }
+      }
+      i += numSampleTuplesWritten;
+    }
+    // Most of the 30 blocks' worth of constant sample tuples must be coded as constant runs
+    if (numConstantRunBlocks < 25) {
+      printf("Error: only %d constant run blocks\n", numConstantRunBlocks);
+      pass = false;
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_LONG_BLOCKS
+  printf("UNITTEST_LONG_BLOCKS: MLACEncoder.encodeNext with blocks longer than fit in a packet as 16-bit PCM\n");
+  pass = true;
+  {
+    // Quiet audio should fill blocks longer than half of BLOCK_NUM_BYTES
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples*2; i++) {
+      sourceBuf[i] /= 256;
+    }
+    MLACEncoder encoder;
+    MLACDecoder decoder;
+    int numLongBlocks = 0;
+    for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+      uint8_t dataBuf[BLOCK_NUM_BYTES];
+      int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+        if (destBuf[j] != sourceBuf[i*2 + j] || numSampleTuplesRead != numSampleTuplesWritten) {
+          printf("Error: i=%d, source: %d, dest: %d\n", i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+          break;
+        }
+      }
+      if (numSampleTuplesWritten*2*16 > BLOCK_NUM_BYTES*8) {
+        numLongBlocks++;
+      }
+      i += numSampleTuplesWritten;
+    }
+    if (BLOCK_MAX_NUM_SAMPLETUPLES*2*16 > BLOCK_NUM_BYTES*8 && numLongBlocks == 0) {
+      printf("Error: no long blocks\n");
+      pass = false;
+    }
+    // White noise forced to BLOCK_MAX_NUM_SAMPLETUPLES must give an 8-bit block if that is the most that fits
+    for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES*2; i++) {
+      sourceBuf[i] = rand();
+    }
+    uint8_t dataBuf[BLOCK_NUM_BYTES];
+    int numSampleTuplesWritten;
+    int numBitsWritten;
+    int bitDepth = encoder.encode(sourceBuf, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, BLOCK_MAX_NUM_SAMPLETUPLES);
+    int expectedNumSampleTuples = MLACDefaultFormat::chModeMSBNumSampleTuples(8);
+    if (bitDepth < 8 || numSampleTuplesWritten != expectedNumSampleTuples) {
+      printf("Error: white noise gave bitDepth=%d, numSampleTuplesWritten=%d, expected %d\n", bitDepth, numSampleTuplesWritten, expectedNumSampleTuples);
+      pass = false;
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_MAX_LENGTH
+  printf("UNITTEST_MAX_LENGTH: MLACEncoder.blockMaxNumSampleTuples, and blocks too long for the decoder\n");
+  pass = true;
+  {
+    // Quiet audio would fill blocks longer than maxLength. The input of each call has only maxLength sample tuples.
+    const int maxLength = (BLOCK_MIN_NUM_SAMPLETUPLES + BLOCK_MAX_NUM_SAMPLETUPLES)/2;
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples*2; i++) {
+      sourceBuf[i] /= 2048;
+    }
+    MLACEncoder encoder;
+    encoder.blockMaxNumSampleTuples = maxLength;
+    MLACDecoder decoder;
+    int16_t *window = new int16_t[maxLength*2];
+    for (int i = 0; i <= numSampleTuples - maxLength && pass;) {
+      for (int j = 0; j < maxLength*2; j++) {
+        window[j] = sourceBuf[i*2 + j];
+      }
+      uint8_t dataBuf[BLOCK_NUM_BYTES];
+      int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      encoder.encodeNext(window, dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      if (numSampleTuplesWritten > maxLength || numSampleTuplesRead != numSampleTuplesWritten) {
+        printf("Error: i=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, max %d\n", i, numSampleTuplesWritten, numSampleTuplesRead, maxLength);
+        pass = false;
+      }
+      for (int j = 0; j < numSampleTuplesWritten*2 && pass; j++) {
+        if (destBuf[j] != sourceBuf[i*2 + j]) {
+          printf("Error: i=%d, source: %d, dest: %d\n", i + j/2, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+        }
+      }
+      i += numSampleTuplesWritten;
+    }
+    delete[] window;
+    // A decoder of a format with shorter blocks outputs silence of its own maximum length for a longer block
+    typedef MLACFormat<BLOCK_NUM_BYTES, maxLength, BLOCK_MIN_NUM_SAMPLETUPLES> ShortFormat;
+    MLACBasicDecoder<ShortFormat> shortDecoder;
+    encoder.blockMaxNumSampleTuples = BLOCK_MAX_NUM_SAMPLETUPLES;
+    uint8_t dataBuf[BLOCK_NUM_BYTES];
+    int numSampleTuplesWritten = 0;
+    int numBitsWritten;
+    for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && numSampleTuplesWritten <= maxLength; i += maxLength) {
+      encoder.encode(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+    }
+    int16_t *destBuf = new int16_t[maxLength*2];
+    uint8_t timeStamp;
+    int numSampleTuplesRead;
+    int bitDepth = shortDecoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+    if (numSampleTuplesWritten <= maxLength || bitDepth != 0 || numSampleTuplesRead != maxLength) {
+      printf("Error: block of %d sample tuples gave bitDepth=%d, numSampleTuplesRead=%d\n", numSampleTuplesWritten, bitDepth, numSampleTuplesRead);
+      pass = false;
+    }
+    for (int j = 0; j < numSampleTuplesRead*2 && pass; j++) {
+      if (destBuf[j] != 0) {
+        printf("Error: no silence at %d\n", j/2);
+        pass = false;
+      }
+    }
+    delete[] destBuf;
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_VARIABLE_LENGTH_PACKETS
+  printf("UNITTEST_VARIABLE_LENGTH_PACKETS: MLACEncoder.encodeNextVariableLength, MLACDecoder.decodeVariableLength\n");
+  pass = formatVariableLengthTest<MLACDefaultFormat>(200);
+  pass = formatVariableLengthTest<MLACFormat<512, 255, 120, MAX_LP_ORDER, true, true> >(200) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_NEAR_LOSSLESS
+  printf("UNITTEST_NEAR_LOSSLESS: MLACEncoder.encodeNext with minNumSampleTuples more than fit losslessly\n");
+  pass = true;
+  {
+    // Noisy audio forced to as many sample tuples as fit in CHMODE_MSB at 8 bits should give near-lossless blocks of more than 8 bits
+    const int numSampleTuples = 40*BLOCK_MAX_NUM_SAMPLETUPLES;
+    const int minNumSampleTuples = MLACDefaultFormat::chModeMSBNumSampleTuples(8);
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples*2; i++) {
+      sourceBuf[i] = sourceBuf[i]/2 + rand()%((i/(8*BLOCK_MAX_NUM_SAMPLETUPLES)%4 + 1)*512) - (i/(8*BLOCK_MAX_NUM_SAMPLETUPLES)%4 + 1)*256;
+    }
+    MLACEncoder encoder;
+    MLACDecoder decoder;
+    encoder.independentBlockInterval = 4;
+    int numNearLosslessBlocks = 0;
+    for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+      uint8_t dataBuf[BLOCK_NUM_BYTES];
+      int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+      int numSampleTuplesWritten;
+      int numBitsWritten;
+      int bitDepth = encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+      uint8_t timeStamp;
+      int numSampleTuplesRead;
+      int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+      if (numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numSampleTuplesWritten < minNumSampleTuples || numBitsWritten > BLOCK_NUM_BYTES*8) {
+        printf("Error: i=%d, bitDepth=%d, decoded bitDepth=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d\n", i, bitDepth, decodedBitDepth, numSampleTuplesWritten, numSampleTuplesRead);
+        pass = false;
+        break;
+      }
+      // The error of a sample is less than 2^(16 - bitDepth)
+      for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+        if (abs(destBuf[j] - sourceBuf[i*2 + j]) >= (1 << (16 - bitDepth))) {
+          printf("Error: i=%d, bitDepth=%d, source: %d, dest: %d\n", i + j/2, bitDepth, sourceBuf[i*2 + j], destBuf[j]);
+          pass = false;
+          break;
+        }
+      }
+      if (bitDepth > 8 && bitDepth < 16 && numSampleTuplesWritten > MLACDefaultFormat::chModeMSBNumSampleTuples(bitDepth)) {
+        numNearLosslessBlocks++;
+      }
+      i += numSampleTuplesWritten;
+    }
+    if (numNearLosslessBlocks == 0) {
+      printf("Error: no near-lossless blocks\n");
+      pass = false;
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_LOOKAHEAD
+  printf("UNITTEST_LOOKAHEAD: MLACEncoder.lookaheadNumBlocks with encodeNextVariableLength and encodeNext\n");
+  pass = formatVariableLengthTest<MLACDefaultFormat>(20, 3);
+  pass = formatStreamTest<MLACDefaultFormat>(20, 2) && pass;
+  printPass(pass);
+#endif
+#ifdef UNITTEST_FIXED_FRAMES
+  printf("UNITTEST_FIXED_FRAMES: MLACEncoder.frameNumSampleTuples\n");
+  pass = true;
+  {
+    // Audio of varying loudness with a silent stretch, in frames that fit losslessly and frames that do not
+    const int numSampleTuples = 40*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    for (int i = 0; i < numSampleTuples*2; i++) {
+      int noise = (i/(8*BLOCK_MAX_NUM_SAMPLETUPLES)%4)*256;
+      sourceBuf[i] = (i/(8*BLOCK_MAX_NUM_SAMPLETUPLES) == 2) ? 0 : sourceBuf[i]/2 + rand()%(2*noise + 1) - noise;
+    }
+    const int frameNumSampleTupless[3] = {BLOCK_MIN_NUM_SAMPLETUPLES + 1, (BLOCK_MIN_NUM_SAMPLETUPLES + BLOCK_MAX_NUM_SAMPLETUPLES)/2, BLOCK_MAX_NUM_SAMPLETUPLES};
+    for (int k = 0; k < 3*2 && pass; k++) {
+      MLACEncoder encoder;
+      MLACDecoder decoder;
+      encoder.frameNumSampleTuples = frameNumSampleTupless[k/2];
+      encoder.independentBlockInterval = 1 + (k % 2)*7;
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES];
+        int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int bitDepth = encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+        // The bits after numBitsWritten are free for other uses
+        for (int j = (numBitsWritten + 7)/8; j < BLOCK_NUM_BYTES; j++) {
+          dataBuf[j] = rand();
+        }
+        uint8_t timeStamp;
+        int numSampleTuplesRead;
+        int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+        if (numSampleTuplesWritten != encoder.frameNumSampleTuples || numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numBitsWritten > BLOCK_NUM_BYTES*8) {
+          printf("Error: k=%d, i=%d, bitDepth=%d, decoded bitDepth=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d\n", k, i, bitDepth, decodedBitDepth, numSampleTuplesWritten, numSampleTuplesRead);
+          pass = false;
+          break;
+        }
+        for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+          if (abs(destBuf[j] - sourceBuf[i*2 + j]) >= (1 << (16 - bitDepth))) {
+            printf("Error: k=%d, i=%d, bitDepth=%d, source: %d, dest: %d\n", k, i + j/2, bitDepth, sourceBuf[i*2 + j], destBuf[j]);
+            pass = false;
+            break;
+          }
+        }
+        i += numSampleTuplesWritten;
+      }
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_ANYTIME
+  printf("UNITTEST_ANYTIME: MLACEncoder.encodeAnytime\n");
+  pass = true;
+  {
+    // A deadline already passed gives a CHMODE_MSB block, and a distant one the full refinement
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    randomTestAudio(sourceBuf, numSampleTuples);
+    MLACEncoder encoder;
+    MLACEncoder referenceEncoder;
+    MLACDecoder decoder;
+    encoder.effort = EFFORT_MAX;
+    for (int k = 0; k < 2*2 && pass; k++) {
+      std::chrono::steady_clock::time_point deadline = (k % 2) ? std::chrono::steady_clock::now() + std::chrono::seconds(10) : std::chrono::steady_clock::time_point();
+      encoder.frameNumSampleTuples = (k/2) ? BLOCK_MAX_NUM_SAMPLETUPLES : 0;
+      referenceEncoder.frameNumSampleTuples = encoder.frameNumSampleTuples;
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES];
+        int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int refinementLevel;
+        int minNumSampleTuples = BLOCK_MIN_NUM_SAMPLETUPLES + rand()%(BLOCK_MAX_NUM_SAMPLETUPLES - BLOCK_MIN_NUM_SAMPLETUPLES + 1);
+        int bitDepth = encoder.encodeAnytime(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, deadline, refinementLevel, minNumSampleTuples);
+        int referenceNumSampleTuplesWritten;
+        int referenceNumBitsWritten;
+        uint8_t referenceBuf[BLOCK_NUM_BYTES];
+        int referenceBitDepth = referenceEncoder.encode(&sourceBuf[i*2], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten, minNumSampleTuples);
+        uint8_t timeStamp;
+        int numSampleTuplesRead;
+        int decodedBitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+        int expectedRefinementLevel = (k % 2) ? REFINEMENT_LPC + EFFORT_MAX : REFINEMENT_MSB;
+        bool notWorse = bitDepth > referenceBitDepth || (bitDepth == referenceBitDepth && numSampleTuplesWritten >= referenceNumSampleTuplesWritten);
+        if (refinementLevel != expectedRefinementLevel || numSampleTuplesRead != numSampleTuplesWritten || decodedBitDepth != bitDepth || numBitsWritten > BLOCK_NUM_BYTES*8 || ((k % 2) && !notWorse) || (encoder.frameNumSampleTuples && refinementLevel != REFINEMENT_MSB && numSampleTuplesWritten != encoder.frameNumSampleTuples)) {
+          printf("Error: k=%d, i=%d, refinementLevel=%d, bitDepth=%d, decoded bitDepth=%d, reference bitDepth=%d, numSampleTuplesWritten=%d, numSampleTuplesRead=%d, reference numSampleTuplesWritten=%d\n", k, i, refinementLevel, bitDepth, decodedBitDepth, referenceBitDepth, numSampleTuplesWritten, numSampleTuplesRead, referenceNumSampleTuplesWritten);
+          pass = false;
+          break;
+        }
+        for (int j = 0; j < numSampleTuplesWritten*2; j++) {
+          if (abs(destBuf[j] - sourceBuf[i*2 + j]) >= (1 << (16 - bitDepth))) {
+            printf("Error: k=%d, i=%d, bitDepth=%d, source: %d, dest: %d\n", k, i + j/2, bitDepth, sourceBuf[i*2 + j], destBuf[j]);
+            pass = false;
+            break;
+          }
+        }
+        i += numSampleTuplesWritten;
+      }
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_LADDER
+  printf("UNITTEST_LADDER: MLACBasicLadderEncoder.encode gives the same blocks as MLACEncoder.encode\n");
+  pass = true;
+  {
+    const int numRungs = 4;
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    uint8_t dataBufs[numRungs][BLOCK_NUM_BYTES];
+    uint8_t *outputs[numRungs];
+    uint8_t timeStamps[numRungs] = {0};
+    for (int rung = 0; rung < numRungs; rung++) {
+      outputs[rung] = dataBufs[rung];
+    }
+    MLACBasicLadderEncoder<MLACDefaultFormat, numRungs> ladderEncoder;
+    MLACEncoder referenceEncoder;
+    for (int k = 0; k < 2*(EFFORT_MAX + 1) && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      ladderEncoder.encoder.effort = k % (EFFORT_MAX + 1);
+      ladderEncoder.encoder.frameNumSampleTuples = (k/(EFFORT_MAX + 1)) ? (BLOCK_MIN_NUM_SAMPLETUPLES + BLOCK_MAX_NUM_SAMPLETUPLES)/2 : 0;
+      referenceEncoder.effort = ladderEncoder.encoder.effort;
+      referenceEncoder.frameNumSampleTuples = ladderEncoder.encoder.frameNumSampleTuples;
+      // Two rungs with the same minimum, the others random
+      int minNumSampleTuples[numRungs];
+      minNumSampleTuples[0] = BLOCK_MIN_NUM_SAMPLETUPLES;
+      for (int rung = 1; rung < numRungs; rung++) {
+        minNumSampleTuples[rung] = BLOCK_MIN_NUM_SAMPLETUPLES + rand()%(BLOCK_MAX_NUM_SAMPLETUPLES - BLOCK_MIN_NUM_SAMPLETUPLES + 1);
+      }
+      minNumSampleTuples[numRungs - 1] = minNumSampleTuples[1];
+      int positions[numRungs] = {0};
+      for (;;) {
+        bool end = false;
+        const int16_t *inputs[numRungs];
+        for (int rung = 0; rung < numRungs; rung++) {
+          end = end || positions[rung] > numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES;
+          inputs[rung] = &sourceBuf[positions[rung]*2];
+          memset(dataBufs[rung], 0, BLOCK_NUM_BYTES);
+        }
+        if (end || !pass) {
+          break;
+        }
+        int numSampleTuplesWritten[numRungs];
+        int numBitsWritten[numRungs];
+        int bitDepths[numRungs];
+        ladderEncoder.encode(inputs, outputs, timeStamps, minNumSampleTuples, numSampleTuplesWritten, numBitsWritten, bitDepths);
+        for (int rung = 0; rung < numRungs && pass; rung++) {
+          uint8_t referenceBuf[BLOCK_NUM_BYTES] = {0};
+          int referenceNumSampleTuplesWritten;
+          int referenceNumBitsWritten;
+          int referenceBitDepth = referenceEncoder.encode(inputs[rung], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten, minNumSampleTuples[rung]);
+          if (bitDepths[rung] != referenceBitDepth || numSampleTuplesWritten[rung] != referenceNumSampleTuplesWritten || numBitsWritten[rung] != referenceNumBitsWritten || memcmp(dataBufs[rung], referenceBuf, (numBitsWritten[rung] + 7)/8)) {
+            printf("Error: k=%d, rung=%d, position=%d, minNumSampleTuples=%d, bitDepth=%d, reference bitDepth=%d, numSampleTuplesWritten=%d, reference numSampleTuplesWritten=%d\n", k, rung, positions[rung], minNumSampleTuples[rung], bitDepths[rung], referenceBitDepth, numSampleTuplesWritten[rung], referenceNumSampleTuplesWritten);
+            pass = false;
+          }
+          positions[rung] += numSampleTuplesWritten[rung];
+        }
+      }
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_COMPACT_ENCODER
+  printf("UNITTEST_COMPACT_ENCODER: MLACCompactEncoder.encode gives the same blocks as MLACEncoder.encode at EFFORT_FASTEST\n");
+  pass = true;
+  {
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    MLACCompactEncoder compactEncoder;
+    MLACEncoder referenceEncoder;
+    for (int k = 0; k < 20 && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      compactEncoder.blockMaxNumSampleTuples = (k % 2) ? BLOCK_MIN_NUM_SAMPLETUPLES + 1 + rand()%(BLOCK_MAX_NUM_SAMPLETUPLES - BLOCK_MIN_NUM_SAMPLETUPLES) : BLOCK_MAX_NUM_SAMPLETUPLES;
+      referenceEncoder.blockMaxNumSampleTuples = compactEncoder.blockMaxNumSampleTuples;
+      int minNumSampleTuples = (k % 4 < 2) ? BLOCK_MIN_NUM_SAMPLETUPLES : BLOCK_MIN_NUM_SAMPLETUPLES + rand()%(compactEncoder.blockMaxNumSampleTuples - BLOCK_MIN_NUM_SAMPLETUPLES + 1);
+      for (int position = 0; position <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES] = {0};
+        uint8_t referenceBuf[BLOCK_NUM_BYTES] = {0};
+        int numSampleTuplesWritten, referenceNumSampleTuplesWritten;
+        int numBitsWritten, referenceNumBitsWritten;
+        int bitDepth = compactEncoder.encode(&sourceBuf[position*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+        int referenceBitDepth = referenceEncoder.encode(&sourceBuf[position*2], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten, minNumSampleTuples);
+        if (bitDepth != referenceBitDepth || numSampleTuplesWritten != referenceNumSampleTuplesWritten || numBitsWritten != referenceNumBitsWritten || memcmp(dataBuf, referenceBuf, BLOCK_NUM_BYTES)) {
+          printf("Error: k=%d, position=%d, minNumSampleTuples=%d, bitDepth=%d, reference bitDepth=%d, numSampleTuplesWritten=%d, reference numSampleTuplesWritten=%d\n", k, position, minNumSampleTuples, bitDepth, referenceBitDepth, numSampleTuplesWritten, referenceNumSampleTuplesWritten);
+          pass = false;
+        }
+        position += numSampleTuplesWritten;
+      }
+    }
+    // Mono
+    MLACBasicCompactEncoder<MLACMonoFormat<MLACDefaultFormat> > monoCompactEncoder;
+    MLACMonoEncoder monoReferenceEncoder;
+    const int monoBlockMaxNumSampleTuples = MLACMonoFormat<MLACDefaultFormat>::BLOCK_MAX_NUM_SAMPLETUPLES;
+    for (int k = 0; k < 4 && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      for (int position = 0; position <= numSampleTuples*2 - monoBlockMaxNumSampleTuples && pass;) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES] = {0};
+        uint8_t referenceBuf[BLOCK_NUM_BYTES] = {0};
+        int numSampleTuplesWritten, referenceNumSampleTuplesWritten;
+        int numBitsWritten, referenceNumBitsWritten;
+        int bitDepth = monoCompactEncoder.encode(&sourceBuf[position], dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+        int referenceBitDepth = monoReferenceEncoder.encode(&sourceBuf[position], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten);
+        if (bitDepth != referenceBitDepth || numSampleTuplesWritten != referenceNumSampleTuplesWritten || numBitsWritten != referenceNumBitsWritten || memcmp(dataBuf, referenceBuf, BLOCK_NUM_BYTES)) {
+          printf("Error: mono, k=%d, position=%d, bitDepth=%d, reference bitDepth=%d, numSampleTuplesWritten=%d, reference numSampleTuplesWritten=%d\n", k, position, bitDepth, referenceBitDepth, numSampleTuplesWritten, referenceNumSampleTuplesWritten);
+          pass = false;
+        }
+        position += numSampleTuplesWritten;
+      }
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_CONVERTED_INPUT
+  printf("UNITTEST_CONVERTED_INPUT: MLACEncoder.encode and encodeNext of int16_t, int32_t and float input, interleaved and planar\n");
+  pass = true;
+  {
+    // Each input holds the same 16-bit samples, so the output must be the same as of the int16_t entry points
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    int16_t *planarBuf = new int16_t[numSampleTuples*2];
+    int32_t *int32Buf = new int32_t[numSampleTuples*2];
+    float *floatBuf = new float[numSampleTuples*2];
+    for (int k = 0; k < 3*(EFFORT_MAX + 1) && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      for (int i = 0; i < numSampleTuples; i++) {
+        planarBuf[i] = sourceBuf[i*2];
+        planarBuf[numSampleTuples + i] = sourceBuf[i*2 + 1];
+        int32Buf[i] = sourceBuf[i*2]*256 + (rand() & 0xff);
+        int32Buf[numSampleTuples + i] = sourceBuf[i*2 + 1]*256 + (rand() & 0xff);
+        floatBuf[i*2] = sourceBuf[i*2]/32768.0f;
+        floatBuf[i*2 + 1] = sourceBuf[i*2 + 1]/32768.0f;
+      }
+      MLACEncoder referenceEncoder;
+      MLACEncoder encoders[3];
+      referenceEncoder.effort = k % (EFFORT_MAX + 1);
+      referenceEncoder.independentBlockInterval = 1 + k % 3;
+      for (int n = 0; n < 3; n++) {
+        encoders[n].effort = referenceEncoder.effort;
+        encoders[n].independentBlockInterval = referenceEncoder.independentBlockInterval;
+      }
+      bool next = k/(EFFORT_MAX + 1) != 0;
+      for (int i = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass;) {
+        int minNumSampleTuples = (k/(EFFORT_MAX + 1) == 2) ? BLOCK_MIN_NUM_SAMPLETUPLES + rand()%(BLOCK_MAX_NUM_SAMPLETUPLES - BLOCK_MIN_NUM_SAMPLETUPLES + 1) : BLOCK_MIN_NUM_SAMPLETUPLES;
+        uint8_t referenceBuf[BLOCK_NUM_BYTES] = {0};
+        int referenceNumSampleTuplesWritten;
+        int referenceNumBitsWritten;
+        int referenceBitDepth = next ? referenceEncoder.encodeNext(&sourceBuf[i*2], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten, minNumSampleTuples) : referenceEncoder.encode(&sourceBuf[i*2], referenceBuf, 0, referenceNumSampleTuplesWritten, referenceNumBitsWritten, minNumSampleTuples);
+        MLACInput<int16_t> planarInput = {&planarBuf[i], &planarBuf[numSampleTuples + i], 1, 0};
+        MLACInput<int32_t> int32Input = {&int32Buf[i], &int32Buf[numSampleTuples + i], 1, 8};
+        MLACInput<float> floatInput = {&floatBuf[i*2], &floatBuf[i*2 + 1], 2, 0};
+        for (int n = 0; n < 3 && pass; n++) {
+          uint8_t dataBuf[BLOCK_NUM_BYTES] = {0};
+          int numSampleTuplesWritten;
+          int numBitsWritten;
+          int bitDepth;
+          if (n == 0) {
+            bitDepth = next ? encoders[n].encodeNext(planarInput, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples) : encoders[n].encode(planarInput, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+          } else if (n == 1) {
+            bitDepth = next ? encoders[n].encodeNext(int32Input, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples) : encoders[n].encode(int32Input, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+          } else {
+            bitDepth = next ? encoders[n].encodeNext(floatInput, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples) : encoders[n].encode(floatInput, dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+          }
+          if (bitDepth != referenceBitDepth || numSampleTuplesWritten != referenceNumSampleTuplesWritten || numBitsWritten != referenceNumBitsWritten || memcmp(dataBuf, referenceBuf, BLOCK_NUM_BYTES)) {
+            printf("Error: k=%d, n=%d, i=%d, bitDepth=%d, reference bitDepth=%d, numSampleTuplesWritten=%d, reference numSampleTuplesWritten=%d\n", k, n, i, bitDepth, referenceBitDepth, numSampleTuplesWritten, referenceNumSampleTuplesWritten);
+            pass = false;
+          }
+        }
+        i += referenceNumSampleTuplesWritten;
+      }
+    }
+    // Dithered float input stays within a LSB of the input and clips
+    MLACEncoder encoder;
+    encoder.dither = true;
+    for (int i = 0; i < BLOCK_MAX_NUM_SAMPLETUPLES*2; i++) {
+      floatBuf[i] = (i < 20) ? ((i & 1) ? 2.0f : -2.0f) : sourceBuf[i]/32768.0f;
+    }
+    MLACInput<float> floatInput = {&floatBuf[0], &floatBuf[1], 2, 0};
+    uint8_t dataBuf[BLOCK_NUM_BYTES];
+    int16_t destBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+    int numSampleTuplesWritten, numBitsWritten, numSampleTuplesRead;
+    uint8_t timeStamp;
+    encoder.encode(floatInput, dataBuf, 0, numSampleTuplesWritten, numBitsWritten);
+    MLACDecoder decoder;
+    int bitDepth = decoder.decode(dataBuf, destBuf, timeStamp, numSampleTuplesRead);
+    for (int j = 0; j < numSampleTuplesRead*2 && pass; j++) {
+      int expected = (j < 20) ? ((j & 1) ? 32767 : -32768) : sourceBuf[j];
+      if (abs(destBuf[j] - expected) > (1 << (16 - bitDepth))) {
+        printf("Error: dither, j=%d, expected: %d, dest: %d\n", j, expected, destBuf[j]);
+        pass = false;
+      }
+    }
+    delete[] sourceBuf;
+    delete[] planarBuf;
+    delete[] int32Buf;
+    delete[] floatBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_CONVERTED_OUTPUT
+  printf("UNITTEST_CONVERTED_OUTPUT: MLACDecoder.decode to int16_t, int32_t and float output, interleaved, planar and strided\n");
+  pass = true;
+  {
+    // Lossless, lossy, constant run and continuation blocks, and continuation blocks after a restart, decoded to each output
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    const int stride = 3;
+    int16_t *sourceBuf = new int16_t[numSampleTuples*2];
+    int16_t referenceBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+    int16_t planarBuf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+    int32_t int32Buf[BLOCK_MAX_NUM_SAMPLETUPLES*2];
+    float floatBuf[BLOCK_MAX_NUM_SAMPLETUPLES*stride];
+    for (int k = 0; k < 8 && pass; k++) {
+      randomTestAudio(sourceBuf, numSampleTuples);
+      for (int i = 2*BLOCK_MAX_NUM_SAMPLETUPLES; i < 5*BLOCK_MAX_NUM_SAMPLETUPLES; i++) {
+        sourceBuf[i*2] = 1234;
+        sourceBuf[i*2 + 1] = -5;
+      }
+      MLACEncoder encoder;
+      encoder.independentBlockInterval = 1 + k % 4;
+      MLACDecoder referenceDecoder;
+      MLACDecoder decoders[3];
+      for (int i = 0, block = 0; i <= numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES && pass; block++) {
+        uint8_t dataBuf[BLOCK_NUM_BYTES];
+        int numSampleTuplesWritten;
+        int numBitsWritten;
+        int minNumSampleTuples = (k & 1) ? BLOCK_MIN_NUM_SAMPLETUPLES + rand()%(BLOCK_MAX_NUM_SAMPLETUPLES - BLOCK_MIN_NUM_SAMPLETUPLES + 1) : BLOCK_MIN_NUM_SAMPLETUPLES;
+        encoder.encodeNext(&sourceBuf[i*2], dataBuf, 0, numSampleTuplesWritten, numBitsWritten, minNumSampleTuples);
+        if (block == 5) {
+          referenceDecoder.restartStream();
+          for (int n = 0; n < 3; n++) {
+            decoders[n].restartStream();
+          }
+        }
+        uint8_t timeStamp;
+        int referenceNumSampleTuplesRead;
+        int referenceBitDepth = referenceDecoder.decode(dataBuf, referenceBuf, timeStamp, referenceNumSampleTuplesRead);
+        MLACOutput<int16_t> planarOutput = {&planarBuf[0], &planarBuf[BLOCK_MAX_NUM_SAMPLETUPLES], 1, 0};
+        MLACOutput<int32_t> int32Output = {&int32Buf[0], &int32Buf[1], 2, 16};
+        MLACOutput<float> floatOutput = {&floatBuf[0], &floatBuf[1], stride, 0};
+        int numSampleTuplesRead[3];
+        int bitDepths[3];
+        bitDepths[0] = decoders[0].decode(dataBuf, planarOutput, timeStamp, numSampleTuplesRead[0]);
+        bitDepths[1] = decoders[1].decode(dataBuf, int32Output, timeStamp, numSampleTuplesRead[1]);
+        bitDepths[2] = decoders[2].decode(dataBuf, floatOutput, timeStamp, numSampleTuplesRead[2]);
+        for (int n = 0; n < 3; n++) {
+          if (numSampleTuplesRead[n] != referenceNumSampleTuplesRead || bitDepths[n] != referenceBitDepth) {
+            printf("Error: k=%d, block=%d, n=%d, numSampleTuplesRead=%d, reference numSampleTuplesRead=%d, bitDepth=%d, reference bitDepth=%d\n", k, block, n, numSampleTuplesRead[n], referenceNumSampleTuplesRead, bitDepths[n], referenceBitDepth);
+            pass = false;
+          }
+        }
+        for (int j = 0; j < referenceNumSampleTuplesRead && pass; j++) {
+          for (int channel = 0; channel < 2; channel++) {
+            int16_t reference = referenceBuf[j*2 + channel];
+            if (planarBuf[channel*BLOCK_MAX_NUM_SAMPLETUPLES + j] != reference || int32Buf[j*2 + channel] != reference*65536 || floatBuf[j*stride + channel] != reference/32768.0f) {
+              printf("Error: k=%d, block=%d, j=%d, channel=%d, reference: %d, int16_t: %d, int32_t: %d, float: %f\n", k, block, j, channel, reference, planarBuf[channel*BLOCK_MAX_NUM_SAMPLETUPLES + j], int32Buf[j*2 + channel], floatBuf[j*stride + channel]);
+              pass = false;
+              break;
+            }
+          }
+        }
+        i += numSampleTuplesWritten;
+      }
+    }
+    delete[] sourceBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_MONO
+  printf("UNITTEST_MONO: MLACMonoEncoder.encodeNext, MLACMonoDecoder.decode, in fewer blocks than the same audio in both channels\n");
+  pass = true;
+  {
+    long numMonoBlocks, numStereoBlocks;
+    pass = formatMonoTest<MLACDefaultFormat>(3*(EFFORT_MAX + 1), numMonoBlocks, numStereoBlocks);
+    if (pass && numMonoBlocks >= numStereoBlocks) {
+      printf("Error: %ld mono blocks, %ld stereo blocks\n", numMonoBlocks, numStereoBlocks);
+      pass = false;
+    }
+    long numHighOrderMonoBlocks, numHighOrderStereoBlocks;
+    pass = pass && formatMonoTest<MLACFormat<MLAC_BLOCK_NUM_BYTES, MLAC_BLOCK_MAX_NUM_SAMPLETUPLES, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES, 8, true, true> >(2*(EFFORT_MAX + 1), numHighOrderMonoBlocks, numHighOrderStereoBlocks);
+    printf("Mono: %ld blocks, same audio in both channels: %ld blocks\n", numMonoBlocks, numStereoBlocks);
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_MULTI_CHANNEL
+  printf("UNITTEST_MULTI_CHANNEL: MLACBasicMultiChannelEncoder.encodeNextVariableLength, MLACBasicMultiChannelDecoder.decodeVariableLength of 5 channels, and restartStream of both\n");
+  pass = true;
+  {
+    const int numChannels = 5;
+    const int numSampleTuples = 20*BLOCK_MAX_NUM_SAMPLETUPLES;
+    const int maxNumPackets = 3*numSampleTuples/BLOCK_MIN_NUM_SAMPLETUPLES;
+    int16_t *stereoBuf = new int16_t[numSampleTuples*2];
+    int16_t *sourceBuf = new int16_t[numSampleTuples*numChannels];
+    int16_t *destBuf = new int16_t[(numSampleTuples + BLOCK_MAX_NUM_SAMPLETUPLES)*numChannels];
+    uint8_t *dataBuf = new uint8_t[maxNumPackets*MLACDefaultFormat::VARIABLE_LENGTH_PACKET_MAX_NUM_BYTES];
+    for (int k = 0; k < EFFORT_MAX + 1 && pass; k++) {
+      for (int channel = 0; channel < numChannels; channel += 2) {
+        randomTestAudio(stereoBuf, numSampleTuples);
+        for (int i = 0; i < numSampleTuples; i++) {
+          sourceBuf[i*numChannels + channel] = stereoBuf[i*2];
+          if (channel + 1 < numChannels) {
+            sourceBuf[i*numChannels + channel + 1] = stereoBuf[i*2 + 1];
+          }
+        }
+      }
+      MLACBasicMultiChannelEncoder<MLACDefaultFormat, numChannels> encoder;
+      for (int pair = 0; pair < encoder.NUM_PAIRS; pair++) {
+        encoder.pairs[pair].effort = (k + pair) % (EFFORT_MAX + 1);
+        encoder.pairs[pair].independentBlockInterval = 4;
+      }
+      encoder.last.effort = k;
+      encoder.last.independentBlockInterval = 4;
+      // Encode until every stream has reached the end of the input, restarting the streams from the beginning once
+      int streams[maxNumPackets];
+      int numPackets = 0;
+      int numBytes = 0;
+      int restartPacket = 3*numChannels;
+      for (;;) {
+        if (numPackets == restartPacket) {
+          encoder.restartStream();
+        }
+        int stream = encoder.nextStream();
+        if (encoder.positions[stream] > numSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES) {
+          break;
+        }
+        int numSampleTuplesWritten;
+        int numBytesWritten;
+        encoder.encodeNextVariableLength(&sourceBuf[encoder.positions[stream]*numChannels], &dataBuf[numBytes], 0, streams[numPackets], numSampleTuplesWritten, numBytesWritten);
+        numBytes += numBytesWritten;
+        numPackets++;
+      }
+      MLACBasicMultiChannelDecoder<MLACDefaultFormat, numChannels> decoder;
+      for (int b = 0, pos = 0; b < numPackets && pass; b++) {
+        if (b == restartPacket) {
+          decoder.restartStream();
+        }
+        int stream = decoder.nextStream();
+        uint8_t timeStamp;
+        int numSampleTuplesRead;
+        int numBytesRead;
+        long start = decoder.positions[stream];
+        int bitDepth = decoder.decodeVariableLength(&dataBuf[pos], &destBuf[start*numChannels], timeStamp, stream, numSampleTuplesRead, numBytesRead);
+        if (stream != streams[b]) {
+          printf("Error: k=%d, b=%d, stream=%d, encoded stream=%d\n", k, b, stream, streams[b]);
+          pass = false;
+        }
+        for (int j = 0; pass && j < numSampleTuplesRead; j++) {
+          for (int channel = stream*2; channel < stream*2 + 2 && channel < numChannels; channel++) {
+            int16_t source = sourceBuf[(start + j)*numChannels + channel];
+            int16_t dest = destBuf[(start + j)*numChannels + channel];
+            if (abs(dest - source) >= (1 << (16 - bitDepth))) {
+              printf("Error: k=%d, b=%d, i=%ld, channel=%d, bitDepth=%d, source: %d, dest: %d\n", k, b, start + j, channel, bitDepth, source, dest);
+              pass = false;
+            }
+          }
+        }
+        pos += numBytesRead;
+      }
+      for (int stream = 0; stream < decoder.NUM_STREAMS; stream++) {
+        if (pass && decoder.positions[stream] != encoder.positions[stream]) {
+          printf("Error: k=%d, stream=%d, decoded %ld sample tuples, encoded %ld\n", k, stream, decoder.positions[stream], encoder.positions[stream]);
+          pass = false;
+        }
+      }
+    }
+    delete[] stereoBuf;
+    delete[] sourceBuf;
+    delete[] destBuf;
+    delete[] dataBuf;
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_24_BIT
+  printf("UNITTEST_24_BIT: MLACBasicEncoder.encodeNext, MLACBasicDecoder.decode of MLAC24BitFormat\n");
+  pass = true;
+  {
+    long numLosslessBlocks, numMonoLosslessBlocks;
+    pass = format24BitTest<MLAC24BitFormat<MLACFormat<1024, 255, 60> > >(2*(EFFORT_MAX + 1), numLosslessBlocks);
+    pass = pass && format24BitTest<MLACMonoFormat<MLAC24BitFormat<MLACFormat<512, 255, 60, 8, true, true> > > >(2*(EFFORT_MAX + 1), numMonoLosslessBlocks);
+    if (pass && (numLosslessBlocks == 0 || numMonoLosslessBlocks == 0)) {
+      printf("Error: %ld stereo and %ld mono lossless blocks\n", numLosslessBlocks, numMonoLosslessBlocks);
+      pass = false;
+    }
+  }
+  printPass(pass);
+#endif
+#ifdef UNITTEST_INCREMENTAL_DECODING
+  printf("UNITTEST_INCREMENTAL_DECODING: MLACBasicIncrementalDecoder.decodeFragment gives the same output as MLACBasicDecoder.decode\n");
+  pass = true;
+  {
+    long numEarlySampleTuples[4], numSampleTuplesDecoded[4];
+    pass = formatIncrementalTest<MLACDefaultFormat>(2*(EFFORT_MAX + 1), numEarlySampleTuples[0], numSampleTuplesDecoded[0]);
+    pass = pass && formatIncrementalTest<MLACFormat<MLAC_BLOCK_NUM_BYTES, MLAC_BLOCK_MAX_NUM_SAMPLETUPLES, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES, 8, true> >(2*(EFFORT_MAX + 1), numEarlySampleTuples[1], numSampleTuplesDecoded[1]);
+    pass = pass && formatIncrementalTest<MLACFormat<MLAC_BLOCK_NUM_BYTES, MLAC_BLOCK_MAX_NUM_SAMPLETUPLES, MLAC_BLOCK_MIN_NUM_SAMPLETUPLES, 8, false, true> >(2*(EFFORT_MAX + 1), numEarlySampleTuples[2], numSampleTuplesDecoded[2]);
+    pass = pass && formatIncrementalTest<MLACMonoFormat<MLACFormat<128, 63, 32> > >(2*(EFFORT_MAX + 1), numEarlySampleTuples[3], numSampleTuplesDecoded[3]);
+    // Linear prediction blocks of MLAC24BitFormat are decoded only once they have fully arrived
+    long num24BitEarlySampleTuples, num24BitSampleTuplesDecoded;
+    pass = pass && formatIncrementalTest<MLAC24BitFormat<MLACFormat<512, 255, 60> > >(EFFORT_MAX + 1, num24BitEarlySampleTuples, num24BitSampleTuplesDecoded);
+    for (int format = 0; pass && format < 4; format++) {
+      printf("Format %d: %.1f %% of sample tuples decoded before the last fragment of their block\n", format, 100.0*numEarlySampleTuples[format]/numSampleTuplesDecoded[format]);
+      if (numEarlySampleTuples[format]*2 < numSampleTuplesDecoded[format]) {
+        printf("Error: too few\n");
+        pass = false;
+      }
+    }
+  }
+  printPass(pass);
+#endif
 #ifdef SPEEDTEST_LOSSLESS_TRANSCODE
   printf("SPEEDTEST_LOSSLESS_TRANSCODE: Test speed of encoder and decoder on CD audio.\n");
   pass = true;
@@ -477,7 +2041,7 @@ int main() {
     for (;audioBufPos <= totalNumSampleTuples - BLOCK_MAX_NUM_SAMPLETUPLES;) {
       int numSampleTuplesWritten;
       int numBitsWritten;
-      encoder.encode(&audioBuf[audioBufPos*2], &codedBuf[codedBufPos], 0, numSampleTuplesWritten, numBitsWritten);
+      encoder.encodeNext(&audioBuf[audioBufPos*2], &codedBuf[codedBufPos], 0, numSampleTuplesWritten, numBitsWritten);
       audioBufPos += numSampleTuplesWritten;
       codedBufPos += BLOCK_NUM_BYTES;
     }